@@ -0,0 +1,185 @@
+/*
+ * Sistemas operativos empotrados
+ * Driver para el módulo de control de reloj y reset (CRM) del MC1322x
+ */
+
+#include <errno.h>
+
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Acceso estructurado a los registros del CRM que usa el driver
+ */
+typedef struct
+{
+	uint32_t sys_cntl;			/* 0x00 */
+	uint32_t wu_cntl;			/* 0x04 */
+	uint32_t sleep_cntl;		/* 0x08 */
+	uint32_t bs_cntl;			/* 0x0C */
+	uint32_t cop_cntl;			/* 0x10 */
+	uint32_t cop_service;		/* 0x14 */
+	uint32_t status;			/* 0x18 */
+	uint32_t mod_status;		/* 0x1C */
+	uint32_t wu_count;			/* 0x20 */
+	uint32_t wu_timeout;		/* 0x24 */
+} crm_regs_t;
+
+static volatile crm_regs_t* const crm_regs = CRM_BASE;
+
+/**
+ * Bits de los registros
+ */
+#define CRM_WU_CNTL_TIMER_WU_EN		(1 << 0)		/* Despertar por temporizador */
+#define CRM_WU_CNTL_EXT_WU_EN(m)	((m) & (0xF << 4))	/* Despertar por KBI4-7 */
+#define CRM_WU_CNTL_EXT_WU_EDGE(m)	(((m) & (0xF << 4)) << 4)	/* Por flanco en vez de por nivel */
+#define CRM_WU_CNTL_EXT_WU_POL(m)	(((m) & (0xF << 4)) << 8)	/* Flanco de subida o nivel alto */
+#define CRM_WU_CNTL_EXT_WU_IEN(m)	(((m) & (0xF << 4)) << 16)	/* Interrupción en vez de sólo despertar */
+#define CRM_SLEEP_CNTL_HIB			(1 << 0)
+#define CRM_SLEEP_CNTL_DOZE			(1 << 1)
+#define CRM_SLEEP_CNTL_RAM_RET_96K	(3 << 4)		/* Conserva toda la RAM */
+#define CRM_SLEEP_CNTL_MCU_RET		(1 << 6)		/* Conserva el estado de la CPU y los periféricos */
+#define CRM_STATUS_SLEEP_SYNC		(1 << 0)
+#define CRM_STATUS_HIB_WU_EVT		(1 << 1)
+#define CRM_STATUS_DOZE_WU_EVT		(1 << 2)
+#define CRM_STATUS_EXT_WU_EVT		(0xF << 4)
+
+/**
+ * Pines KBI con interrupción. Sus bits coinciden con los de EXT_WU_EVT
+ */
+static volatile uint32_t crm_kbi_irq;
+
+/*****************************************************************************/
+
+/**
+ * Manejador de la interrupción del CRM. Atiende los flancos de los pines KBI
+ * con interrupción
+ * @param src	Fuente (itc_src_crm)
+ * @param ctx	No se usa
+ */
+static void crm_isr (itc_src_t src, void *ctx)
+{
+	uint32_t events = crm_regs->status & crm_kbi_irq;
+	uint32_t signals = 0;
+	uint32_t kbi;
+
+	crm_regs->status = events;
+
+	/* KBI0 a KBI7 son los GPIO22 a GPIO29 */
+	for (kbi = 4; kbi < 8; kbi++)
+		if (events & CRM_WAKE_KBI (kbi))
+		{
+			bsp_event_notify (bsp_event_gpio, gpio_pin_22 + kbi, bsp_event_normal);
+			signals |= BSP_PT_SIGNAL_KBI (kbi);
+		}
+
+	if (signals)
+		bsp_pt_signal (signals);
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el CRM sin fuentes de despertar ni interrupciones de los pines KBI
+ */
+void crm_init (void)
+{
+	crm_kbi_irq = 0;
+	crm_regs->wu_cntl = 0;
+	crm_regs->status = CRM_STATUS_HIB_WU_EVT | CRM_STATUS_DOZE_WU_EVT | CRM_STATUS_EXT_WU_EVT;
+
+	itc_set_priority (itc_src_crm, itc_priority_normal);
+	itc_set_handler (itc_src_crm, crm_isr, NULL);
+	itc_enable_interrupt (itc_src_crm);
+}
+
+/*****************************************************************************/
+
+/**
+ * Habilita la interrupción por flanco de subida de los pines KBI4 a KBI7
+ * (GPIO26 a GPIO29), que deben estar configurados como entradas. Cada flanco
+ * publica el evento bsp_event_gpio con el pin como fuente y envía la señal
+ * BSP_PT_SIGNAL_KBI a las corrutinas. Los flancos también despiertan al
+ * procesador en doze y hibernate
+ * @param kbi	Pines con interrupción (ver CRM_WAKE_KBI). 0 para ninguno
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t crm_set_kbi_irq (uint32_t kbi)
+{
+	uint32_t i_bit, old;
+
+	if (kbi & ~CRM_WAKE_KBI_ALL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* crm_sleep modifica wu_cntl con la IRQ deshabilitada */
+	i_bit = excep_disable_irq ();
+	old = crm_kbi_irq;
+	crm_regs->wu_cntl &= ~(CRM_WU_CNTL_EXT_WU_EN (old) | CRM_WU_CNTL_EXT_WU_EDGE (old) |
+			CRM_WU_CNTL_EXT_WU_POL (old) | CRM_WU_CNTL_EXT_WU_IEN (old));
+	crm_regs->status = kbi & ~old;		/* Descarta los flancos anteriores */
+	crm_regs->wu_cntl |= CRM_WU_CNTL_EXT_WU_EN (kbi) | CRM_WU_CNTL_EXT_WU_EDGE (kbi) |
+			CRM_WU_CNTL_EXT_WU_POL (kbi) | CRM_WU_CNTL_EXT_WU_IEN (kbi);
+	crm_kbi_irq = kbi;
+	excep_restore_irq (i_bit);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Entra en un modo de bajo consumo y espera a despertar. La RAM y el estado de
+ * los periféricos se conservan. El llamante debe haber deshabilitado las
+ * interrupciones: las que lleguen en doze despiertan a la CPU igualmente y se
+ * atienden al restaurarlas
+ * @param mode		Modo de bajo consumo
+ * @param timeout	Tiempo máximo dormido, en ticks de CRM_SLEEP_HZ. 0 para no
+ * 					usar el temporizador de despertar
+ * @param kbi		Pines KBI que despiertan con un flanco de subida
+ * 					(ver CRM_WAKE_KBI)
+ * @param slept		Destino del tiempo dormido, en ticks de CRM_SLEEP_HZ
+ * @return	Las causas del despertar (ver CRM_WAKE_TIMER y CRM_WAKE_KBI)
+ */
+uint32_t crm_sleep (crm_sleep_mode_t mode, uint32_t timeout, uint32_t kbi, uint32_t *slept)
+{
+	uint32_t wu_cntl = crm_regs->wu_cntl;
+	uint32_t cause = 0;
+	uint32_t count;
+
+	/* Las fuentes de despertar sólo se activan mientras se duerme */
+	crm_regs->wu_timeout = timeout;
+	crm_regs->wu_cntl = wu_cntl | (timeout ? CRM_WU_CNTL_TIMER_WU_EN : 0) |
+			CRM_WU_CNTL_EXT_WU_EN (kbi) | CRM_WU_CNTL_EXT_WU_EDGE (kbi) | CRM_WU_CNTL_EXT_WU_POL (kbi);
+
+	crm_regs->sleep_cntl = ((mode == crm_hibernate) ? CRM_SLEEP_CNTL_HIB : CRM_SLEEP_CNTL_DOZE) |
+			CRM_SLEEP_CNTL_RAM_RET_96K | CRM_SLEEP_CNTL_MCU_RET;
+
+	/* SLEEP_SYNC se pone a 1 al estar listo para dormir y al despertar. Se borra
+	 * escribiendo un 1, que en el primer caso es lo que detiene el reloj */
+	while (!(crm_regs->status & CRM_STATUS_SLEEP_SYNC));
+	crm_regs->status = CRM_STATUS_SLEEP_SYNC;
+	while (!(crm_regs->status & CRM_STATUS_SLEEP_SYNC));
+	crm_regs->status = CRM_STATUS_SLEEP_SYNC;
+
+	count = crm_regs->wu_count;
+	if (timeout && count >= timeout)
+		cause |= CRM_WAKE_TIMER;
+	cause |= crm_regs->status & kbi & ~crm_kbi_irq & CRM_STATUS_EXT_WU_EVT;
+
+	/* Los flancos de los pines con interrupción se quedan para crm_isr */
+	crm_regs->status = CRM_STATUS_HIB_WU_EVT | CRM_STATUS_DOZE_WU_EVT |
+			(CRM_STATUS_EXT_WU_EVT & ~crm_kbi_irq);
+	crm_regs->wu_cntl = wu_cntl;
+
+	if (slept)
+		*slept = count;
+
+	return cause;
+}
+
+/*****************************************************************************/
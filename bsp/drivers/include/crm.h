@@ -0,0 +1,75 @@
+/*
+ * Sistemas operativos empotrados
+ * Driver para el módulo de control de reloj y reset (CRM) del MC1322x
+ */
+
+#ifndef __CRM_H__
+#define __CRM_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Modos de bajo consumo
+ */
+typedef enum
+{
+	crm_doze = 0,		/* Para el reloj de la CPU. Los periféricos siguen funcionando
+						   y sus interrupciones la despiertan */
+	crm_hibernate,		/* Para también el oscilador de referencia y los periféricos.
+						   Sólo despiertan el temporizador de despertar y los pines KBI */
+	crm_sleep_mode_max
+} crm_sleep_mode_t;
+
+/*****************************************************************************/
+
+/**
+ * Causas del despertar retornadas por crm_sleep. Los pines KBI4 a KBI7
+ * (GPIO26 a GPIO29) usan los bits 4 a 7
+ */
+#define CRM_WAKE_TIMER		(1 << 0)
+#define CRM_WAKE_KBI(n)		(1 << (n))
+#define CRM_WAKE_KBI_ALL	(0xF << 4)
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el CRM sin fuentes de despertar ni interrupciones de los pines KBI
+ */
+void crm_init (void);
+
+/*****************************************************************************/
+
+/**
+ * Habilita la interrupción por flanco de subida de los pines KBI4 a KBI7
+ * (GPIO26 a GPIO29), que deben estar configurados como entradas. Cada flanco
+ * publica el evento bsp_event_gpio con el pin como fuente y envía la señal
+ * BSP_PT_SIGNAL_KBI a las corrutinas. Los flancos también despiertan al
+ * procesador en doze y hibernate
+ * @param kbi	Pines con interrupción (ver CRM_WAKE_KBI). 0 para ninguno
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t crm_set_kbi_irq (uint32_t kbi);
+
+/*****************************************************************************/
+
+/**
+ * Entra en un modo de bajo consumo y espera a despertar. La RAM y el estado de
+ * los periféricos se conservan. El llamante debe haber deshabilitado las
+ * interrupciones: las que lleguen en doze despiertan a la CPU igualmente y se
+ * atienden al restaurarlas
+ * @param mode		Modo de bajo consumo
+ * @param timeout	Tiempo máximo dormido, en ticks de CRM_SLEEP_HZ. 0 para no
+ * 					usar el temporizador de despertar
+ * @param kbi		Pines KBI que despiertan con un flanco de subida
+ * 					(ver CRM_WAKE_KBI)
+ * @param slept		Destino del tiempo dormido, en ticks de CRM_SLEEP_HZ
+ * @return	Las causas del despertar (ver CRM_WAKE_TIMER y CRM_WAKE_KBI)
+ */
+uint32_t crm_sleep (crm_sleep_mode_t mode, uint32_t timeout, uint32_t kbi, uint32_t *slept);
+
+/*****************************************************************************/
+
+#endif /* __CRM_H__ */
@@ -44,9 +44,60 @@ typedef enum
 /*****************************************************************************/
 
 /**
- * Prototipo para los manejadores de interrupción
+ * Máscaras de fuentes para las secciones críticas
  */
-typedef void (* itc_handler_t) (void);
+#define ITC_SRC_MASK(src)	(1u << (src))
+#define ITC_SRC_ALL			((1u << itc_src_max) - 1)
+
+/**
+ * Estado guardado por una sección crítica
+ */
+typedef uint32_t itc_critical_t;
+
+/*****************************************************************************/
+
+/**
+ * Prototipo para los manejadores de interrupción. Un mismo manejador puede
+ * atender varias fuentes e instancias del mismo periférico
+ * @param src	Fuente que ha interrumpido
+ * @param ctx	Contexto indicado al asignar el manejador
+ */
+typedef void (* itc_handler_t) (itc_src_t src, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Prototipo para la función de estadísticas de lotes de interrupciones
+ * @param count	Interrupciones atendidas en una misma entrada al manejador
+ */
+typedef void (* itc_batch_hook_t) (uint32_t count);
+
+/*****************************************************************************/
+
+/**
+ * Número de intervalos de los histogramas del perfilador. El intervalo i
+ * cuenta las medidas de entre 2^i y 2^(i+1)-1 ticks (el 0 incluye el cero)
+ */
+#define ITC_PROF_BUCKETS	16
+
+/**
+ * Medidas del perfilador para una fuente (ver ITC_PROFILING en "system.h").
+ * Los tiempos se miden en ticks de ITC_PROF_TICK_HZ. La espera va desde la
+ * entrada al manejador de IRQ o FIQ hasta la llamada al manejador de la fuente,
+ * y la ejecución incluye el tiempo de las fuentes que lo expulsan
+ */
+typedef struct
+{
+	uint32_t count;						/* Veces que se ha atendido la fuente */
+	uint32_t run_min;					/* Ejecución mínima */
+	uint32_t run_max;					/* Ejecución máxima */
+	uint64_t run_total;					/* Ejecución acumulada, para la media */
+	uint32_t wait_min;					/* Espera mínima */
+	uint32_t wait_max;					/* Espera máxima */
+	uint64_t wait_total;				/* Espera acumulada, para la media */
+	uint32_t run_hist[ITC_PROF_BUCKETS];	/* Histograma de la ejecución */
+	uint32_t wait_hist[ITC_PROF_BUCKETS];	/* Histograma de la espera */
+} itc_prof_t;
 
 /*****************************************************************************/
 
@@ -62,7 +113,8 @@ inline void itc_init ();
 
 /**
  * Deshabilita el envío de peticiones de interrupción a la CPU
- * Permite implementar regiones críticas en modo USER
+ * Permite implementar regiones críticas en modo USER. Se mantiene por
+ * compatibilidad, es preferible usar itc_critical_enter
  */
 inline void itc_disable_ints ();
 
@@ -70,18 +122,42 @@ inline void itc_disable_ints ();
 
 /**
  * Vuelve a habilitar el envío de peticiones de interrupción a la CPU
- * Permite implementar regiones críticas en modo USER
+ * Permite implementar regiones críticas en modo USER. Se mantiene por
+ * compatibilidad, es preferible usar itc_critical_exit
  */
 inline void itc_restore_ints ();
 
 /*****************************************************************************/
 
+/**
+ * Comienza una sección crítica respecto a un conjunto de fuentes.
+ * Usa los bits I (y F si alguna de las fuentes es rápida) del CPSR, que en modo
+ * USER se modifican mediante una SWI (ver swi.h). Las secciones críticas se
+ * pueden anidar, ya que cada una guarda su propio estado
+ * @param srcs	Máscara de las fuentes que comparten datos con el llamante
+ * 				(ver ITC_SRC_MASK e ITC_SRC_ALL)
+ * @return		Estado a pasar a itc_critical_exit
+ */
+itc_critical_t itc_critical_enter (uint32_t srcs);
+
+/*****************************************************************************/
+
+/**
+ * Termina una sección crítica, restaurando el estado anterior a la llamada a
+ * itc_critical_enter correspondiente
+ * @param state	Estado retornado por itc_critical_enter
+ */
+void itc_critical_exit (itc_critical_t state);
+
+/*****************************************************************************/
+
 /**
  * Asigna un manejador de interrupción
  * @param src		Identificador de la fuente
  * @param handler	Manejador
+ * @param ctx		Contexto que se pasa al manejador
  */
-inline void itc_set_handler (itc_src_t src, itc_handler_t handler);
+inline void itc_set_handler (itc_src_t src, itc_handler_t handler, void *ctx);
 
 /*****************************************************************************/
 
@@ -126,12 +202,63 @@ inline void itc_unforce_interrupt (itc_src_t src);
 /*****************************************************************************/
 
 /**
- * Da servicio a la interrupción normal pendiente de más prioridad
+ * Fija la función que recibe el número de interrupciones atendidas en cada
+ * entrada al manejador de IRQ
+ * @param hook	Función de estadísticas. NULL para no usarla
+ */
+void itc_set_batch_hook (itc_batch_hook_t hook);
+
+/*****************************************************************************/
+
+/**
+ * Copia las medidas del perfilador de una fuente
+ * @param src	Identificador de la fuente
+ * @param prof	Destino de las medidas
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOSYS si el BSP se ha
+ * 			compilado sin ITC_PROFILING).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t itc_prof_get (itc_src_t src, itc_prof_t *prof);
+
+/*****************************************************************************/
+
+/**
+ * Pone a cero las medidas del perfilador de todas las fuentes
+ */
+void itc_prof_reset (void);
+
+/*****************************************************************************/
+
+/**
+ * Escribe las medidas del perfilador de las fuentes atendidas en la salida
+ * estándar (por defecto la uart1). No se debe llamar desde una isr
+ */
+void itc_prof_dump (void);
+
+/*****************************************************************************/
+
+/**
+ * Da servicio a todas las interrupciones normales pendientes, de mayor a menor
+ * prioridad, antes de retornar
  */
 void itc_service_normal_interrupt ();
 
 /*****************************************************************************/
 
+/**
+ * Da servicio a todas las interrupciones normales pendientes, de mayor a menor
+ * prioridad, permitiendo que las expulsen las de mayor prioridad.
+ * La llama excep_nested_irq_handler en modo SYS con el bit I a 1. Para cada
+ * fuente enmascara en el ITC las de prioridad menor o igual, habilita el bit I
+ * mientras se ejecuta el manejador y restaura la máscara anterior al terminar,
+ * de modo que retorna con el bit I a 1. Al salir de la interrupción más externa
+ * despierta a las tareas que esperan una interrupción (ver bsp_kernel_irq_exit)
+ * y ejecuta el trabajo diferido pendiente (ver bsp_run_deferred) con el bit I a 0
+ */
+void itc_service_nested_interrupt ();
+
+/*****************************************************************************/
+
 /**
  * Da servicio a la interrupción rápida pendiente de más prioridad
  */
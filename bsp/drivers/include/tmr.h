@@ -0,0 +1,166 @@
+/*
+ * Sistemas operativos empotrados
+ * Driver para los temporizadores del MC1322x
+ */
+
+#ifndef __TMR_H__
+#define __TMR_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Canales de los temporizadores. El canal TMR_CLOCK_ID (ver "system.h") es el
+ * reloj monótono del sistema y no se puede usar con tmr_start
+ */
+typedef enum
+{
+	tmr_0 = 0,
+	tmr_1,
+	tmr_2,
+	tmr_3,
+	tmr_max
+} tmr_id_t;
+
+/*****************************************************************************/
+
+/**
+ * Modos de los temporizadores
+ */
+typedef enum
+{
+	tmr_one_shot = 0,		/* Vence una sola vez */
+	tmr_periodic,			/* Vence cada periodo, sin deriva */
+	tmr_mode_max
+} tmr_mode_t;
+
+/*****************************************************************************/
+
+/**
+ * Definición para las funciones de callback de los temporizadores.
+ * Se ejecutan en la isr, así que deben ser breves (ver bsp_defer). Pueden
+ * volver a programar o detener el temporizador que las llama. La isr publica
+ * además el evento bsp_event_timer (ver event.h)
+ * @param tmr	Canal que ha vencido
+ * @param ctx	Contexto indicado al programar el temporizador
+ */
+typedef void (* tmr_callback_t) (tmr_id_t tmr, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Inicializa los temporizadores y arranca el reloj monótono
+ */
+void tmr_init (void);
+
+/*****************************************************************************/
+
+/**
+ * Lee el reloj monótono del sistema, que cuenta a TMR_TICK_HZ desde tmr_init
+ * y no da la vuelta en la práctica (64 bits). Se puede llamar desde una isr
+ * @return	Ticks transcurridos
+ */
+uint64_t tmr_now (void);
+
+/*****************************************************************************/
+
+/**
+ * Lee los 16 bits bajos del reloj monótono directamente del contador, sin
+ * sección crítica. Sirve para medir intervalos cortos con el mínimo coste
+ * @return	Valor actual del contador
+ */
+uint16_t tmr_clock_count (void);
+
+/*****************************************************************************/
+
+/**
+ * Adelanta el reloj monótono y los temporizadores en marcha el tiempo que han
+ * estado parados los periféricos (ver crm_hibernate). Los temporizadores que
+ * habrían vencido mientras tanto vencen tras TMR_MIN_TICKS
+ * @param ticks	Ticks que ha estado parado el reloj
+ */
+void tmr_advance (uint64_t ticks);
+
+/*****************************************************************************/
+
+/**
+ * Calcula el vencimiento más próximo de los temporizadores en marcha
+ * @param deadline	Destino del instante de vencimiento (ver tmr_now)
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOENT si no hay
+ * 			ninguno en marcha).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t tmr_next_expiry (uint64_t *deadline);
+
+/*****************************************************************************/
+
+/**
+ * Convierte microsegundos a ticks del reloj, redondeando hacia arriba
+ * @param us	Microsegundos
+ * @return	Ticks
+ */
+uint64_t tmr_us_to_ticks (uint64_t us);
+
+/*****************************************************************************/
+
+/**
+ * Convierte ticks del reloj a microsegundos, redondeando hacia abajo
+ * @param ticks	Ticks
+ * @return	Microsegundos
+ */
+uint64_t tmr_ticks_to_us (uint64_t ticks);
+
+/*****************************************************************************/
+
+/**
+ * Espera activamente un número de microsegundos
+ * @param us	Microsegundos
+ */
+void tmr_delay_us (uint32_t us);
+
+/*****************************************************************************/
+
+/**
+ * Programa un temporizador relativo al instante actual. Si ya estaba en marcha
+ * se vuelve a programar
+ * @param tmr	Canal
+ * @param ticks	Ticks hasta el vencimiento y periodo en modo periódico. Al menos
+ * 				TMR_MIN_TICKS en modo periódico. En modo de un disparo los
+ * 				valores menores se redondean a TMR_MIN_TICKS
+ * @param mode	Modo del temporizador
+ * @param func	Función callback. Puede ser NULL si sólo se usan los eventos
+ * @param ctx	Contexto que se pasa a la callback
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t tmr_start (tmr_id_t tmr, uint32_t ticks, tmr_mode_t mode, tmr_callback_t func, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Programa un temporizador de un disparo para que venza en un instante
+ * absoluto del reloj monótono. Los instantes pasados o demasiado cercanos
+ * vencen tras TMR_MIN_TICKS
+ * @param tmr		Canal
+ * @param deadline	Instante de vencimiento (ver tmr_now)
+ * @param func		Función callback. Puede ser NULL si sólo se usan los eventos
+ * @param ctx		Contexto que se pasa a la callback
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t tmr_set_deadline (tmr_id_t tmr, uint64_t deadline, tmr_callback_t func, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Detiene un temporizador. No tiene efecto si ya estaba detenido
+ * @param tmr	Canal
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t tmr_stop (tmr_id_t tmr);
+
+/*****************************************************************************/
+
+#endif /* __TMR_H__ */
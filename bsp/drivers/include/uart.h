@@ -8,6 +8,8 @@
 
 #include <stdint.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include "baudrate.h"
 
 /*****************************************************************************/
 
@@ -24,14 +26,126 @@ typedef enum
 /*****************************************************************************/
 
 /**
- * Definición para las funciones de callback
+ * Definición para las funciones de callback.
+ * Todas las callbacks del driver se ejecutan como trabajo diferido (ver
+ * bsp_defer), fuera de la isr y con las interrupciones habilitadas. La isr
+ * publica además los eventos bsp_event_uart_rx, bsp_event_uart_tx y
+ * bsp_event_uart_frame (ver event.h)
+ * @param uart	Identificador de la uart que ha producido el aviso
+ * @param ctx	Contexto indicado al fijar la callback
  */
-typedef void (* uart_callback_t) (void);
+typedef void (* uart_callback_t) (uart_id_t uart, void *ctx);
 
 /*****************************************************************************/
 
 /**
- * Inicializa una uart
+ * Descriptor de una transmisión asíncrona (ver uart_send_async).
+ * La memoria del descriptor y de los datos pertenece a la aplicación
+ */
+typedef struct uart_tx_desc uart_tx_desc_t;
+
+/**
+ * Definición para las funciones de finalización de una transmisión asíncrona
+ * @param uart	Identificador de la uart
+ * @param desc	Descriptor que se ha terminado de transmitir
+ */
+typedef void (* uart_tx_done_t) (uart_id_t uart, uart_tx_desc_t *desc);
+
+struct uart_tx_desc
+{
+	const uint8_t *buf;		/* Datos a transmitir */
+	uint32_t len;			/* Número de bytes */
+	uart_tx_done_t done;	/* Función de finalización. Puede ser NULL */
+	uint32_t sent;			/* Uso interno: bytes ya escritos en el FIFO */
+	uint32_t ring_pos;		/* Uso interno: posición del búfer de uart_send al encolarlo */
+	uart_tx_desc_t *next;	/* Uso interno: siguiente descriptor de la cola */
+};
+
+/*****************************************************************************/
+
+/**
+ * Modos de entramado en recepción
+ */
+typedef enum
+{
+	uart_framing_none,		/* Flujo de bytes sin tramas */
+	uart_framing_slip,		/* Tramas SLIP (RFC 1055) */
+	uart_framing_cobs,		/* Tramas COBS delimitadas por 0x00 */
+	uart_framing_max
+} uart_framing_t;
+
+/*****************************************************************************/
+
+/**
+ * Resultado de la recepción de una trama
+ */
+typedef enum
+{
+	uart_frame_ok,				/* Trama correcta */
+	uart_frame_crc_error,		/* El CRC no coincide */
+	uart_frame_format_error,	/* Codificación SLIP/COBS incorrecta */
+	uart_frame_overflow			/* La trama no cabe en el búfer de recepción */
+} uart_frame_status_t;
+
+/*****************************************************************************/
+
+/**
+ * Definición para las funciones de callback de recepción de tramas
+ * @param uart		Identificador de la uart
+ * @param len		Longitud de la trama, sin el CRC si es correcta
+ * @param status	Resultado de la recepción
+ * @param ctx		Contexto indicado al seleccionar el modo de entramado
+ */
+typedef void (* uart_frame_callback_t) (uart_id_t uart, uint32_t len, uart_frame_status_t status, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Contadores de rendimiento de una uart
+ */
+typedef struct
+{
+	uint32_t isr_count;			/* Entradas en la isr */
+	uint32_t rx_bytes;			/* Bytes extraídos del FIFO de recepción */
+	uint32_t rx_drains;			/* Interrupciones que han vaciado el FIFO de recepción */
+	uint32_t rx_drain_max;		/* Máximo de bytes extraídos en una interrupción */
+	uint32_t tx_bytes;			/* Bytes escritos en el FIFO de transmisión */
+	uint32_t tx_fills;			/* Interrupciones que han llenado el FIFO de transmisión */
+	uint32_t tx_fill_max;		/* Máximo de bytes escritos en una interrupción */
+	uint32_t overruns;			/* Desbordamientos del FIFO de recepción (ROE) */
+	uint32_t tx_overruns;		/* Escrituras con el FIFO de transmisión lleno (TOE) */
+	uint32_t framing_errors;	/* Errores de trama (FE) */
+	uint32_t parity_errors;		/* Errores de paridad (PE) */
+	uint32_t rx_high_water;		/* Máxima ocupación del búfer de recepción */
+	uint32_t tx_high_water;		/* Máxima ocupación del búfer de transmisión */
+	uint32_t rx_ring_full;		/* Veces que se ha detenido la recepción o descartado */
+								/* una trama por tener el búfer lleno */
+	uint32_t tx_ring_full;		/* Bytes rechazados por uart_send por tener el búfer lleno */
+	uint32_t frame_errors;		/* Tramas descartadas por CRC o codificación incorrectos */
+} uart_stats_t;
+
+/*****************************************************************************/
+
+/**
+ * Peticiones de control de las uart (ver bsp_ioctl).
+ * Salvo que se indique otra cosa, el argumento es un puntero a un uint32_t
+ */
+typedef enum
+{
+	uart_ioctl_set_flow_control = 1,	/* Nivel de CTS, 0 deshabilita el control de flujo */
+	uart_ioctl_get_flow_control,		/* Devuelve el nivel de CTS, 0 si está deshabilitado */
+	uart_ioctl_get_overruns,			/* Devuelve los desbordamientos del FIFO de recepción */
+	uart_ioctl_set_baudrate,			/* Nueva velocidad, en baudios */
+	uart_ioctl_get_baudrate,			/* Devuelve la velocidad realmente obtenida */
+	uart_ioctl_get_baudrate_error,		/* Devuelve el error de la velocidad en ppm (int32_t) */
+	uart_ioctl_get_stats,				/* Devuelve los contadores (uart_stats_t) */
+	uart_ioctl_reset_stats				/* Pone a cero los contadores. El argumento se ignora */
+} uart_ioctl_t;
+
+/*****************************************************************************/
+
+/**
+ * Inicializa una uart con los tamaños de búfer por defecto (ver system.h)
  * @param uart	Identificador de la uart
  * @param br	Baudrate
  * @param name	Nombre del dispositivo
@@ -42,9 +156,28 @@ int32_t uart_init (uart_id_t uart, uint32_t br, const char *name);
 
 /*****************************************************************************/
 
+/**
+ * Inicializa una uart indicando el tamaño de sus búferes de recepción y de
+ * transmisión, que se reservan de la arena del BSP. Al volver a inicializarla
+ * se reutiliza la memoria ya reservada mientras quepan los nuevos tamaños
+ * @param uart		Identificador de la uart
+ * @param br		Baudrate
+ * @param name		Nombre del dispositivo
+ * @param rx_size	Tamaño del búfer de recepción. Potencia de dos o cero para
+ * 					deshabilitar la recepción
+ * @param tx_size	Tamaño del búfer de transmisión. Potencia de dos o cero para
+ * 					deshabilitar la transmisión
+ * @return			Cero en caso de éxito o -1 en caso de error.
+ * 					La condición de error se indica en la variable global errno
+ */
+int32_t uart_init_ex (uart_id_t uart, uint32_t br, const char *name, uint32_t rx_size, uint32_t tx_size);
+
+/*****************************************************************************/
+
 /**
  * Transmite un byte por la uart
- * Implementación del driver de nivel 0. La llamada se bloquea hasta que transmite el byte
+ * Implementación del driver de nivel 0. La llamada se bloquea hasta que transmite el byte,
+ * después de todo lo pendiente de uart_send y uart_send_async
  * @param uart	Identificador de la uart
  * @param c		El carácter
  */
@@ -76,6 +209,23 @@ ssize_t uart_send (uint32_t uart, char *buf, size_t count);
 
 /*****************************************************************************/
 
+/**
+ * Transmisión asíncrona de un bloque sin copia intermedia.
+ * Implementación del driver de nivel 1. El descriptor se encola y la isr
+ * escribe los datos directamente desde el búfer de la aplicación al FIFO. La
+ * transmisión respeta el orden de las llamadas: el bloque sale después de lo
+ * que uart_send ya había dejado en el búfer circular y antes de lo que deje
+ * después. Al terminar se difiere la llamada a la función de finalización del
+ * descriptor. Ni el descriptor ni sus datos se pueden modificar hasta entonces
+ * @param uart	Identificador de la uart
+ * @param desc	Descriptor con los datos a transmitir
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_send_async (uart_id_t uart, uart_tx_desc_t *desc);
+
+/*****************************************************************************/
+
 /**
  * Recepción de bytes
  * Implementación del driver de nivel 1. La llamada es no bloqueante y se realiza mediante interrupciones
@@ -94,10 +244,11 @@ ssize_t uart_receive (uint32_t uart, char *buf, size_t count);
  * Fija la función callback de recepción de una uart
  * @param uart	Identificador de la uart
  * @param func	Función callback. NULL para anular una selección anterior
+ * @param ctx	Contexto que se pasa a la callback
  * @return	Cero en caso de éxito o -1 en caso de error.
  * 		La condición de error se indica en la variable global errno
  */
-int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func);
+int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func, void *ctx);
 
 /*****************************************************************************/
 
@@ -105,10 +256,177 @@ int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func);
  * Fija la función callback de transmisión de una uart
  * @param uart	Identificador de la uart
  * @param func	Función callback. NULL para anular una selección anterior
+ * @param ctx	Contexto que se pasa a la callback
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Selecciona el modo de entramado en recepción de una uart.
+ * En los modos SLIP y COBS la isr decodifica las tramas directamente sobre el
+ * búfer de recepción y llama a la callback una vez por trama completa en vez
+ * de llamar a la callback de recepción. Cada trama termina con su CRC-16 CCITT
+ * (byte alto primero), que se comprueba y se elimina antes de publicarla.
+ * Las tramas erróneas se descartan, pero también se notifican.
+ * Las tramas correctas se leen con uart_receive
+ * @param uart	Identificador de la uart
+ * @param mode	Modo de entramado
+ * @param func	Función callback de trama completa
+ * @param ctx	Contexto que se pasa a la callback
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_framing (uart_id_t uart, uart_framing_t mode, uart_frame_callback_t func, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Atiende la recepción de una uart con el manejador FIQ en ensamblador, que
+ * vacía el FIFO en el búfer de recepción con la mínima latencia. El resto del
+ * trabajo (transmisión, callbacks, búfer lleno) lo sigue haciendo la isr normal,
+ * a la que el manejador rápido cede la fuente tras cada ráfaga para que
+ * despierte a las tareas y corrutinas que esperan datos.
+ * Sólo una uart puede usar la FIQ, y no es compatible con la recepción por
+ * tramas. Los bytes recibidos por FIQ sólo se contabilizan en rx_bytes
+ * @param uart		Identificador de la uart
+ * @param enable	1 para usar la FIQ, 0 para volver a la IRQ
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_fiq (uart_id_t uart, uint32_t enable);
+
+/*****************************************************************************/
+
+/**
+ * Configura el control de flujo hardware (RTS/CTS) de una uart.
+ * La uart deja de aceptar datos (desactiva CTS) cuando su FIFO de recepción
+ * alcanza el nivel indicado. Como la isr deja de vaciar el FIFO cuando se
+ * llena el búfer de recepción, el emisor se detiene en vez de perder datos
+ * @param uart		Identificador de la uart
+ * @param cts_level	Nivel del FIFO de recepción (1-31) al que se desactiva CTS.
+ * 					Cero deshabilita el control de flujo
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_flow_control (uart_id_t uart, uint32_t cts_level);
+
+/*****************************************************************************/
+
+/**
+ * Cambia la velocidad de una uart.
+ * Se busca la pareja INC/MOD y el sobremuestreo de menor error, y se rechaza la
+ * velocidad si el error supera UART_BAUDRATE_TOLERANCE (ver system.h). La uart
+ * se deshabilita durante el cambio, por lo que se pueden perder los datos que
+ * estén en los FIFO
+ * @param uart	Identificador de la uart
+ * @param br	Baudrate
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_baudrate (uart_id_t uart, uint32_t br);
+
+/*****************************************************************************/
+
+/**
+ * Obtiene la configuración de velocidad de una uart: los divisores, el
+ * sobremuestreo, la velocidad realmente obtenida y su error
+ * @param uart	Identificador de la uart
+ * @param cfg	Estructura para almacenar la configuración
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_get_baudrate (uart_id_t uart, baudrate_t *cfg);
+
+/*****************************************************************************/
+
+/**
+ * Número de desbordamientos del FIFO de recepción detectados desde la
+ * inicialización de la uart
+ * @param uart	Identificador de la uart
+ * @return		El número de desbordamientos
+ */
+uint32_t uart_get_overruns (uart_id_t uart);
+
+/*****************************************************************************/
+
+/**
+ * Indica si a una uart le quedan datos por transmitir, en el búfer, en la cola
+ * de descriptores o en el FIFO hardware
+ * @param uart	Identificador de la uart
+ * @return		1 si la transmisión está en curso, 0 en otro caso
+ */
+uint32_t uart_tx_busy (uart_id_t uart);
+
+/*****************************************************************************/
+
+/**
+ * Consulta sin bloquear cuántos bytes esperan en el búfer de recepción de una
+ * uart. Con la recepción por FIQ no cuenta los que el manejador rápido aún
+ * no ha publicado
+ * @param uart	Identificador de la uart
+ * @return		El número de bytes
+ */
+uint32_t uart_rx_count (uart_id_t uart);
+
+/*****************************************************************************/
+
+/**
+ * Consulta sin bloquear cuántos bytes caben en el búfer de transmisión de una
+ * uart
+ * @param uart	Identificador de la uart
+ * @return		El número de bytes
+ */
+uint32_t uart_tx_space (uart_id_t uart);
+
+/*****************************************************************************/
+
+/**
+ * Copia los contadores de rendimiento de una uart
+ * @param uart	Identificador de la uart
+ * @param stats	Estructura para almacenar los contadores
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_get_stats (uart_id_t uart, uart_stats_t *stats);
+
+/*****************************************************************************/
+
+/**
+ * Pone a cero los contadores de rendimiento de una uart
+ * @param uart	Identificador de la uart
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_reset_stats (uart_id_t uart);
+
+/*****************************************************************************/
+
+/**
+ * Obtención de información de una uart.
+ * Implementación del driver de nivel 2. st_size indica los bytes pendientes de
+ * leer en el búfer de recepción y st_blksize su tamaño
+ * @param uart	Identificador de la uart
+ * @param buf	Estructura para almacenar dicha información
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int uart_fstat (uint32_t uart, struct stat *buf);
+
+/*****************************************************************************/
+
+/**
+ * Operaciones de control de las uart.
+ * Implementación del driver de nivel 2 (ver bsp_ioctl)
+ * @param uart		Identificador de la uart
+ * @param request	Petición (ver uart_ioctl_t y BSP_IOCTL_WAIT_READ/WRITE)
+ * @param arg		Puntero a un uint32_t con el argumento o el resultado
  * @return	Cero en caso de éxito o -1 en caso de error.
  * 		La condición de error se indica en la variable global errno
  */
-int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func);
+int uart_ioctl (uint32_t uart, uint32_t request, void *arg);
 
 /*****************************************************************************/
 
@@ -3,6 +3,10 @@
  * Driver para el controlador de interrupciones del MC1322x
  */
 
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
 #include "system.h"
 
 /*****************************************************************************/
@@ -29,16 +33,157 @@ typedef struct
 
 static volatile itc_regs_t* const itc_regs = ITC_BASE;
 
+/**
+ * Valor de nimask que no enmascara ninguna fuente. Con cualquier otro valor se
+ * enmascaran las fuentes de prioridad (número) menor o igual
+ */
+#define ITC_NIMASK_NONE		0x1F
+
 /**
  * Tabla de manejadores de interrupción.
  */
 static itc_handler_t itc_handlers[itc_src_max];
 
 /**
- * Estado de las interrupciones
+ * Contextos de los manejadores de interrupción
+ */
+static void *itc_contexts[itc_src_max];
+
+/**
+ * Estado de las interrupciones guardado por itc_disable_ints y nivel de
+ * anidamiento
+ */
+
+static itc_critical_t itc_ints_status;
+static uint32_t itc_ints_depth;
+
+/**
+ * Marca de los estados de sección crítica que sólo guardan el bit I (ver
+ * excep_disable_irq). El resto guardan los bits I y F (ver excep_disable_ints)
+ */
+#define ITC_CRITICAL_IRQ	(1u << 30)
+
+/**
+ * Función de estadísticas del tamaño de los lotes de interrupciones
+ */
+static itc_batch_hook_t itc_batch_hook;
+
+/**
+ * Nivel de anidamiento de itc_service_nested_interrupt
+ */
+static uint32_t itc_nesting;
+
+/*****************************************************************************/
+
+#ifdef ITC_PROFILING
+
+/**
+ * Medidas del perfilador de cada fuente
+ */
+static itc_prof_t itc_prof[itc_src_max];
+
+/*****************************************************************************/
+
+/**
+ * Lee los 16 bits bajos del reloj monótono (ver tmr_clock_count). Da la vuelta
+ * cada 65536 ticks, así que sólo se miden intervalos menores
+ * @return	Valor actual del contador
+ */
+static inline uint16_t itc_prof_now ()
+{
+        return tmr_clock_count();
+}
+
+/*****************************************************************************/
+
+/**
+ * Pone a cero las medidas. El reloj lo arranca tmr_init, y hasta entonces
+ * las medidas son nulas
+ */
+static void itc_prof_init ()
+{
+        memset(itc_prof, 0, sizeof(itc_prof));
+}
+
+/*****************************************************************************/
+
+/**
+ * Calcula el intervalo del histograma de una medida (parte entera de su
+ * logaritmo en base 2) en un número fijo de pasos
+ * @param ticks	Medida de 16 bits
+ * @return	Intervalo del histograma
  */
+static inline uint32_t itc_prof_bucket (uint32_t ticks)
+{
+        uint32_t i = 0;
+        
+        if(ticks & 0xFF00){ ticks >>= 8; i += 8; }
+        if(ticks & 0xF0){ ticks >>= 4; i += 4; }
+        if(ticks & 0xC){ ticks >>= 2; i += 2; }
+        if(ticks & 0x2){ i += 1; }
+        
+        return i;
+}
+
+/*****************************************************************************/
+
+/**
+ * Acumula las medidas de una llamada a un manejador
+ * @param src	Fuente atendida
+ * @param entry	Instante de entrada al manejador de IRQ o FIQ
+ * @param start	Instante de llamada al manejador de la fuente
+ * @param end	Instante de retorno del manejador de la fuente
+ */
+static void itc_prof_record (itc_src_t src, uint16_t entry, uint16_t start, uint16_t end)
+{
+        itc_prof_t *prof = &itc_prof[src];
+        uint32_t wait = (uint16_t) (start - entry);
+        uint32_t run = (uint16_t) (end - start);
+        
+        if(prof->count == 0 || run < prof->run_min)
+            prof->run_min = run;
+        if(run > prof->run_max)
+            prof->run_max = run;
+        if(prof->count == 0 || wait < prof->wait_min)
+            prof->wait_min = wait;
+        if(wait > prof->wait_max)
+            prof->wait_max = wait;
+        
+        prof->count++;
+        prof->run_total += run;
+        prof->wait_total += wait;
+        prof->run_hist[itc_prof_bucket(run)]++;
+        prof->wait_hist[itc_prof_bucket(wait)]++;
+}
+
+/*****************************************************************************/
+
+#define ITC_PROF_NOW()		itc_prof_now()
+
+#else
+
+#define ITC_PROF_NOW()		0
+
+#endif /* ITC_PROFILING */
+
+/*****************************************************************************/
 
-static uint32_t itc_ints_status;
+/**
+ * Llama al manejador de una fuente, midiéndolo si está activo el perfilador
+ * @param src	Fuente a atender
+ * @param entry	Instante de entrada al manejador de IRQ o FIQ (ver ITC_PROF_NOW)
+ */
+static inline void itc_call_handler (itc_src_t src, uint16_t entry)
+{
+#ifdef ITC_PROFILING
+        uint16_t start = itc_prof_now();
+        
+        itc_handlers[src](src, itc_contexts[src]);
+        itc_prof_record(src, entry, start, itc_prof_now());
+#else
+        itc_handlers[src](src, itc_contexts[src]);
+#endif
+}
 
 /*****************************************************************************/
 
@@ -51,10 +196,16 @@ static uint32_t itc_ints_status;
 inline void itc_init ()
 {
         uint8_t i;
-        for(i = 0; i < itc_src_max; ++i)
+        for(i = 0; i < itc_src_max; ++i){
             itc_handlers[i] = (uint32_t) 0x0;
+            itc_contexts[i] = NULL;
+        }
         itc_regs->intfrc = (uint32_t) 0x0;
         itc_regs->intenable = (uint32_t) 0x0;
+        itc_regs->nimask = ITC_NIMASK_NONE;
+#ifdef ITC_PROFILING
+        itc_prof_init();
+#endif
         //ponemos un 1 en las posiciones 19 y 20
         itc_regs->intcntl &= (~( 3 << 19 ));
 }
@@ -67,8 +218,11 @@ inline void itc_init ()
  */
 inline void itc_disable_ints ()
 {
-        itc_ints_status = itc_regs->intenable;
-        itc_regs->intenable = (uint32_t) 0;
+        itc_critical_t state = itc_critical_enter(ITC_SRC_ALL);
+        
+        //Sólo la sección más externa tiene algo que restaurar
+        if(itc_ints_depth++ == 0)
+            itc_ints_status = state;
 }
 
 /*****************************************************************************/
@@ -79,7 +233,42 @@ inline void itc_disable_ints ()
  */
 inline void itc_restore_ints ()
 {
-        itc_regs->intenable = itc_ints_status;
+        if(itc_ints_depth > 0 && --itc_ints_depth == 0)
+            itc_critical_exit(itc_ints_status);
+}
+
+/*****************************************************************************/
+
+/**
+ * Comienza una sección crítica respecto a un conjunto de fuentes.
+ * Usa los bits I (y F si alguna de las fuentes es rápida) del CPSR, que en modo
+ * USER se modifican mediante una SWI (ver swi.h). Las secciones críticas se
+ * pueden anidar, ya que cada una guarda su propio estado
+ * @param srcs	Máscara de las fuentes que comparten datos con el llamante
+ * 				(ver ITC_SRC_MASK e ITC_SRC_ALL)
+ * @return		Estado a pasar a itc_critical_exit
+ */
+itc_critical_t itc_critical_enter (uint32_t srcs)
+{
+        //Las fuentes rápidas obligan a deshabilitar también las FIQ
+        if(itc_regs->inttype & srcs)
+            return excep_disable_ints();
+        return ITC_CRITICAL_IRQ | excep_disable_irq();
+}
+
+/*****************************************************************************/
+
+/**
+ * Termina una sección crítica, restaurando el estado anterior a la llamada a
+ * itc_critical_enter correspondiente
+ * @param state	Estado retornado por itc_critical_enter
+ */
+void itc_critical_exit (itc_critical_t state)
+{
+        if(state & ITC_CRITICAL_IRQ)
+            excep_restore_irq(state & 1);
+        else
+            excep_restore_ints(state & 3);
 }
 
 /*****************************************************************************/
@@ -88,10 +277,16 @@ inline void itc_restore_ints ()
  * Asigna un manejador de interrupción
  * @param src		Identificador de la fuente
  * @param handler	Manejador
+ * @param ctx		Contexto que se pasa al manejador
  */
-inline void itc_set_handler (itc_src_t src, itc_handler_t handler)
+inline void itc_set_handler (itc_src_t src, itc_handler_t handler, void *ctx)
 {
+	itc_critical_t state = itc_critical_enter (ITC_SRC_ALL);
+
 	itc_handlers[src] = handler;
+	itc_contexts[src] = ctx;
+
+	itc_critical_exit (state);
 }
 
 /*****************************************************************************/
@@ -103,12 +298,19 @@ inline void itc_set_handler (itc_src_t src, itc_handler_t handler)
  */
 inline void itc_set_priority (itc_src_t src, itc_priority_t priority)	
 {
+        uint32_t f_bit;
+
         if(priority)
             /*Si hay alguna interrupcion mapeada como FIQ escribe el bit
             encima y la pone como normal */
             itc_regs->inttype = (uint32_t) (1 << src);
-        else
+        else{
+            //El manejador FIQ de la uart también modifica inttype (ver
+            //uart_fiq.s): sin enmascarar FIQ su cambio se perdería
+            f_bit = excep_disable_fiq();
             itc_regs->inttype &= (uint32_t) ~(1 << src);
+            excep_restore_fiq(f_bit);
+        }
 }
 
 /*****************************************************************************/
@@ -119,7 +321,8 @@ inline void itc_set_priority (itc_src_t src, itc_priority_t priority)
  */
 inline void itc_enable_interrupt (itc_src_t src)
 {
-        itc_regs->intenable |= (uint32_t) (1 << src);
+        //Escritura atómica, sin leer-modificar-escribir intenable
+        itc_regs->intennum = src;
 }
 
 /*****************************************************************************/
@@ -130,9 +333,8 @@ inline void itc_enable_interrupt (itc_src_t src)
  */
 inline void itc_disable_interrupt (itc_src_t src)
 {
-        uint32_t tmp = (1 << src);
-        itc_regs->intenable &= ~tmp;
-        
+        //Escritura atómica, sin leer-modificar-escribir intenable
+        itc_regs->intdisnum = src;
 }
 
 /*****************************************************************************/
@@ -143,7 +345,12 @@ inline void itc_disable_interrupt (itc_src_t src)
  */
 inline void itc_force_interrupt (itc_src_t src)
 {
+        uint32_t f_bit;
+
+        //El manejador FIQ de la uart también modifica intfrc (ver uart_fiq.s)
+        f_bit = excep_disable_fiq();
         itc_regs->intfrc |= (1 << src);
+        excep_restore_fiq(f_bit);
 }
 
 /*****************************************************************************/
@@ -155,26 +362,240 @@ inline void itc_force_interrupt (itc_src_t src)
 inline void itc_unforce_interrupt (itc_src_t src)
 {
 	/* ESTA FUNCIÓN SE DEFINIRÁ EN LA PRÁCTICA 6 */
+        uint32_t f_bit;
+
+        f_bit = excep_disable_fiq();
         itc_regs->intfrc &= ~(1 << src);
+        excep_restore_fiq(f_bit);
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna las interrupciones normales pendientes que puede atender un
+ * manejador que se ejecuta con una máscara dada, es decir, las de prioridad
+ * mayor que la máscara
+ * @param mask	Valor de nimask del nivel actual
+ */
+static inline uint32_t itc_pending_above (uint32_t mask)
+{
+        uint32_t pend = itc_regs->nipend;
+        
+        if(mask != ITC_NIMASK_NONE)
+            pend &= ~((2u << mask) - 1);
+        
+        return pend;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna la fuente más prioritaria (el bit más alto) de un conjunto no vacío
+ * de interrupciones pendientes.
+ * El ARM7TDMI (ARMv4T) no dispone de la instrucción CLZ, así que se usa una
+ * búsqueda binaria sobre los 16 bits de fuentes del ITC
+ * @param pend	Interrupciones pendientes, distinto de cero
+ */
+static inline uint32_t itc_highest_pending (uint32_t pend)
+{
+        uint32_t src = 0;
+        
+        if(pend & 0xFF00){ src += 8; pend >>= 8; }
+        if(pend & 0xF0){ src += 4; pend >>= 4; }
+        if(pend & 0xC){ src += 2; pend >>= 2; }
+        if(pend & 0x2){ src += 1; }
+        
+        return src;
+}
+
+/*****************************************************************************/
+
+/**
+ * Fija la función que recibe el número de interrupciones atendidas en cada
+ * entrada al manejador de IRQ
+ * @param hook	Función de estadísticas. NULL para no usarla
+ */
+void itc_set_batch_hook (itc_batch_hook_t hook)
+{
+        itc_batch_hook = hook;
+}
+
+/*****************************************************************************/
+
+/**
+ * Copia las medidas del perfilador de una fuente
+ * @param src	Identificador de la fuente
+ * @param prof	Destino de las medidas
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOSYS si el BSP se ha
+ * 			compilado sin ITC_PROFILING).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t itc_prof_get (itc_src_t src, itc_prof_t *prof)
+{
+#ifdef ITC_PROFILING
+        itc_critical_t state;
+        
+        if(src >= itc_src_max || prof == NULL){
+            errno = EINVAL;
+            return -1;
+        }
+        
+        //Copia coherente respecto a las isr, que actualizan las medidas
+        state = itc_critical_enter(ITC_SRC_ALL);
+        *prof = itc_prof[src];
+        itc_critical_exit(state);
+        
+        return 0;
+#else
+        errno = ENOSYS;
+        return -1;
+#endif
 }
 
 /*****************************************************************************/
 
 /**
- * Da servicio a la interrupción normal pendiente de más prioridad.
- * Deshabilia las IRQ de menor prioridad hasta que se haya completado el servicio
- * de la IRQ para evitar inversiones de prioridad
+ * Pone a cero las medidas del perfilador de todas las fuentes
+ */
+void itc_prof_reset (void)
+{
+#ifdef ITC_PROFILING
+        itc_critical_t state = itc_critical_enter(ITC_SRC_ALL);
+        
+        memset(itc_prof, 0, sizeof(itc_prof));
+        itc_critical_exit(state);
+#endif
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe un histograma del perfilador en la salida estándar
+ * @param name	Nombre de la medida
+ * @param hist	Histograma
+ */
+#ifdef ITC_PROFILING
+static void itc_prof_dump_hist (const char *name, const uint32_t *hist)
+{
+        uint32_t i;
+        
+        printf("    %s:", name);
+        for(i = 0; i < ITC_PROF_BUCKETS; i++)
+            printf(" %lu", (unsigned long) hist[i]);
+        printf("\n");
+}
+#endif
+
+/*****************************************************************************/
+
+/**
+ * Escribe las medidas del perfilador de las fuentes atendidas en la salida
+ * estándar (por defecto la uart1). No se debe llamar desde una isr
+ */
+void itc_prof_dump (void)
+{
+#ifdef ITC_PROFILING
+        itc_prof_t prof;
+        uint32_t src;
+        
+        printf("itc: ticks de %lu Hz, min/media/max\n", (unsigned long) ITC_PROF_TICK_HZ);
+        
+        for(src = 0; src < itc_src_max; src++){
+            if(itc_prof_get(src, &prof) < 0 || prof.count == 0)
+                continue;
+            
+            printf("  fuente %lu: %lu veces, ejecucion %lu/%lu/%lu, espera %lu/%lu/%lu\n",
+                   (unsigned long) src, (unsigned long) prof.count,
+                   (unsigned long) prof.run_min, (unsigned long) (prof.run_total / prof.count),
+                   (unsigned long) prof.run_max,
+                   (unsigned long) prof.wait_min, (unsigned long) (prof.wait_total / prof.count),
+                   (unsigned long) prof.wait_max);
+            itc_prof_dump_hist("ejecucion", prof.run_hist);
+            itc_prof_dump_hist("espera", prof.wait_hist);
+        }
+#endif
+}
+
+/*****************************************************************************/
+
+/**
+ * Da servicio a todas las interrupciones normales pendientes, de mayor a menor
+ * prioridad, antes de retornar, para no pagar una entrada en la excepción por
+ * cada fuente.
+ * Deshabilia las IRQ de menor prioridad mientras se atiende cada una para
+ * evitar inversiones de prioridad
  */
 void itc_service_normal_interrupt ()
 {
-        //obtener el numero de interrupción mas prioritaria
-        uint8_t pri = itc_regs->nivector;
-        //Deshabilitar las interrupciones menos prioritarias
-        itc_regs->nimask = pri;
-        //llamar al manejador de la interrupcion mas prioritaria
-        itc_handlers[pri]();
-        //al retornar, rehabilitar todas las interrupciones
-        itc_regs->nimask = 0x31;
+        uint32_t old = itc_regs->nimask;
+        uint32_t pend, pri, batch = 0;
+        uint16_t entry = ITC_PROF_NOW();
+        
+        while((pend = itc_pending_above(old)) != 0){
+            //obtener el numero de interrupción mas prioritaria
+            pri = itc_highest_pending(pend);
+            //Deshabilitar las interrupciones menos prioritarias
+            itc_regs->nimask = pri;
+            //llamar al manejador de la interrupcion mas prioritaria
+            itc_call_handler(pri, entry);
+            batch++;
+        }
+        
+        //al terminar, restaurar la máscara anterior (ITC_NIMASK_NONE fuera de las isr)
+        itc_regs->nimask = old;
+        
+        if(itc_batch_hook)
+            itc_batch_hook(batch);
+}
+
+/*****************************************************************************/
+
+/**
+ * Da servicio a todas las interrupciones normales pendientes, de mayor a menor
+ * prioridad, permitiendo que las expulsen las de mayor prioridad.
+ * La llama excep_nested_irq_handler en modo SYS con el bit I a 1. Para cada
+ * fuente enmascara en el ITC las de prioridad menor o igual, habilita el bit I
+ * mientras se ejecuta el manejador y restaura la máscara anterior al terminar,
+ * de modo que retorna con el bit I a 1
+ */
+void itc_service_nested_interrupt ()
+{
+        uint32_t old = itc_regs->nimask;
+        uint32_t pend, pri, batch = 0;
+        uint16_t entry = ITC_PROF_NOW();
+        
+        itc_nesting++;
+        
+        while((pend = itc_pending_above(old)) != 0){
+            pri = itc_highest_pending(pend);
+            
+            //Sólo las fuentes más prioritarias pueden expulsar a este manejador
+            itc_regs->nimask = pri;
+            excep_restore_irq(0);
+            
+            itc_call_handler(pri, entry);
+            batch++;
+            
+            excep_disable_irq();
+        }
+        
+        //Restauramos la máscara del nivel anterior con las IRQ deshabilitadas
+        itc_regs->nimask = old;
+        
+        if(itc_batch_hook)
+            itc_batch_hook(batch);
+        
+        //Al salir de la interrupción más externa despertamos a las tareas que
+        //esperan una interrupción y ejecutamos el trabajo diferido por las isr,
+        //en modo SYS, con las IRQ habilitadas y en su propia pila
+        if(--itc_nesting == 0){
+            bsp_kernel_irq_exit();
+            if(bsp_deferred_pending()){
+                excep_restore_irq(0);
+                excep_run_deferred();
+                excep_disable_irq();
+            }
+        }
 }
 
 /*****************************************************************************/
@@ -184,8 +605,10 @@ void itc_service_normal_interrupt ()
  */
 void itc_service_fast_interrupt ()
 {
+        uint16_t entry = ITC_PROF_NOW();
+        
         //Obtener el indice del manejador de la fiq y llamar a la rutina
-        itc_handlers[itc_regs->fivector]();
+        itc_call_handler(itc_regs->fivector, entry);
 }
 
 /*****************************************************************************/
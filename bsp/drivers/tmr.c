@@ -0,0 +1,517 @@
+/*
+ * Sistemas operativos empotrados
+ * Driver para los temporizadores del MC1322x
+ */
+
+#include <errno.h>
+
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Acceso estructurado a los registros de un canal de los temporizadores.
+ * Los canales están separados 0x20 bytes
+ */
+typedef struct
+{
+	uint16_t comp1;				/* 0x00 */
+	uint16_t comp2;				/* 0x02 */
+	uint16_t capt;				/* 0x04 */
+	uint16_t load;				/* 0x06 */
+	uint16_t hold;				/* 0x08 */
+	uint16_t cntr;				/* 0x0A */
+	uint16_t ctrl;				/* 0x0C */
+	uint16_t sctrl;				/* 0x0E */
+	uint16_t cmpld1;			/* 0x10 */
+	uint16_t cmpld2;			/* 0x12 */
+	uint16_t csctrl;			/* 0x14 */
+	const uint16_t reserved[4];	/* 0x16-0x1C */
+	uint16_t enbl;				/* 0x1E (sólo en el canal 0) */
+} tmr_regs_t;
+
+#define TMR_REGS(n)		((tmr_regs_t *) ((uint8_t *) TMR_BASE + (n) * 0x20))
+
+static volatile tmr_regs_t* const tmr_regs[tmr_max] =
+{
+	TMR_REGS(0), TMR_REGS(1), TMR_REGS(2), TMR_REGS(3)
+};
+
+/**
+ * Bits de los registros de control
+ */
+#define TMR_CTRL_CM_RISING	(1 << 13)		/* Cuenta los flancos de la fuente primaria */
+#define TMR_CTRL_PCS(n)		((0x8 + (n)) << 9)	/* Fuente primaria: reloj de periféricos / 2^n */
+#define TMR_CTRL_LENGTH		(1 << 5)		/* Reinicia el contador al alcanzar COMP1 */
+#define TMR_SCTRL_TOF		(1 << 13)		/* Desbordamiento del contador */
+#define TMR_SCTRL_TOFIE		(1 << 12)		/* Interrupción por desbordamiento */
+#define TMR_CSCTRL_TCF1		(1 << 4)		/* Comparación con COMP1 */
+#define TMR_CSCTRL_TCF1EN	(1 << 6)		/* Interrupción por comparación con COMP1 */
+
+/**
+ * Modo de todos los canales: cuenta ascendente a TMR_TICK_HZ
+ */
+#define TMR_CTRL_COUNT		(TMR_CTRL_CM_RISING | TMR_CTRL_PCS (TMR_PRESCALER))
+
+/*****************************************************************************/
+
+/**
+ * Estado de los temporizadores.
+ * Los contadores son de 16 bits, así que los intervalos más largos se dividen
+ * en tramos. Los tramos intermedios son de 0x8000 ticks, de modo que el último
+ * nunca es tan corto que la isr no llegue a tiempo de programarlo
+ */
+typedef struct
+{
+	tmr_callback_t func;		/* Callback */
+	void *ctx;					/* Contexto de la callback */
+	uint32_t period;			/* Periodo, 0 en modo de un disparo */
+	uint32_t chunk;				/* Longitud del tramo en curso */
+	uint64_t remaining;			/* Ticks hasta el vencimiento desde el inicio del tramo en curso, 0 si está detenido */
+} tmr_channel_t;
+
+static tmr_channel_t tmr_channels[tmr_max];
+
+/**
+ * Parte alta del reloj monótono, que se incrementa en cada desbordamiento del
+ * contador del canal TMR_CLOCK_ID
+ */
+static volatile uint64_t tmr_clock_high;
+
+/*****************************************************************************/
+
+/**
+ * Calcula la longitud del siguiente tramo
+ * @param remaining	Ticks hasta el vencimiento
+ * @return	Longitud del tramo
+ */
+static inline uint32_t tmr_chunk (uint64_t remaining)
+{
+	return (remaining > 0x10000) ? 0x8000 : (uint32_t) remaining;
+}
+
+/*****************************************************************************/
+
+/**
+ * Atiende la comparación de un canal: avanza un tramo y, si vence, llama a la
+ * callback y publica el evento
+ * @param tmr	Canal
+ */
+static void tmr_expire (tmr_id_t tmr)
+{
+	volatile tmr_regs_t *regs = tmr_regs[tmr];
+	tmr_channel_t *chan = &tmr_channels[tmr];
+	itc_critical_t state;
+	tmr_callback_t func = NULL;
+	void *ctx = NULL;
+	uint32_t expired = 0;
+	uint32_t next;
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+
+	regs->csctrl &= ~TMR_CSCTRL_TCF1;
+
+	if (chan->remaining)
+	{
+		chan->remaining -= chan->chunk;
+
+		if (chan->remaining == 0)
+		{
+			expired = 1;
+			func = chan->func;
+			ctx = chan->ctx;
+
+			if (chan->period)
+				chan->remaining = chan->period;
+			else
+			{
+				regs->ctrl = 0;
+				regs->csctrl = 0;
+			}
+		}
+
+		/* El contador ya se ha reiniciado, sólo cambiamos COMP1 si es necesario */
+		if (chan->remaining)
+		{
+			next = tmr_chunk (chan->remaining);
+			if (next != chan->chunk)
+			{
+				regs->comp1 = next - 1;
+				chan->chunk = next;
+			}
+		}
+	}
+
+	itc_critical_exit (state);
+
+	if (expired)
+	{
+		if (func)
+			func (tmr, ctx);
+		bsp_event_notify (bsp_event_timer, tmr, bsp_event_normal);
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Manejador de interrupciones de los temporizadores. Todos los canales
+ * comparten la fuente itc_src_tmr
+ * @param src	Fuente (itc_src_tmr)
+ * @param ctx	No se usa
+ */
+static void tmr_isr (itc_src_t src, void *ctx)
+{
+	volatile tmr_regs_t *clock = tmr_regs[TMR_CLOCK_ID];
+	itc_critical_t state;
+	uint32_t i;
+
+	if (clock->sctrl & TMR_SCTRL_TOF)
+	{
+		/* Las isr anidadas no deben ver el indicador borrado sin la vuelta contada */
+		state = itc_critical_enter (ITC_SRC_ALL);
+		clock->sctrl &= ~TMR_SCTRL_TOF;
+		tmr_clock_high += 0x10000;
+		itc_critical_exit (state);
+	}
+
+	for (i = 0; i < tmr_max; i++)
+		if (i != TMR_CLOCK_ID && (tmr_regs[i]->csctrl & TMR_CSCTRL_TCF1))
+			tmr_expire (i);
+}
+
+/*****************************************************************************/
+
+/**
+ * Arranca la cuenta de un canal
+ * @param tmr		Canal
+ * @param ticks		Ticks hasta el vencimiento (al menos TMR_MIN_TICKS)
+ * @param period	Periodo, 0 en modo de un disparo
+ * @param func		Callback
+ * @param ctx		Contexto de la callback
+ */
+static void tmr_program (tmr_id_t tmr, uint64_t ticks, uint32_t period, tmr_callback_t func, void *ctx)
+{
+	volatile tmr_regs_t *regs = tmr_regs[tmr];
+	tmr_channel_t *chan = &tmr_channels[tmr];
+	itc_critical_t state;
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+
+	regs->ctrl = 0;
+	regs->csctrl = 0;
+
+	chan->func = func;
+	chan->ctx = ctx;
+	chan->period = period;
+	chan->remaining = ticks;
+	chan->chunk = tmr_chunk (ticks);
+
+	regs->load = 0;
+	regs->cntr = 0;
+	regs->comp1 = chan->chunk - 1;
+	regs->csctrl = TMR_CSCTRL_TCF1EN;
+	regs->ctrl = TMR_CTRL_COUNT | TMR_CTRL_LENGTH;
+
+	itc_critical_exit (state);
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa los temporizadores y arranca el reloj monótono
+ */
+void tmr_init (void)
+{
+	volatile tmr_regs_t *clock = tmr_regs[TMR_CLOCK_ID];
+	uint32_t i;
+
+	for (i = 0; i < tmr_max; i++)
+	{
+		tmr_regs[i]->ctrl = 0;
+		tmr_regs[i]->sctrl = 0;
+		tmr_regs[i]->csctrl = 0;
+		tmr_channels[i].remaining = 0;
+		tmr_channels[i].func = NULL;
+	}
+	tmr_regs[0]->enbl |= (1 << tmr_max) - 1;
+
+	/* El reloj cuenta libremente de 0 a 0xFFFF e interrumpe al dar la vuelta */
+	tmr_clock_high = 0;
+	clock->load = 0;
+	clock->cntr = 0;
+	clock->sctrl = TMR_SCTRL_TOFIE;
+	clock->ctrl = TMR_CTRL_COUNT;
+
+	itc_set_priority (itc_src_tmr, itc_priority_normal);
+	itc_set_handler (itc_src_tmr, tmr_isr, NULL);
+	itc_enable_interrupt (itc_src_tmr);
+}
+
+/*****************************************************************************/
+
+/**
+ * Lee el reloj monótono del sistema, que cuenta a TMR_TICK_HZ desde tmr_init
+ * y no da la vuelta en la práctica (64 bits). Se puede llamar desde una isr
+ * @return	Ticks transcurridos
+ */
+uint64_t tmr_now (void)
+{
+	volatile tmr_regs_t *clock = tmr_regs[TMR_CLOCK_ID];
+	itc_critical_t state;
+	uint64_t high;
+	uint16_t count;
+
+	state = itc_critical_enter (ITC_SRC_MASK (itc_src_tmr));
+
+	high = tmr_clock_high;
+	count = clock->cntr;
+
+	/* Vuelta aún sin atender: el contador ya es de la vuelta siguiente */
+	if (clock->sctrl & TMR_SCTRL_TOF)
+	{
+		count = clock->cntr;
+		high += 0x10000;
+	}
+
+	itc_critical_exit (state);
+
+	return high + count;
+}
+
+/*****************************************************************************/
+
+/**
+ * Lee los 16 bits bajos del reloj monótono directamente del contador, sin
+ * sección crítica. Sirve para medir intervalos cortos con el mínimo coste
+ * @return	Valor actual del contador
+ */
+uint16_t tmr_clock_count (void)
+{
+	return tmr_regs[TMR_CLOCK_ID]->cntr;
+}
+
+/*****************************************************************************/
+
+/**
+ * Adelanta el reloj monótono y los temporizadores en marcha el tiempo que han
+ * estado parados los periféricos (ver crm_hibernate). Los temporizadores que
+ * habrían vencido mientras tanto vencen tras TMR_MIN_TICKS
+ * @param ticks	Ticks que ha estado parado el reloj
+ */
+void tmr_advance (uint64_t ticks)
+{
+	volatile tmr_regs_t *clock = tmr_regs[TMR_CLOCK_ID];
+	tmr_channel_t *chan;
+	itc_critical_t state;
+	uint64_t now, left;
+	uint32_t i;
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+
+	now = tmr_now () + ticks;
+	clock->ctrl = 0;
+	clock->sctrl &= ~TMR_SCTRL_TOF;
+	clock->cntr = (uint16_t) now;
+	tmr_clock_high = now & ~(uint64_t) 0xFFFF;
+	clock->ctrl = TMR_CTRL_COUNT;
+
+	for (i = 0; i < tmr_max; i++)
+	{
+		chan = &tmr_channels[i];
+
+		/* Con la comparación pendiente el tramo ya ha terminado y lo atiende la isr */
+		if (i == TMR_CLOCK_ID || !chan->remaining || (tmr_regs[i]->csctrl & TMR_CSCTRL_TCF1))
+			continue;
+
+		left = chan->remaining - tmr_regs[i]->cntr;
+		tmr_program (i, (left > ticks + TMR_MIN_TICKS) ? left - ticks : TMR_MIN_TICKS,
+					 chan->period, chan->func, chan->ctx);
+	}
+
+	itc_critical_exit (state);
+}
+
+/*****************************************************************************/
+
+/**
+ * Calcula el vencimiento más próximo de los temporizadores en marcha
+ * @param deadline	Destino del instante de vencimiento (ver tmr_now)
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOENT si no hay
+ * 			ninguno en marcha).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t tmr_next_expiry (uint64_t *deadline)
+{
+	itc_critical_t state;
+	uint64_t now, left, best = 0;
+	uint32_t i, found = 0;
+
+	if (deadline == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+
+	now = tmr_now ();
+	for (i = 0; i < tmr_max; i++)
+	{
+		if (i == TMR_CLOCK_ID || !tmr_channels[i].remaining)
+			continue;
+
+		if (tmr_regs[i]->csctrl & TMR_CSCTRL_TCF1)
+			left = 0;
+		else
+			left = tmr_channels[i].remaining - tmr_regs[i]->cntr;
+
+		if (!found || left < best)
+			best = left;
+		found = 1;
+	}
+
+	itc_critical_exit (state);
+
+	if (!found)
+	{
+		errno = ENOENT;
+		return -1;
+	}
+
+	*deadline = now + best;
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Convierte microsegundos a ticks del reloj, redondeando hacia arriba
+ * @param us	Microsegundos
+ * @return	Ticks
+ */
+uint64_t tmr_us_to_ticks (uint64_t us)
+{
+	/* Se separan los segundos para que el producto no desborde */
+	return (us / 1000000) * TMR_TICK_HZ +
+			((us % 1000000) * TMR_TICK_HZ + 999999) / 1000000;
+}
+
+/*****************************************************************************/
+
+/**
+ * Convierte ticks del reloj a microsegundos, redondeando hacia abajo
+ * @param ticks	Ticks
+ * @return	Microsegundos
+ */
+uint64_t tmr_ticks_to_us (uint64_t ticks)
+{
+	return (ticks / TMR_TICK_HZ) * 1000000 +
+			((ticks % TMR_TICK_HZ) * 1000000) / TMR_TICK_HZ;
+}
+
+/*****************************************************************************/
+
+/**
+ * Espera activamente un número de microsegundos
+ * @param us	Microsegundos
+ */
+void tmr_delay_us (uint32_t us)
+{
+	uint64_t end = tmr_now () + tmr_us_to_ticks (us);
+
+	while (tmr_now () < end);
+}
+
+/*****************************************************************************/
+
+/**
+ * Programa un temporizador relativo al instante actual. Si ya estaba en marcha
+ * se vuelve a programar
+ * @param tmr	Canal
+ * @param ticks	Ticks hasta el vencimiento y periodo en modo periódico. Al menos
+ * 				TMR_MIN_TICKS en modo periódico. En modo de un disparo los
+ * 				valores menores se redondean a TMR_MIN_TICKS
+ * @param mode	Modo del temporizador
+ * @param func	Función callback. Puede ser NULL si sólo se usan los eventos
+ * @param ctx	Contexto que se pasa a la callback
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t tmr_start (tmr_id_t tmr, uint32_t ticks, tmr_mode_t mode, tmr_callback_t func, void *ctx)
+{
+	if (tmr >= tmr_max || tmr == TMR_CLOCK_ID || mode >= tmr_mode_max ||
+		(mode == tmr_periodic && ticks < TMR_MIN_TICKS))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (ticks < TMR_MIN_TICKS)
+		ticks = TMR_MIN_TICKS;
+
+	tmr_program (tmr, ticks, (mode == tmr_periodic) ? ticks : 0, func, ctx);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Programa un temporizador de un disparo para que venza en un instante
+ * absoluto del reloj monótono. Los instantes pasados o demasiado cercanos
+ * vencen tras TMR_MIN_TICKS
+ * @param tmr		Canal
+ * @param deadline	Instante de vencimiento (ver tmr_now)
+ * @param func		Función callback. Puede ser NULL si sólo se usan los eventos
+ * @param ctx		Contexto que se pasa a la callback
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t tmr_set_deadline (tmr_id_t tmr, uint64_t deadline, tmr_callback_t func, void *ctx)
+{
+	uint64_t now;
+
+	if (tmr >= tmr_max || tmr == TMR_CLOCK_ID)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	now = tmr_now ();
+	tmr_program (tmr, (deadline > now + TMR_MIN_TICKS) ? deadline - now : TMR_MIN_TICKS,
+				 0, func, ctx);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Detiene un temporizador. No tiene efecto si ya estaba detenido
+ * @param tmr	Canal
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t tmr_stop (tmr_id_t tmr)
+{
+	itc_critical_t state;
+
+	if (tmr >= tmr_max || tmr == TMR_CLOCK_ID)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+
+	tmr_regs[tmr]->ctrl = 0;
+	tmr_regs[tmr]->csctrl = 0;
+	tmr_channels[tmr].remaining = 0;
+
+	itc_critical_exit (state);
+
+	return 0;
+}
+
+/*****************************************************************************/
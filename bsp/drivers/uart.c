@@ -5,8 +5,11 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 #include "system.h"
-#include "circular_buffer.h"
+#include "spsc_buffer.h"
+#include "crc16.h"
+#include "baudrate.h"
 
 /*****************************************************************************/
 
@@ -114,41 +117,305 @@ static const uart_pins_t uart_pins[uart_max] = {
 		{gpio_pin_14, gpio_pin_15, gpio_pin_16, gpio_pin_17},
 		{gpio_pin_18, gpio_pin_19, gpio_pin_20, gpio_pin_21} };
 
-static void uart_1_isr (void);
-static void uart_2_isr (void);
-static const itc_handler_t uart_irq_handlers[uart_max] = {uart_1_isr, uart_2_isr};
+/**
+ * Tamaño de los FIFO hardware de las uart
+ */
+#define UART_FIFO_SIZE	32
+
+/**
+ * Bits del registro de estado que usa el driver
+ */
+#define UART_USTAT_PE	(1 << 1)		/* Error de paridad */
+#define UART_USTAT_FE	(1 << 2)		/* Error de trama */
+#define UART_USTAT_TOE	(1 << 3)		/* Desbordamiento del FIFO de transmisión */
+#define UART_USTAT_ROE	(1 << 4)		/* Desbordamiento del FIFO de recepción */
+#define UART_USTAT_RXRDY	(1 << 6)		/* Hay datos en el FIFO de recepción */
+#define UART_USTAT_TXRDY	(1 << 7)		/* Hay hueco en el FIFO de transmisión */
+#define UART_USTAT_ERRORS	(UART_USTAT_PE | UART_USTAT_FE | UART_USTAT_TOE | UART_USTAT_ROE)
+
+static void uart_isr (itc_src_t src, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Búferes circulares. Su memoria se reserva de la arena del BSP al inicializar
+ * cada uart, y un búfer sin memoria indica que esa dirección está deshabilitada.
+ * En recepción la isr es el productor y la aplicación el consumidor, y en
+ * transmisión al revés, por lo que no hace falta enmascarar las interrupciones
+ * de la uart para acceder a los búferes
+ */
+static spsc_buffer_t uart_rx_buffers[uart_max];
+static spsc_buffer_t uart_tx_buffers[uart_max];
+
+/**
+ * Bloques de la arena asignados a cada búfer. La arena no libera memoria, así
+ * que el bloque y su capacidad se conservan aunque el búfer se reinicialice con
+ * un tamaño menor o nulo, para volver a usarlo en la siguiente inicialización
+ */
+typedef struct
+{
+	uint8_t *data;
+	uint32_t capacity;
+} uart_buffer_block_t;
+
+static uart_buffer_block_t uart_rx_blocks[uart_max];
+static uart_buffer_block_t uart_tx_blocks[uart_max];
+
+/**
+ * Semáforos binarios que la isr señala cuando hay datos en el búfer de
+ * recepción o hueco en el de transmisión. Las tareas se bloquean en ellos en
+ * uart_wait (ver kernel.h)
+ */
+static bsp_sem_t uart_rx_sems[uart_max];
+static bsp_sem_t uart_tx_sems[uart_max];
 
 /*****************************************************************************/
 
 /**
- * Tamaño de los búferes circulares
+ * Colas de descriptores de transmisión asíncrona. La aplicación añade al final
+ * y la isr extrae del principio, siempre con la fuente de la uart enmascarada
+ * en el caso de la aplicación
  */
-#define __UART_BUFFER_SIZE__	256
+typedef struct
+{
+	uart_tx_desc_t *head;
+	uart_tx_desc_t *tail;
+} uart_tx_queue_t;
 
-static volatile uint8_t uart_rx_buffers[uart_max][__UART_BUFFER_SIZE__];
-static volatile uint8_t uart_tx_buffers[uart_max][__UART_BUFFER_SIZE__];
+static uart_tx_queue_t uart_tx_queues[uart_max];
+static uint32_t uart_tx_fill (uart_id_t uart);
+
+/*****************************************************************************/
 
-static volatile circular_buffer_t uart_circular_rx_buffers[uart_max];
-static volatile circular_buffer_t uart_circular_tx_buffers[uart_max];
+/**
+ * Tamaños por defecto de los búferes, fijados en system.h
+ */
+static const uint32_t uart_default_rx_sizes[uart_max] = {UART1_RX_BUFFER_SIZE, UART2_RX_BUFFER_SIZE};
+static const uint32_t uart_default_tx_sizes[uart_max] = {UART1_TX_BUFFER_SIZE, UART2_TX_BUFFER_SIZE};
 
+/**
+ * Los tamaños de system.h se comprueban al compilar: potencia de dos o 0
+ */
+#define UART_BUFFER_SIZE_OK(size)	((size) == 0 || SPSC_BUFFER_IS_POW2 (size))
+typedef char uart_buffer_size_not_power_of_two[(UART_BUFFER_SIZE_OK(UART1_RX_BUFFER_SIZE) &&
+                                               UART_BUFFER_SIZE_OK(UART1_TX_BUFFER_SIZE) &&
+                                               UART_BUFFER_SIZE_OK(UART2_RX_BUFFER_SIZE) &&
+                                               UART_BUFFER_SIZE_OK(UART2_TX_BUFFER_SIZE)) ? 1 : -1];
 
 /*****************************************************************************/
 
 /**
- * Gestión de las callbacks
+ * Gestión de las callbacks. La isr no las llama directamente, sino que encola
+ * un trabajo diferido, salvo que ya haya uno pendiente para la misma callback
  */
 typedef struct
 {
 	uart_callback_t tx_callback;
 	uart_callback_t rx_callback;
+	void *tx_ctx;				/* Contexto de la callback de transmisión */
+	void *rx_ctx;				/* Contexto de la callback de recepción */
+	uint8_t tx_pending;			/* Hay un trabajo diferido de transmisión encolado */
+	uint8_t rx_pending;			/* Hay un trabajo diferido de recepción encolado */
 } uart_callbacks_t;
 
+/**
+ * Argumento de los trabajos diferidos de las callbacks: identificador de la
+ * uart en los bits bajos y callback a ejecutar
+ */
+#define UART_DEFER_UART		0xFF
+#define UART_DEFER_RX		(1 << 8)
+#define UART_DEFER_TX		(1 << 9)
+
 static volatile uart_callbacks_t uart_callbacks[uart_max];
 
 /*****************************************************************************/
 
 /**
- * Inicializa una uart
+ * Configuración de velocidad de cada uart
+ */
+static baudrate_t uart_baudrates[uart_max];
+
+/*****************************************************************************/
+
+/**
+ * Contadores de rendimiento. Los actualiza sobre todo la isr, así que la
+ * aplicación sólo los lee o modifica con la fuente de la uart enmascarada
+ */
+static uart_stats_t uart_stats[uart_max];
+
+/*****************************************************************************/
+
+/**
+ * Caracteres especiales de SLIP
+ */
+#define SLIP_END		0xC0
+#define SLIP_ESC		0xDB
+#define SLIP_ESC_END	0xDC
+#define SLIP_ESC_ESC	0xDD
+
+/*****************************************************************************/
+
+/**
+ * Estado de la recepción por tramas.
+ * La trama en curso se decodifica en el espacio libre del búfer de recepción,
+ * a partir de la posición de escritura, y sólo se publica al completarla
+ */
+typedef struct
+{
+	uart_framing_t mode;				/* Modo de entramado */
+	uart_frame_callback_t callback;		/* Notificación de trama completa */
+	void *ctx;							/* Contexto de la notificación */
+	uint32_t len;						/* Bytes decodificados de la trama en curso */
+	uint16_t crc;						/* CRC de la trama en curso */
+	uint8_t escape;						/* SLIP: el byte anterior era SLIP_ESC */
+	uint8_t remaining;					/* COBS: bytes que quedan en el bloque actual */
+	uint8_t zero;						/* COBS: el bloque actual termina con un cero */
+	uart_frame_status_t status;			/* Estado de la trama en curso */
+} uart_frame_t;
+
+static uart_frame_t uart_frames[uart_max];
+static void uart_frame_reset (uart_frame_t *frame);
+
+/*****************************************************************************/
+
+/**
+ * Contexto del manejador FIQ de recepción (uart_fiq.s). El manejador accede a
+ * los campos por su desplazamiento, así que no se debe cambiar su orden
+ */
+typedef struct
+{
+	volatile uart_regs_t *regs;		/* 0: uart asociada o NULL */
+	spsc_buffer_t *cb;				/* 4: búfer de recepción */
+	uint32_t *rx_bytes;				/* 8: contador de bytes recibidos */
+	uint32_t src_mask;				/* 12: bit de la fuente en el ITC */
+} uart_fiq_ctx_t;
+
+uart_fiq_ctx_t uart_fiq_ctx;
+
+/**
+ * Manejador FIQ de recepción, definido en uart_fiq.s
+ */
+void uart_fiq_rx_handler (void);
+
+/*****************************************************************************/
+
+/**
+ * Enmascara o desenmascara las interrupciones de transmisión de una uart.
+ * Sólo se usa fuera del camino rápido. Como la isr también modifica ucon, la
+ * escritura se protege enmascarando la fuente de la uart en el ITC
+ * @param uart	Identificador de la uart
+ * @param mask	1 para enmascarar, 0 para desenmascarar
+ * @return		El valor anterior de la máscara
+ */
+static uint32_t uart_set_tx_mask (uart_id_t uart, uint32_t mask)
+{
+	itc_critical_t critical;
+	uint32_t old;
+
+	critical = itc_critical_enter (ITC_SRC_MASK (itc_src_uart1 + uart));
+	old = uart_regs[uart]->MTxR;
+	uart_regs[uart]->MTxR = mask;
+	itc_critical_exit (critical);
+
+	return old;
+}
+
+/*****************************************************************************/
+
+/**
+ * Enmascara o desenmascara las interrupciones de recepción de una uart.
+ * Sólo se usa fuera del camino rápido. Como la isr también modifica ucon, la
+ * escritura se protege enmascarando la fuente de la uart en el ITC
+ * @param uart	Identificador de la uart
+ * @param mask	1 para enmascarar, 0 para desenmascarar
+ * @return		El valor anterior de la máscara
+ */
+static uint32_t uart_set_rx_mask (uart_id_t uart, uint32_t mask)
+{
+	itc_critical_t critical;
+	uint32_t old;
+
+	critical = itc_critical_enter (ITC_SRC_MASK (itc_src_uart1 + uart));
+	old = uart_regs[uart]->MRxR;
+	uart_regs[uart]->MRxR = mask;
+	itc_critical_exit (critical);
+
+	return old;
+}
+
+/*****************************************************************************/
+
+/**
+ * Indica si la aplicación ha liberado suficiente espacio en el búfer de
+ * recepción como para que la isr vuelva a vaciar el FIFO.
+ * Sin control de flujo se reanuda en cuanto hay hueco para perder los menos
+ * bytes posibles. Con control de flujo no se pierden datos, así que se espera a
+ * que quepa un FIFO completo (o medio búfer si es más pequeño) para no generar
+ * una interrupción por byte
+ * @param uart	Identificador de la uart
+ * @return		1 si se puede reanudar la recepción o 0 en otro caso
+ */
+static inline uint32_t uart_rx_can_resume (uart_id_t uart)
+{
+	spsc_buffer_t *cb = &uart_rx_buffers[uart];
+	uint32_t size = spsc_buffer_size (cb);
+	uint32_t room = size - spsc_buffer_count (cb);
+
+	if (!uart_regs[uart]->FCe)
+		return room > 0;
+
+	return room >= UART_FIFO_SIZE || room >= size / 2;
+}
+
+/*****************************************************************************/
+
+/**
+ * Programa los divisores de velocidad de una uart con su configuración actual.
+ * La uart debe estar deshabilitada
+ * @param uart	Identificador de la uart
+ */
+static void uart_write_baudrate (uart_id_t uart)
+{
+	uart_regs[uart]->xTIM = (uart_baudrates[uart].oversampling == 8);
+	uart_regs[uart]->ubr = ((uint32_t) uart_baudrates[uart].inc << 16) | uart_baudrates[uart].mod;
+}
+
+/*****************************************************************************/
+
+/**
+ * Asigna la memoria de un búfer circular desde la arena del BSP.
+ * Si el bloque de una inicialización anterior tiene capacidad suficiente se
+ * reutiliza. Si no, se reserva uno nuevo y el anterior se pierde, pero como los
+ * tamaños son potencias de dos la capacidad al menos se duplica cada vez, y lo
+ * perdido nunca supera la capacidad final
+ * @param cb	Búfer circular
+ * @param block	Bloque asignado al búfer
+ * @param size	Tamaño en bytes. Potencia de dos o cero para no usar el búfer
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+static int32_t uart_buffer_alloc (spsc_buffer_t *cb, uart_buffer_block_t *block, uint32_t size)
+{
+	uint8_t *data;
+
+	if (size > block->capacity)
+	{
+		data = bsp_arena_alloc (size);
+		if (data == NULL)
+			return -1;
+		block->data = data;
+		block->capacity = size;
+	}
+
+	spsc_buffer_init (cb, size ? block->data : NULL, size);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa una uart con los tamaños de búfer por defecto (ver system.h)
  * @param uart	Identificador de la uart
  * @param br	Baudrate
  * @param name	Nombre del dispositivo
@@ -156,6 +423,34 @@ static volatile uart_callbacks_t uart_callbacks[uart_max];
  * 				La condición de error se indica en la variable global errno
  */
 int32_t uart_init (uart_id_t uart, uint32_t br, const char *name)
+{
+	/* Sólo hay dos uarts */
+	if (uart >= uart_max)
+	{
+		errno = ENODEV; /* El dispositivo no existe */
+		return -1;
+	}
+
+	return uart_init_ex (uart, br, name, uart_default_rx_sizes[uart], uart_default_tx_sizes[uart]);
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa una uart indicando el tamaño de sus búferes de recepción y de
+ * transmisión, que se reservan de la arena del BSP. Al volver a inicializarla
+ * se reutiliza la memoria ya reservada mientras quepan los nuevos tamaños
+ * @param uart		Identificador de la uart
+ * @param br		Baudrate
+ * @param name		Nombre del dispositivo
+ * @param rx_size	Tamaño del búfer de recepción. Potencia de dos o cero para
+ * 					deshabilitar la recepción
+ * @param tx_size	Tamaño del búfer de transmisión. Potencia de dos o cero para
+ * 					deshabilitar la transmisión
+ * @return			Cero en caso de éxito o -1 en caso de error.
+ * 					La condición de error se indica en la variable global errno
+ */
+int32_t uart_init_ex (uart_id_t uart, uint32_t br, const char *name, uint32_t rx_size, uint32_t tx_size)
 {
 //     	uint32_t inc, mod;
 // 
@@ -233,20 +528,34 @@ int32_t uart_init (uart_id_t uart, uint32_t br, const char *name)
         errno = EFAULT;
         return -1;
     }
+    if((rx_size & (rx_size - 1)) || (tx_size & (tx_size - 1))){
+        errno = EINVAL;
+        return -1;
+    }
+    //Calculamos los divisores antes de tocar la uart. Falla si el error es excesivo
+    if(baudrate_solve(CPU_FREQ, br, 0, UART_BAUDRATE_TOLERANCE, &uart_baudrates[uart]) < 0)
+        return -1;
+    
     //Desactivación de TxE, RxE, MTxR y MRxR
     uart_regs[uart]->ucon = 0x6000;
     
     //Se establecen los baudios de la UART
-    uart_regs[uart]->ubrmod = 9999;
-    uart_regs[uart]->ubrinc = (br * 9999) / (CPU_FREQ >> 4);
+    uart_write_baudrate(uart);
+    
+    //Reservamos los bufferes circulares. Un tamaño cero deshabilita esa dirección
+    if(uart_buffer_alloc(&uart_rx_buffers[uart], &uart_rx_blocks[uart], rx_size) < 0 ||
+       uart_buffer_alloc(&uart_tx_buffers[uart], &uart_tx_blocks[uart], tx_size) < 0)
+        return -1;
     
-    //Rehabilitamos la uart
-    uart_regs[uart]->TxE = 1;
-    uart_regs[uart]->RxE = 1;
+    //Rehabilitamos la uart, sólo en las direcciones que tengan buffer
+    uart_regs[uart]->TxE = (tx_size > 0);
+    uart_regs[uart]->RxE = (rx_size > 0);
 
     //Fijamos la función de los pines
-    gpio_set_pin_func(uart_pins[uart].tx, gpio_func_alternate_1);
-    gpio_set_pin_func(uart_pins[uart].rx, gpio_func_alternate_1);
+    if(tx_size > 0)
+        gpio_set_pin_func(uart_pins[uart].tx, gpio_func_alternate_1);
+    if(rx_size > 0)
+        gpio_set_pin_func(uart_pins[uart].rx, gpio_func_alternate_1);
     gpio_set_pin_func(uart_pins[uart].cts, gpio_func_alternate_1);
     gpio_set_pin_func(uart_pins[uart].rts, gpio_func_alternate_1);
     
@@ -256,29 +565,39 @@ int32_t uart_init (uart_id_t uart, uint32_t br, const char *name)
     gpio_set_pin_dir_input(uart_pins[uart].rx);
     gpio_set_pin_dir_input(uart_pins[uart].rts);
     
-    //Inicializamos los bufferes circulares
-    circular_buffer_init(&uart_circular_rx_buffers[uart], (uint8_t *) uart_rx_buffers[uart], sizeof(uart_rx_buffers[uart]));
-    circular_buffer_init(&uart_circular_tx_buffers[uart], (uint8_t *) uart_tx_buffers[uart], sizeof(uart_tx_buffers[uart]));
-    
     //Fijamos cuantos bytes deben haber en el buffer para que se activen las interrupciones
     uart_regs[uart]->RxLevel = 1;
     uart_regs[uart]->TxLevel = 31;
     
     /* Habilitamos las interrupciones de la uart en el ICT */
     
-    //Configuramos las interrupciones en el ITC
-    itc_set_handler(itc_src_uart1 + uart, uart_irq_handlers[uart]);
+    //Los semáforos de uart_wait empiezan sin señalar
+    bsp_sem_init(&uart_rx_sems[uart], 0, 1);
+    bsp_sem_init(&uart_tx_sems[uart], 0, 1);
+    
+    //Configuramos las interrupciones en el ITC, volviendo a la IRQ si se usaba la FIQ
+    uart_set_fiq(uart, 0);
+    itc_set_handler(itc_src_uart1 + uart, uart_isr, NULL);
     itc_set_priority(itc_src_uart1 + uart, itc_priority_normal);
     itc_enable_interrupt(itc_src_uart1 + uart);
     
     //Configuramos los callbacks como vacíos
     uart_callbacks[uart].tx_callback = NULL;
     uart_callbacks[uart].rx_callback = NULL;
+    uart_callbacks[uart].tx_pending = 0;
+    uart_callbacks[uart].rx_pending = 0;
+    
+    //Se abandonan las transmisiones asíncronas pendientes de una inicialización anterior
+    uart_tx_queues[uart].head = NULL;
+    uart_tx_queues[uart].tail = NULL;
     
-    //Y habilitamos las interrupciones de recepción
-    uart_regs[uart]->MRxR = 0;
+    //El control de flujo queda deshabilitado (FCe = 0) hasta que lo pida la aplicación
+    memset(&uart_stats[uart], 0, sizeof(uart_stats_t));
     
-    bsp_register_dev (name, uart, NULL, NULL, uart_receive, uart_send, NULL, NULL, NULL);
+    //Y habilitamos las interrupciones de recepción, si se usa
+    uart_regs[uart]->MRxR = (rx_size == 0);
+    
+    bsp_register_dev (name, uart, NULL, NULL, uart_receive, uart_send, NULL, uart_fstat, NULL, uart_ioctl);
     
     return 0;
 }
@@ -287,29 +606,26 @@ int32_t uart_init (uart_id_t uart, uint32_t br, const char *name)
 
 /**
  * Transmite un byte por la uart
- * Implementación del driver de nivel 0. La llamada se bloquea hasta que transmite el byte
+ * Implementación del driver de nivel 0. La llamada se bloquea hasta que transmite el byte,
+ * después de todo lo pendiente de uart_send y uart_send_async
  * @param uart	Identificador de la uart
  * @param c		El carácter
  */
 void uart_send_byte (uart_id_t uart, uint8_t c)
 {
+    //Deshabilitamos las interrupciones del transmisor para ser el único consumidor del buffer
+    uint32_t temp_interrupt = uart_set_tx_mask(uart, 1);
     
-    //Deshabilitamos las interrupciones del transmisor
-    uint32_t temp_interrupt = uart_regs[uart]->MTxR;
-    uart_regs[uart]->MTxR = 1;
-    
-    //Volcamos todo lo que haya en el buffer circular en el FIFO.
-    while(!circular_buffer_is_empty(&uart_circular_tx_buffers[uart])){
-        while(uart_regs[uart]->Tx_fifo_addr_diff > 0)
-            uart_regs[uart]->Tx_data = circular_buffer_read(&uart_circular_rx_buffers[uart]);
-    }
+    //Volcamos en el FIFO el buffer circular y los descriptores asíncronos para respetar el orden
+    while(!spsc_buffer_is_empty(&uart_tx_buffers[uart]) || uart_tx_queues[uart].head != NULL)
+        uart_tx_fill(uart);
     
     //Bloquear mientras no haya espacio,
     while(uart_regs[uart]->Tx_fifo_addr_diff == 0);
     uart_regs[uart]->Tx_data = c;
     
     //Volver a dejar las interrupciones como estaban
-    uart_regs[uart]->MTxR = temp_interrupt;
+    uart_set_tx_mask(uart, temp_interrupt);
 
 }
 
@@ -323,23 +639,19 @@ void uart_send_byte (uart_id_t uart, uint8_t c)
  */
 uint8_t uart_receive_byte (uart_id_t uart)
 {
-    //Deshabilitamos las interrupciones del receptor
-    uint32_t temp_interrupt = uart_regs[uart]->MRxR;
+    //Deshabilitamos las interrupciones del receptor para que la isr no vacíe el FIFO
+    uint32_t temp_interrupt = uart_set_rx_mask(uart, 1);
     uint8_t ret;
-    uart_regs[uart]->MRxR = 1;
     
     //Si hay algo pendiente en el buffer extraemos de ahi
-    if(!circular_buffer_is_empty(&uart_circular_rx_buffers[uart])){
-        ret = circular_buffer_read(&uart_circular_rx_buffers[uart]);
-    }
     //Si no se extrae directamente del buffer de la uart, bloqueando si es necesario.
-    else{
+    if(spsc_buffer_read_block(&uart_rx_buffers[uart], &ret, 1) == 0){
         while(uart_regs[uart]->Rx_fifo_addr_diff == 0);
         ret = uart_regs[uart]->Rx_data;
     }
     
     //Devolvemos las interrupciones a su estado anterior
-    uart_regs[uart]->MRxR = temp_interrupt;
+    uart_set_rx_mask(uart, temp_interrupt);
     
     return ret;
 }
@@ -367,21 +679,75 @@ ssize_t uart_send (uint32_t uart, char *buf, size_t count)
         errno = EFAULT;
         return -1;
     }
+    if(uart_tx_buffers[uart].data == NULL){
+        errno = EBADF; //Transmisión deshabilitada
+        return -1;
+    }
+    
+    //Copiamos en bloque todo lo que quepa en el buffer circular
+    ssize_t written_bytes = spsc_buffer_write_block(&uart_tx_buffers[uart], (uint8_t *) buf, count);
+    uint32_t pending = spsc_buffer_count(&uart_tx_buffers[uart]);
     
+    //Sólo la aplicación escribe estos contadores
+    uart_stats[uart].tx_ring_full += count - written_bytes;
+    if(pending > uart_stats[uart].tx_high_water)
+        uart_stats[uart].tx_high_water = pending;
     
-    //Deshabilitación de interrupciones
-    uart_regs[uart]->MTxR = 1;
-    ssize_t written_bytes = 0;
+    //Si la isr había enmascarado la transmisión por vaciar el buffer, la reactivamos.
+    //Se comprueba tras publicar los datos para no perder la carrera con la isr
+    if(written_bytes > 0 && uart_regs[uart]->MTxR)
+        uart_set_tx_mask(uart, 0);
     
-    while(!circular_buffer_is_full(&uart_circular_tx_buffers[uart]) && count > 0){
-        circular_buffer_write(&uart_circular_tx_buffers[uart], *buf++);
-        written_bytes++;
-        count--;
+    return written_bytes;
+}
+
+/*****************************************************************************/
+
+/**
+ * Transmisión asíncrona de un bloque sin copia intermedia.
+ * Implementación del driver de nivel 1. El descriptor se encola y la isr
+ * escribe los datos directamente desde el búfer de la aplicación al FIFO. La
+ * transmisión respeta el orden de las llamadas: el bloque sale después de lo
+ * que uart_send ya había dejado en el búfer circular y antes de lo que deje
+ * después. Al terminar se difiere la llamada a la función de finalización del
+ * descriptor. Ni el descriptor ni sus datos se pueden modificar hasta entonces
+ * @param uart	Identificador de la uart
+ * @param desc	Descriptor con los datos a transmitir
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_send_async (uart_id_t uart, uart_tx_desc_t *desc)
+{
+    //comprobación de errores
+    if(uart >= uart_max){
+        errno = ENODEV;
+        return -1;
+    }
+    if(!desc || (!desc->buf && desc->len > 0)){
+        errno = EFAULT;
+        return -1;
+    }
+    if(uart_tx_buffers[uart].data == NULL){
+        errno = EBADF; //Transmisión deshabilitada
+        return -1;
     }
     
+    desc->sent = 0;
+    desc->next = NULL;
+    //Los bytes de uart_send hasta aquí salen antes que el bloque
+    desc->ring_pos = spsc_buffer_write_pos(&uart_tx_buffers[uart]);
+    
+    //Encolamos el descriptor y activamos la transmisión sin que intervenga la isr
+    itc_critical_t critical = itc_critical_enter(ITC_SRC_MASK(itc_src_uart1 + uart));
+    if(uart_tx_queues[uart].tail)
+        uart_tx_queues[uart].tail->next = desc;
+    else
+        uart_tx_queues[uart].head = desc;
+    uart_tx_queues[uart].tail = desc;
     uart_regs[uart]->MTxR = 0;
+    itc_critical_exit(critical);
     
-    return written_bytes;
+    return 0;
 }
 
 /*****************************************************************************/
@@ -407,19 +773,17 @@ ssize_t uart_receive (uint32_t uart, char *buf, size_t count)
         errno = EFAULT;
         return -1;
     }
+    if(uart_rx_buffers[uart].data == NULL){
+        errno = EBADF; //Recepción deshabilitada
+        return -1;
+    }
     
-    ssize_t read_bytes = 0;
-    
-    //Deshabilitación de interrupciones
-    uart_regs[uart]->MRxR = 1;
+    //Copiamos en bloque todo lo que haya en el buffer circular
+    ssize_t read_bytes = spsc_buffer_read_block(&uart_rx_buffers[uart], (uint8_t *) buf, count);
     
-    while(!circular_buffer_is_empty(&uart_circular_rx_buffers[uart]) && count > 0){
-        *buf++ = circular_buffer_read(&uart_circular_rx_buffers[uart]);
-        read_bytes++;
-        count--;
-    }
-        
-    uart_regs[uart]->MRxR = 0;
+    //Si la isr había enmascarado la recepción por llenar el buffer, la reanudamos cuando hay hueco
+    if(read_bytes > 0 && uart_regs[uart]->MRxR && uart_rx_can_resume(uart))
+        uart_set_rx_mask(uart, 0);
     
     return read_bytes;
 }
@@ -430,10 +794,11 @@ ssize_t uart_receive (uint32_t uart, char *buf, size_t count)
  * Fija la función callback de recepción de una uart
  * @param uart	Identificador de la uart
  * @param func	Función callback. NULL para anular una selección anterior
+ * @param ctx	Contexto que se pasa a la callback
  * @return	Cero en caso de éxito o -1 en caso de error.
  * 		La condición de error se indica en la variable global errno
  */
-int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func)
+int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func, void *ctx)
 {
     //comprobación de errores
     if(uart >= uart_max){
@@ -441,7 +806,11 @@ int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func)
         return -1;
     }
     
+    //Una callback diferida pendiente no debe ver la función y el contexto a medias
+    itc_critical_t critical = itc_critical_enter(ITC_SRC_ALL);
     uart_callbacks[uart].rx_callback = func;
+    uart_callbacks[uart].rx_ctx = ctx;
+    itc_critical_exit(critical);
     
     return 0;
 }
@@ -452,10 +821,11 @@ int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func)
  * Fija la función callback de transmisión de una uart
  * @param uart	Identificador de la uart
  * @param func	Función callback. NULL para anular una selección anterior
+ * @param ctx	Contexto que se pasa a la callback
  * @return	Cero en caso de éxito o -1 en caso de error.
  * 		La condición de error se indica en la variable global errno
  */
-int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func)
+int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func, void *ctx)
 {
     //comprobación de errores
     if(uart >= uart_max){
@@ -463,7 +833,11 @@ int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func)
         return -1;
     }
     
+    //Una callback diferida pendiente no debe ver la función y el contexto a medias
+    itc_critical_t critical = itc_critical_enter(ITC_SRC_ALL);
     uart_callbacks[uart].tx_callback = func;
+    uart_callbacks[uart].tx_ctx = ctx;
+    itc_critical_exit(critical);
     
     return 0;
 }
@@ -471,62 +845,883 @@ int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func)
 /*****************************************************************************/
 
 /**
- * Manejador genérico de interrupciones para las uart.
- * Cada isr llamará a este manejador indicando la uart en la que se ha
- * producido la interrupción.
- * Lo declaramos inline para reducir la latencia de la isr
+ * Selecciona el modo de entramado en recepción de una uart.
+ * En los modos SLIP y COBS la isr decodifica las tramas directamente sobre el
+ * búfer de recepción y llama a la callback una vez por trama completa en vez
+ * de llamar a la callback de recepción. Cada trama termina con su CRC-16 CCITT
+ * (byte alto primero), que se comprueba y se elimina antes de publicarla.
+ * Las tramas erróneas se descartan, pero también se notifican.
+ * Las tramas correctas se leen con uart_receive
  * @param uart	Identificador de la uart
+ * @param mode	Modo de entramado
+ * @param func	Función callback de trama completa
+ * @param ctx	Contexto que se pasa a la callback
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
  */
-static inline void uart_isr (uart_id_t uart)
+int32_t uart_set_framing (uart_id_t uart, uart_framing_t mode, uart_frame_callback_t func, void *ctx)
 {
-    uint32_t status = uart_regs[uart]->ustat;
+    //comprobación de errores
+    if(uart >= uart_max){
+        errno = ENODEV;
+        return -1;
+    }
+    if(mode >= uart_framing_max){
+        errno = EINVAL;
+        return -1;
+    }
+    if(uart_rx_buffers[uart].data == NULL){
+        errno = EBADF; //Recepción deshabilitada
+        return -1;
+    }
+    if(mode != uart_framing_none && uart_fiq_ctx.regs == uart_regs[uart]){
+        errno = EBUSY; //La FIQ no decodifica tramas
+        return -1;
+    }
+    
+    //La isr no debe ver el estado a medio cambiar. Se descarta la trama en curso
+    itc_critical_t critical = itc_critical_enter(ITC_SRC_MASK(itc_src_uart1 + uart));
+    uart_frames[uart].mode = mode;
+    uart_frames[uart].callback = func;
+    uart_frames[uart].ctx = ctx;
+    uart_frame_reset(&uart_frames[uart]);
+    itc_critical_exit(critical);
+    
+    return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Atiende la recepción de una uart con el manejador FIQ en ensamblador, que
+ * vacía el FIFO en el búfer de recepción con la mínima latencia. El resto del
+ * trabajo (transmisión, callbacks, búfer lleno) lo sigue haciendo la isr normal,
+ * a la que el manejador rápido cede la fuente tras cada ráfaga para que
+ * despierte a las tareas y corrutinas que esperan datos.
+ * Sólo una uart puede usar la FIQ, y no es compatible con la recepción por
+ * tramas. Los bytes recibidos por FIQ sólo se contabilizan en rx_bytes
+ * @param uart		Identificador de la uart
+ * @param enable	1 para usar la FIQ, 0 para volver a la IRQ
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_fiq (uart_id_t uart, uint32_t enable)
+{
+    itc_src_t src = itc_src_uart1 + uart;
+    
+    //comprobación de errores
+    if(uart >= uart_max){
+        errno = ENODEV;
+        return -1;
+    }
     
-    //Gestión de interrupciones de recepción
-    if(uart_regs[uart]->RxRdy){
-        while(!circular_buffer_is_full(&uart_circular_rx_buffers[uart]) && (uart_regs[uart]->Rx_fifo_addr_diff > 0)){
-            circular_buffer_write(&uart_circular_rx_buffers[uart], uart_regs[uart]->Rx_data);
+    if(enable){
+        if(uart_rx_buffers[uart].data == NULL){
+            errno = EBADF; //Recepción deshabilitada
+            return -1;
+        }
+        if(uart_frames[uart].mode != uart_framing_none ||
+           (uart_fiq_ctx.regs != NULL && uart_fiq_ctx.regs != uart_regs[uart])){
+            errno = EBUSY; //Recepción por tramas o FIQ ocupada por la otra uart
+            return -1;
         }
         
-        if(uart_callbacks[uart].rx_callback) 
-            uart_callbacks[uart].rx_callback();
-        
-        if(circular_buffer_is_full(&uart_circular_rx_buffers[uart]))
-            uart_regs[uart]->MRxR = 1;
+        itc_critical_t critical = itc_critical_enter(ITC_SRC_MASK(src));
+        uart_fiq_ctx.regs = uart_regs[uart];
+        uart_fiq_ctx.cb = &uart_rx_buffers[uart];
+        uart_fiq_ctx.rx_bytes = &uart_stats[uart].rx_bytes;
+        uart_fiq_ctx.src_mask = 1 << src;
+        excep_set_handler(excep_fiq, uart_fiq_rx_handler);
+        itc_set_priority(src, itc_priority_fast);
+        itc_critical_exit(critical);
     }
+    else if(uart_fiq_ctx.regs == uart_regs[uart]){
+        itc_critical_t critical = itc_critical_enter(ITC_SRC_MASK(src));
+        itc_set_priority(src, itc_priority_normal);
+        excep_set_handler(excep_fiq, excep_fiq_handler);
+        uart_fiq_ctx.regs = NULL;
+        itc_critical_exit(critical);
+    }
+    
+    return 0;
+}
 
-    //Gestión de interrupciones de transmisión
-    if(uart_regs[uart]->TxRdy){
-        while(!circular_buffer_is_empty(&uart_circular_tx_buffers[uart]) && (uart_regs[uart]->Tx_fifo_addr_diff > 0)){
-            uart_regs[uart]->Tx_data = circular_buffer_read(&uart_circular_tx_buffers[uart]);
-        }
-        
-        if(uart_callbacks[uart].tx_callback) 
-            uart_callbacks[uart].tx_callback();
-        
-        if(circular_buffer_is_empty(&uart_circular_tx_buffers[uart]))
-            uart_regs[uart]->MTxR = 1;
+/*****************************************************************************/
+
+/**
+ * Configura el control de flujo hardware (RTS/CTS) de una uart.
+ * La uart deja de aceptar datos (desactiva CTS) cuando su FIFO de recepción
+ * alcanza el nivel indicado. Como la isr deja de vaciar el FIFO cuando se
+ * llena el búfer de recepción, el emisor se detiene en vez de perder datos
+ * @param uart		Identificador de la uart
+ * @param cts_level	Nivel del FIFO de recepción (1-31) al que se desactiva CTS.
+ * 					Cero deshabilita el control de flujo
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_flow_control (uart_id_t uart, uint32_t cts_level)
+{
+    //comprobación de errores
+    if(uart >= uart_max){
+        errno = ENODEV;
+        return -1;
     }
+    if(cts_level >= UART_FIFO_SIZE){
+        errno = EINVAL;
+        return -1;
+    }
+    
+    //La isr también escribe en ucon
+    itc_critical_t critical = itc_critical_enter(ITC_SRC_MASK(itc_src_uart1 + uart));
+    if(cts_level > 0){
+        uart_regs[uart]->ucts = cts_level;
+        uart_regs[uart]->FCp = 0; //CTS activa a nivel bajo
+        uart_regs[uart]->FCe = 1;
+    }
+    else
+        uart_regs[uart]->FCe = 0;
+    itc_critical_exit(critical);
     
+    return 0;
 }
 
 /*****************************************************************************/
 
 /**
- * Manejador de interrupciones para la uart1
+ * Cambia la velocidad de una uart.
+ * Se busca la pareja INC/MOD y el sobremuestreo de menor error, y se rechaza la
+ * velocidad si el error supera UART_BAUDRATE_TOLERANCE (ver system.h). La uart
+ * se deshabilita durante el cambio, por lo que se pueden perder los datos que
+ * estén en los FIFO
+ * @param uart	Identificador de la uart
+ * @param br	Baudrate
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
  */
-static void uart_1_isr (void)
+int32_t uart_set_baudrate (uart_id_t uart, uint32_t br)
 {
-	uart_isr(uart_1);
+    baudrate_t cfg;
+    uint32_t tx, rx;
+    
+    //comprobación de errores
+    if(uart >= uart_max){
+        errno = ENODEV;
+        return -1;
+    }
+    if(baudrate_solve(CPU_FREQ, br, 0, UART_BAUDRATE_TOLERANCE, &cfg) < 0)
+        return -1;
+    
+    //La velocidad sólo se puede cambiar con la uart deshabilitada
+    itc_critical_t critical = itc_critical_enter(ITC_SRC_MASK(itc_src_uart1 + uart));
+    tx = uart_regs[uart]->TxE;
+    rx = uart_regs[uart]->RxE;
+    uart_regs[uart]->TxE = 0;
+    uart_regs[uart]->RxE = 0;
+    
+    uart_baudrates[uart] = cfg;
+    uart_write_baudrate(uart);
+    
+    uart_regs[uart]->TxE = tx;
+    uart_regs[uart]->RxE = rx;
+    itc_critical_exit(critical);
+    
+    return 0;
 }
 
 /*****************************************************************************/
 
 /**
- * Manejador de interrupciones para la uart2
+ * Obtiene la configuración de velocidad de una uart: los divisores, el
+ * sobremuestreo, la velocidad realmente obtenida y su error
+ * @param uart	Identificador de la uart
+ * @param cfg	Estructura para almacenar la configuración
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
  */
-static void uart_2_isr (void)
+int32_t uart_get_baudrate (uart_id_t uart, baudrate_t *cfg)
 {
-	uart_isr(uart_2);
+    //comprobación de errores
+    if(uart >= uart_max){
+        errno = ENODEV;
+        return -1;
+    }
+    if(!cfg){
+        errno = EFAULT;
+        return -1;
+    }
+    
+    *cfg = uart_baudrates[uart];
+    
+    return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Número de desbordamientos del FIFO de recepción detectados desde la
+ * inicialización de la uart
+ * @param uart	Identificador de la uart
+ * @return		El número de desbordamientos
+ */
+uint32_t uart_get_overruns (uart_id_t uart)
+{
+    if(uart >= uart_max)
+        return 0;
+    
+    return uart_stats[uart].overruns;
+}
+
+/*****************************************************************************/
+
+/**
+ * Indica si a una uart le quedan datos por transmitir, en el búfer, en la cola
+ * de descriptores o en el FIFO hardware
+ * @param uart	Identificador de la uart
+ * @return		1 si la transmisión está en curso, 0 en otro caso
+ */
+uint32_t uart_tx_busy (uart_id_t uart)
+{
+    if(uart >= uart_max)
+        return 0;
+    
+    return !spsc_buffer_is_empty(&uart_tx_buffers[uart]) ||
+           uart_tx_queues[uart].head != NULL ||
+           uart_regs[uart]->Tx_fifo_addr_diff < UART_FIFO_SIZE;
+}
+
+/*****************************************************************************/
+
+/**
+ * Consulta sin bloquear cuántos bytes esperan en el búfer de recepción de una
+ * uart. Con la recepción por FIQ no cuenta los que el manejador rápido aún
+ * no ha publicado
+ * @param uart	Identificador de la uart
+ * @return		El número de bytes
+ */
+uint32_t uart_rx_count (uart_id_t uart)
+{
+    if(uart >= uart_max)
+        return 0;
+    
+    return spsc_buffer_count(&uart_rx_buffers[uart]);
+}
+
+/*****************************************************************************/
+
+/**
+ * Consulta sin bloquear cuántos bytes caben en el búfer de transmisión de una
+ * uart
+ * @param uart	Identificador de la uart
+ * @return		El número de bytes
+ */
+uint32_t uart_tx_space (uart_id_t uart)
+{
+    if(uart >= uart_max)
+        return 0;
+    
+    return spsc_buffer_size(&uart_tx_buffers[uart]) - spsc_buffer_count(&uart_tx_buffers[uart]);
+}
+
+/*****************************************************************************/
+
+/**
+ * Copia los contadores de rendimiento de una uart
+ * @param uart	Identificador de la uart
+ * @param stats	Estructura para almacenar los contadores
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_get_stats (uart_id_t uart, uart_stats_t *stats)
+{
+    //comprobación de errores
+    if(uart >= uart_max){
+        errno = ENODEV;
+        return -1;
+    }
+    if(!stats){
+        errno = EFAULT;
+        return -1;
+    }
+    
+    //Copia coherente: la isr no puede modificar los contadores mientras tanto
+    itc_critical_t critical = itc_critical_enter(ITC_SRC_MASK(itc_src_uart1 + uart));
+    *stats = uart_stats[uart];
+    itc_critical_exit(critical);
+    
+    return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Pone a cero los contadores de rendimiento de una uart
+ * @param uart	Identificador de la uart
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_reset_stats (uart_id_t uart)
+{
+    //comprobación de errores
+    if(uart >= uart_max){
+        errno = ENODEV;
+        return -1;
+    }
+    
+    itc_critical_t critical = itc_critical_enter(ITC_SRC_MASK(itc_src_uart1 + uart));
+    memset(&uart_stats[uart], 0, sizeof(uart_stats_t));
+    itc_critical_exit(critical);
+    
+    return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Obtención de información de una uart.
+ * Implementación del driver de nivel 2. st_size indica los bytes pendientes de
+ * leer en el búfer de recepción y st_blksize su tamaño
+ * @param uart	Identificador de la uart
+ * @param buf	Estructura para almacenar dicha información
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int uart_fstat (uint32_t uart, struct stat *buf)
+{
+    //comprobación de errores
+    if(uart >= uart_max){
+        errno = ENODEV;
+        return -1;
+    }
+    if(!buf){
+        errno = EFAULT;
+        return -1;
+    }
+    
+    memset(buf, 0, sizeof(struct stat));
+    buf->st_mode = S_IFCHR;
+    if(uart_rx_buffers[uart].data != NULL){
+        buf->st_size = spsc_buffer_count(&uart_rx_buffers[uart]);
+        buf->st_blksize = spsc_buffer_size(&uart_rx_buffers[uart]);
+    }
+    
+    return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Espera a que haya datos en el búfer de recepción o espacio en el de
+ * transmisión. Las tareas se bloquean en el semáforo que señala la isr, y fuera
+ * de una tarea el procesador queda en bsp_idle (ver bsp_sem_wait)
+ * @param uart		Identificador de la uart
+ * @param request	BSP_IOCTL_WAIT_READ o BSP_IOCTL_WAIT_WRITE
+ * @param block		Cero para consultar sin esperar
+ * @return	Cero si la uart está lista o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+static int uart_wait (uint32_t uart, uint32_t request, uint32_t block)
+{
+    spsc_buffer_t *cb;
+    bsp_sem_t *sem;
+    
+    if(request == BSP_IOCTL_WAIT_READ){
+        cb = &uart_rx_buffers[uart];
+        sem = &uart_rx_sems[uart];
+    }
+    else{
+        cb = &uart_tx_buffers[uart];
+        sem = &uart_tx_sems[uart];
+    }
+    
+    if(cb->data == NULL){
+        errno = EBADF; //Dirección deshabilitada
+        return -1;
+    }
+    
+    //La isr vacía el FIFO de recepción mientras haya hueco y el buffer de transmisión
+    //mientras tenga datos, así que la condición siempre acaba cambiando
+    while(request == BSP_IOCTL_WAIT_READ ? spsc_buffer_is_empty(cb) : spsc_buffer_is_full(cb)){
+        if(!block){
+            errno = EAGAIN;
+            return -1;
+        }
+        bsp_sem_wait(sem, BSP_KERNEL_FOREVER);
+    }
+    
+    return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Operaciones de control de las uart.
+ * Implementación del driver de nivel 2 (ver bsp_ioctl)
+ * @param uart		Identificador de la uart
+ * @param request	Petición (ver uart_ioctl_t y BSP_IOCTL_WAIT_READ/WRITE)
+ * @param arg		Puntero a un uint32_t con el argumento o el resultado
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int uart_ioctl (uint32_t uart, uint32_t request, void *arg)
+{
+    uint32_t *value = (uint32_t *) arg;
+    
+    //comprobación de errores
+    if(uart >= uart_max){
+        errno = ENODEV;
+        return -1;
+    }
+    if(value == NULL && request != uart_ioctl_reset_stats){
+        errno = EFAULT;
+        return -1;
+    }
+    
+    switch(request){
+        case uart_ioctl_set_flow_control:
+            return uart_set_flow_control(uart, *value);
+        case uart_ioctl_get_flow_control:
+            *value = uart_regs[uart]->FCe ? uart_regs[uart]->ucts : 0;
+            return 0;
+        case uart_ioctl_get_overruns:
+            *value = uart_stats[uart].overruns;
+            return 0;
+        case uart_ioctl_set_baudrate:
+            return uart_set_baudrate(uart, *value);
+        case uart_ioctl_get_baudrate:
+            *value = uart_baudrates[uart].rate;
+            return 0;
+        case uart_ioctl_get_baudrate_error:
+            *(int32_t *) value = uart_baudrates[uart].error_ppm;
+            return 0;
+        case uart_ioctl_get_stats:
+            return uart_get_stats(uart, (uart_stats_t *) arg);
+        case uart_ioctl_reset_stats:
+            return uart_reset_stats(uart);
+        case BSP_IOCTL_WAIT_READ:
+        case BSP_IOCTL_WAIT_WRITE:
+            return uart_wait(uart, request, *value);
+        default:
+            errno = ENOTTY; //Petición desconocida
+            return -1;
+    }
+}
+
+/*****************************************************************************/
+
+/**
+ * Descarta la trama en curso y prepara la recepción de la siguiente
+ * @param frame	Estado de la recepción por tramas
+ */
+static void uart_frame_reset (uart_frame_t *frame)
+{
+	frame->len = 0;
+	frame->crc = CRC16_INIT;
+	frame->escape = 0;
+	frame->remaining = 0;
+	frame->zero = 0;
+	frame->status = uart_frame_ok;
+}
+
+/*****************************************************************************/
+
+/**
+ * Trabajo diferido que ejecuta la callback de recepción o de transmisión
+ * @param ctx	No se usa
+ * @param arg	Identificador de la uart y UART_DEFER_RX o UART_DEFER_TX
+ */
+static void uart_callback_work (void *ctx, uint32_t arg)
+{
+	uart_id_t uart = arg & UART_DEFER_UART;
+	volatile uart_callbacks_t *callbacks = &uart_callbacks[uart];
+	uart_callback_t func;
+	void *func_ctx;
+
+	/* Se desmarca antes de llamarla para no perder los avisos posteriores */
+	if (arg & UART_DEFER_TX)
+	{
+		callbacks->tx_pending = 0;
+		func = callbacks->tx_callback;
+		func_ctx = callbacks->tx_ctx;
+	}
+	else
+	{
+		callbacks->rx_pending = 0;
+		func = callbacks->rx_callback;
+		func_ctx = callbacks->rx_ctx;
+	}
+
+	if (func)
+		func (uart, func_ctx);
+}
+
+/*****************************************************************************/
+
+/**
+ * Difiere la callback de recepción o de transmisión desde la isr. Si ya hay un
+ * aviso pendiente no se encola otro, ya que la callback consulta el estado
+ * de los búferes al ejecutarse
+ * @param uart	Identificador de la uart
+ * @param event	UART_DEFER_RX o UART_DEFER_TX
+ */
+static void uart_defer_callback (uart_id_t uart, uint32_t event)
+{
+	volatile uint8_t *pending = (event == UART_DEFER_TX) ?
+			&uart_callbacks[uart].tx_pending : &uart_callbacks[uart].rx_pending;
+
+	if (*pending)
+		return;
+	*pending = 1;
+
+	/* Si la cola está llena la callback se ejecuta en la propia isr */
+	if (bsp_defer (uart_callback_work, NULL, uart | event) < 0)
+		uart_callback_work (NULL, uart | event);
+}
+
+/*****************************************************************************/
+
+/**
+ * Trabajo diferido que notifica una trama completa
+ * @param ctx	No se usa
+ * @param arg	Identificador de la uart (bits 0-3), resultado (bits 4-7) y
+ * 				longitud de la trama (bits 8-31)
+ */
+static void uart_frame_work (void *ctx, uint32_t arg)
+{
+	uart_id_t uart = arg & 0xF;
+	uart_frame_callback_t func = uart_frames[uart].callback;
+
+	if (func)
+		func (uart, arg >> 8, (arg >> 4) & 0xF, uart_frames[uart].ctx);
+}
+
+/*****************************************************************************/
+
+/**
+ * Trabajo diferido que notifica el final de una transmisión asíncrona
+ * @param ctx	Descriptor transmitido
+ * @param arg	Identificador de la uart
+ */
+static void uart_tx_done_work (void *ctx, uint32_t arg)
+{
+	uart_tx_desc_t *desc = ctx;
+
+	desc->done (arg, desc);
+}
+
+/*****************************************************************************/
+
+/**
+ * Almacena un byte decodificado de la trama en curso
+ * @param uart	Identificador de la uart
+ * @param byte	Byte decodificado
+ */
+static inline void uart_frame_store (uart_id_t uart, uint8_t byte)
+{
+	uart_frame_t *frame = &uart_frames[uart];
+
+	if (frame->status != uart_frame_ok)
+		return;
+
+	if (spsc_buffer_stage (&uart_rx_buffers[uart], frame->len, byte))
+	{
+		frame->crc = crc16_update (frame->crc, byte);
+		frame->len++;
+	}
+	else
+		frame->status = uart_frame_overflow;
+}
+
+/*****************************************************************************/
+
+/**
+ * Termina la trama en curso: comprueba el CRC, la publica si es correcta y la
+ * notifica a la aplicación
+ * @param uart	Identificador de la uart
+ */
+static void uart_frame_end (uart_id_t uart)
+{
+	uart_frame_t *frame = &uart_frames[uart];
+	uint32_t len = frame->len;
+	uart_frame_status_t status = frame->status;
+
+	/* Los delimitadores consecutivos no forman tramas */
+	if (len == 0 && status == uart_frame_ok)
+		return;
+
+	/* Al calcular el CRC sobre los datos y su propio CRC el resultado es cero */
+	if (status == uart_frame_ok && (len < 2 || frame->crc != 0))
+		status = uart_frame_crc_error;
+
+	/* Publicamos la trama sin el CRC */
+	if (status == uart_frame_ok)
+	{
+		len -= 2;
+		spsc_buffer_commit_write (&uart_rx_buffers[uart], len);
+	}
+
+	if (status == uart_frame_overflow)
+		uart_stats[uart].rx_ring_full++;
+	else if (status != uart_frame_ok)
+		uart_stats[uart].frame_errors++;
+
+	uart_frame_reset (frame);
+
+	bsp_event_post (bsp_event_uart_frame, uart, (status << 24) | len, bsp_event_normal);
+
+	/* Cada trama se notifica por separado. Si la cola está llena la callback
+	   se ejecuta en la propia isr */
+	if (frame->callback)
+	{
+		uint32_t arg = (len << 8) | (status << 4) | uart;
+
+		if (bsp_defer (uart_frame_work, NULL, arg) < 0)
+			uart_frame_work (NULL, arg);
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Decodifica un byte recibido en modo de tramas
+ * @param uart	Identificador de la uart
+ * @param byte	Byte recibido
+ */
+static inline void uart_frame_rx_byte (uart_id_t uart, uint8_t byte)
+{
+	uart_frame_t *frame = &uart_frames[uart];
+
+	if (frame->mode == uart_framing_slip)
+	{
+		if (byte == SLIP_END)
+			uart_frame_end (uart);
+		else if (frame->escape)
+		{
+			frame->escape = 0;
+			if (byte == SLIP_ESC_END)
+				uart_frame_store (uart, SLIP_END);
+			else if (byte == SLIP_ESC_ESC)
+				uart_frame_store (uart, SLIP_ESC);
+			else if (frame->status == uart_frame_ok)
+				frame->status = uart_frame_format_error;
+		}
+		else if (byte == SLIP_ESC)
+			frame->escape = 1;
+		else
+			uart_frame_store (uart, byte);
+	}
+	else
+	{
+		if (byte == 0)
+		{
+			/* El delimitador sólo puede llegar al terminar un bloque */
+			if (frame->remaining && frame->status == uart_frame_ok)
+				frame->status = uart_frame_format_error;
+			uart_frame_end (uart);
+		}
+		else if (frame->remaining == 0)
+		{
+			/* Nuevo bloque. El cero implícito del último bloque no se almacena */
+			if (frame->zero)
+				uart_frame_store (uart, 0);
+			frame->remaining = byte - 1;
+			frame->zero = (byte != 0xFF);
+		}
+		else
+		{
+			uart_frame_store (uart, byte);
+			frame->remaining--;
+		}
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Acumula en los contadores de rendimiento los bytes transferidos entre un
+ * FIFO y su búfer en una interrupción
+ * @param bytes		Contador de bytes
+ * @param count		Contador de interrupciones con transferencia
+ * @param max		Máximo transferido en una interrupción
+ * @param total		Bytes transferidos en esta interrupción
+ */
+static inline void uart_isr_count_drain (uint32_t *bytes, uint32_t *count, uint32_t *max, uint32_t total)
+{
+	if (total == 0)
+		return;
+
+	*bytes += total;
+	(*count)++;
+	if (total > *max)
+		*max = total;
+}
+
+/*****************************************************************************/
+
+/**
+ * Llena el FIFO de transmisión en el orden de las llamadas: los bytes del
+ * buffer circular anteriores al primer descriptor asíncrono, el descriptor, y
+ * así sucesivamente. La llaman la isr y uart_send_byte, con la transmisión
+ * enmascarada en el caso de uart_send_byte
+ * @param uart	Identificador de la uart
+ * @return		Bytes escritos en el FIFO
+ */
+static uint32_t uart_tx_fill (uart_id_t uart)
+{
+    spsc_buffer_t *cb = &uart_tx_buffers[uart];
+    uart_tx_desc_t *desc;
+    uint8_t *span;
+    uint32_t fifo, len, i, total = 0;
+    
+    while((fifo = uart_regs[uart]->Tx_fifo_addr_diff) > 0){
+        desc = uart_tx_queues[uart].head;
+        
+        //Tramo ocupado del buffer circular, sin pasar del primer descriptor
+        len = spsc_buffer_peek_read(cb, &span);
+        if(desc && len > desc->ring_pos - spsc_buffer_read_pos(cb))
+            len = desc->ring_pos - spsc_buffer_read_pos(cb);
+        if(len > 0){
+            if(len > fifo)
+                len = fifo;
+            for(i = 0; i < len; i++)
+                uart_regs[uart]->Tx_data = span[i];
+            spsc_buffer_commit_read(cb, len);
+            total += len;
+            continue;
+        }
+        if(desc == NULL)
+            break;
+        
+        //Le toca al descriptor: se copia directamente desde la memoria de la aplicación
+        len = desc->len - desc->sent;
+        if(len > fifo)
+            len = fifo;
+        for(i = 0; i < len; i++)
+            uart_regs[uart]->Tx_data = desc->buf[desc->sent + i];
+        desc->sent += len;
+        total += len;
+        
+        if(desc->sent == desc->len){
+            //uart_send_byte también llega aquí, así que se protege frente a uart_send_async
+            itc_critical_t critical = itc_critical_enter(ITC_SRC_MASK(itc_src_uart1 + uart));
+            uart_tx_queues[uart].head = desc->next;
+            if(uart_tx_queues[uart].head == NULL)
+                uart_tx_queues[uart].tail = NULL;
+            itc_critical_exit(critical);
+            if(desc->done && bsp_defer(uart_tx_done_work, desc, uart) < 0)
+                desc->done(uart, desc);
+        }
+    }
+    
+    return total;
+}
+
+/*****************************************************************************/
+
+/**
+ * Manejador de interrupciones para las uart.
+ * El ITC lo llama con la fuente que ha interrumpido, de la que se deduce la uart
+ * @param src	Fuente de interrupción (itc_src_uart1 o itc_src_uart2)
+ * @param ctx	No se usa
+ */
+static void uart_isr (itc_src_t src, void *ctx)
+{
+    uart_id_t uart = src - itc_src_uart1;
+    uint32_t status = uart_regs[uart]->ustat;
+    uart_stats_t *stats = &uart_stats[uart];
+    uint8_t *span;
+    uint32_t fifo, len, i, total;
+    uint32_t signals = 0;
+    
+    stats->isr_count++;
+    
+    //Los bits de error se borran al leer ustat, así que se usa la copia
+    if(status & UART_USTAT_ERRORS){
+        if(status & UART_USTAT_ROE)
+            stats->overruns++;
+        if(status & UART_USTAT_TOE)
+            stats->tx_overruns++;
+        if(status & UART_USTAT_FE)
+            stats->framing_errors++;
+        if(status & UART_USTAT_PE)
+            stats->parity_errors++;
+    }
+    
+    //Gestión de interrupciones de recepción, salvo que estén enmascaradas
+    if((status & UART_USTAT_RXRDY) && !uart_regs[uart]->MRxR && uart_frames[uart].mode != uart_framing_none){
+        //En modo de tramas se decodifica todo el FIFO. Si una trama no cabe se descarta
+        for(total = 0; uart_regs[uart]->Rx_fifo_addr_diff > 0; total++)
+            uart_frame_rx_byte(uart, uart_regs[uart]->Rx_data);
+        
+        uart_isr_count_drain(&stats->rx_bytes, &stats->rx_drains, &stats->rx_drain_max, total);
+    }
+    else if((status & UART_USTAT_RXRDY) && !uart_regs[uart]->MRxR){
+        //Volcamos el FIFO directamente sobre los tramos libres del buffer circular
+        total = 0;
+        while((fifo = uart_regs[uart]->Rx_fifo_addr_diff) > 0 &&
+              (len = spsc_buffer_peek_write(&uart_rx_buffers[uart], &span)) > 0){
+            if(len > fifo)
+                len = fifo;
+            for(i = 0; i < len; i++)
+                span[i] = uart_regs[uart]->Rx_data;
+            spsc_buffer_commit_write(&uart_rx_buffers[uart], len);
+            total += len;
+        }
+        
+        uart_isr_count_drain(&stats->rx_bytes, &stats->rx_drains, &stats->rx_drain_max, total);
+        len = spsc_buffer_count(&uart_rx_buffers[uart]);
+        if(len > stats->rx_high_water)
+            stats->rx_high_water = len;
+        
+        if(total > 0)
+            bsp_event_notify(bsp_event_uart_rx, uart, bsp_event_normal);
+        if(uart_callbacks[uart].rx_callback) 
+            uart_defer_callback(uart, UART_DEFER_RX);
+        
+        //Si el buffer se llena dejamos de vaciar el FIFO. Con control de flujo,
+        //al alcanzar el nivel de CTS la uart detiene al emisor
+        if(spsc_buffer_is_full(&uart_rx_buffers[uart])){
+            uart_regs[uart]->MRxR = 1;
+            stats->rx_ring_full++;
+        }
+    }
+
+    //Gestión de interrupciones de transmisión, salvo que estén enmascaradas
+    if((status & UART_USTAT_TXRDY) && !uart_regs[uart]->MTxR){
+        //Volcamos el buffer circular y los descriptores asíncronos sobre el FIFO
+        total = uart_tx_fill(uart);
+        
+        uart_isr_count_drain(&stats->tx_bytes, &stats->tx_fills, &stats->tx_fill_max, total);
+        
+        if(uart_callbacks[uart].tx_callback) 
+            uart_defer_callback(uart, UART_DEFER_TX);
+        
+        if(spsc_buffer_is_empty(&uart_tx_buffers[uart]) && uart_tx_queues[uart].head == NULL){
+            uart_regs[uart]->MTxR = 1;
+            bsp_event_notify(bsp_event_uart_tx, uart, bsp_event_normal);
+        }
+    }
+    
+    //Despertamos a las tareas bloqueadas en uart_wait y a las corrutinas que
+    //esperan a la uart. El cambio de tarea se hace al salir de la interrupción
+    if(!spsc_buffer_is_empty(&uart_rx_buffers[uart])){
+        bsp_sem_post(&uart_rx_sems[uart]);
+        signals |= BSP_PT_SIGNAL_UART_RX(uart);
+    }
+    if(!spsc_buffer_is_full(&uart_tx_buffers[uart])){
+        bsp_sem_post(&uart_tx_sems[uart]);
+        signals |= BSP_PT_SIGNAL_UART_TX(uart);
+    }
+    if(signals)
+        bsp_pt_signal(signals);
+    
+    //Si la recepción va por FIQ, el manejador rápido nos había cedido la fuente
+    //forzando la IRQ tras copiar bytes, para que se avise arriba a quien los
+    //espera. El forzado se borra siempre, por si uart_set_fiq devolvió la
+    //uart a la IRQ con él pendiente
+    itc_unforce_interrupt(itc_src_uart1 + uart);
+    if(uart_fiq_ctx.regs == uart_regs[uart])
+        itc_set_priority(itc_src_uart1 + uart, itc_priority_fast);
+    
 }
 
 /*****************************************************************************/
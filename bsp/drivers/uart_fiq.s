@@ -0,0 +1,114 @@
+@
+@ Sistemas Empotrados
+@ Manejador FIQ para la recepción de las uart
+@
+@ Vacía el FIFO de recepción de la uart asociada (ver uart_set_fiq) en su
+@ búfer circular usando sólo los registros r8-r13 del modo FIQ, sin apilar
+@ nada. sp_fiq hace de contador y se restaura a _fiq_stack_top al salir, ya
+@ que el manejador en C de las demás FIQ (excep_fiq_handler) sí usa la pila y
+@ las FIQ no se anidan. Si ha copiado bytes o queda trabajo que requiere el
+@ driver en C (búfer lleno o transmisión activa) convierte la fuente en IRQ, y
+@ uart_isr despierta a las tareas y corrutinas que esperan datos y la devuelve
+@ a FIQ al terminar. La línea de la uart es por nivel y con el FIFO vacío ya
+@ no está activa, así que además se fuerza la IRQ en INTFRC, que uart_isr
+@ borra
+@
+
+	@ Registros de la uart
+	.set _UCON, 0x00
+	.set _UDATA, 0x08
+	.set _URXCON, 0x0C
+	.set _UCON_MTXR, (1 << 13)
+	.set _FIFO_DIFF, 0x3F
+
+	@ Registros INTTYPE e INTFRC del ITC
+	.set _ITC_INTTYPE, 0x80020014
+	.set _ITC_INTFRC, 0x80020034
+
+	@ Campos de uart_fiq_ctx (ver uart.c)
+	.set _CTX_REGS, 0
+	.set _CTX_CB, 4
+	.set _CTX_RX_BYTES, 8
+	.set _CTX_SRC_MASK, 12
+
+	@ Campos de spsc_buffer_t
+	.set _CB_DATA, 0
+	.set _CB_MASK, 4
+	.set _CB_HEAD, 8
+	.set _CB_TAIL, 12
+
+	.code 32
+	.text
+
+	.align	4
+	.global	uart_fiq_rx_handler
+	.type	uart_fiq_rx_handler, %function
+uart_fiq_rx_handler:
+	ldr	r8, =uart_fiq_ctx
+	ldr	r9, [r8, #_CTX_CB]
+	ldr	r8, [r8, #_CTX_REGS]		@ r8 <- registros de la uart
+	ldr	r10, [r9, #_CB_DATA]		@ r10 <- datos del búfer
+	ldr	r11, [r9, #_CB_MASK]		@ r11 <- máscara del búfer
+	ldr	r12, [r9, #_CB_HEAD]
+	ldr	r13, [r9, #_CB_TAIL]
+
+	@ Bytes a copiar: el mínimo entre el FIFO y el hueco libre menos uno.
+	@ Dejar siempre un hueco permite calcular al final cuánto se ha copiado a
+	@ partir de los índices
+	add	r13, r13, r11
+	sub	r13, r13, r12			@ r13 <- libre - 1 (negativo si lleno)
+	ldr	r9, [r8, #_URXCON]
+	and	r9, r9, #_FIFO_DIFF		@ r9 <- bytes en el FIFO
+	cmp	r13, r9
+	movgt	r13, r9
+	and	r12, r12, r11			@ r12 <- índice de escritura
+	cmp	r13, #0
+	ble	2f
+
+1:	ldr	r9, [r8, #_UDATA]
+	strb	r9, [r10, r12]
+	add	r12, r12, #1
+	and	r12, r12, r11
+	subs	r13, r13, #1
+	bne	1b
+
+	@ Publicamos los datos después de escribirlos: head += copiados
+	ldr	r9, =uart_fiq_ctx
+	ldr	r9, [r9, #_CTX_CB]
+	ldr	r10, [r9, #_CB_HEAD]
+	sub	r13, r12, r10
+	and	r13, r13, r11			@ r13 <- bytes copiados
+	add	r10, r10, r13
+	str	r10, [r9, #_CB_HEAD]
+
+	@ Contador de bytes recibidos del driver
+	ldr	r9, =uart_fiq_ctx
+	ldr	r9, [r9, #_CTX_RX_BYTES]
+	ldr	r10, [r9]
+	add	r10, r10, r13
+	str	r10, [r9]
+	b	3f				@ uart_isr avisa de los datos nuevos
+
+	@ ¿Queda trabajo para el manejador normal?
+2:	ldr	r9, [r8, #_URXCON]
+	ands	r9, r9, #_FIFO_DIFF
+	bne	3f				@ Búfer lleno con datos en el FIFO
+	ldr	r9, [r8, #_UCON]
+	tst	r9, #_UCON_MTXR
+	bne	4f				@ Transmisión inactiva
+
+	@ Convertimos la fuente en IRQ para que la atienda uart_isr
+3:	ldr	r9, =_ITC_INTTYPE
+	ldr	r10, [r9]
+	ldr	r11, =uart_fiq_ctx
+	ldr	r11, [r11, #_CTX_SRC_MASK]
+	bic	r10, r10, r11
+	str	r10, [r9]
+	ldr	r9, =_ITC_INTFRC		@ Con el FIFO vacío la línea no pide la IRQ
+	ldr	r10, [r9]
+	orr	r10, r10, r11
+	str	r10, [r9]
+
+4:	ldr	sp, =_fiq_stack_top		@ Pila vacía, como al entrar
+	subs	pc, lr, #4			@ Retorno restaurando cpsr <- spsr
+	.size	uart_fiq_rx_handler, .-uart_fiq_rx_handler
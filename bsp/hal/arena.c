@@ -0,0 +1,63 @@
+/*
+ * Sistemas operativos empotrados
+ * Arena estática del BSP
+ */
+
+#include <errno.h>
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Límites de la arena, definidos en el script de enlazado
+ */
+extern uint8_t _bsp_arena_start[], _bsp_arena_end[];
+
+/*****************************************************************************/
+
+/**
+ * Siguiente posición libre de la arena
+ */
+static uint8_t *bsp_arena_next = _bsp_arena_start;
+
+/*****************************************************************************/
+
+/**
+ * Reserva memoria de la arena estática del BSP.
+ * La arena se define en el script de enlazado y se usa para los búferes de los
+ * drivers, cuyo tamaño se decide al inicializarlos. La memoria reservada no se
+ * libera nunca.
+ * @param size	Tamaño en bytes. Se redondea a un múltiplo del tamaño de palabra
+ * @return		Puntero a la memoria reservada o NULL en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+void * bsp_arena_alloc (uint32_t size)
+{
+	void *block = bsp_arena_next;
+
+	/* Forzamos a que el tamaño sea un múltiplo del tamaño de la palabra */
+	size = (size + 3) & ~3;
+
+	/* Comprobamos que queda memoria suficiente en la arena */
+	if (size > bsp_arena_free ())
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	bsp_arena_next += size;
+
+	return block;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de bytes que quedan libres en la arena
+ */
+uint32_t bsp_arena_free (void)
+{
+	return _bsp_arena_end - bsp_arena_next;
+}
+
+/*****************************************************************************/
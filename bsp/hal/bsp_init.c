@@ -30,8 +30,15 @@ static void bsp_excep_init( void )
 static void bsp_sys_init( void )
 {
 	/* Inicialización de las UARTs */
-	uart_init(UART1_ID, UART1_BAUDRATE, UART1_NAME);
-	uart_init(UART2_ID, UART2_BAUDRATE, UART2_NAME);
+	uart_init_ex(UART1_ID, UART1_BAUDRATE, UART1_NAME, UART1_RX_BUFFER_SIZE, UART1_TX_BUFFER_SIZE);
+	uart_init_ex(UART2_ID, UART2_BAUDRATE, UART2_NAME, UART2_RX_BUFFER_SIZE, UART2_TX_BUFFER_SIZE);
+
+	/* Inicialización de los temporizadores */
+	tmr_init ();
+	bsp_timer_init ();
+
+	/* El gestor de bajo consumo duerme en bsp_idle hasta el siguiente vencimiento */
+	bsp_power_init ();
 }
 
 /*****************************************************************************/
@@ -0,0 +1,280 @@
+/*
+ * Sistemas operativos empotrados
+ * Registro de fallos
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <errno.h>
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Límites de la RAM, definidos en el script de enlazado
+ */
+extern uint8_t _ram_base[], _ram_limit[];
+
+/*****************************************************************************/
+
+/**
+ * Registro del último fallo. Se ubica en una sección sin inicializar del script
+ * de enlazado, que el reinicio en caliente no borra
+ */
+bsp_crash_t bsp_crash_record __attribute__ ((section (".crash")));
+
+/*****************************************************************************/
+
+/**
+ * Bits del cpsr
+ */
+#define BSP_CRASH_MODE_MASK		0x1F
+#define BSP_CRASH_THUMB			(1 << 5)
+
+#define BSP_CRASH_USR_MODE		0x10
+#define BSP_CRASH_FIQ_MODE		0x11
+#define BSP_CRASH_IRQ_MODE		0x12
+#define BSP_CRASH_SVC_MODE		0x13
+#define BSP_CRASH_ABT_MODE		0x17
+#define BSP_CRASH_UND_MODE		0x1B
+#define BSP_CRASH_SYS_MODE		0x1F
+
+/*****************************************************************************/
+
+/**
+ * Nombres de las excepciones de fallo para el informe
+ */
+static const char * const bsp_crash_names[excep_max] =
+{
+	[excep_undef] = "undef",
+	[excep_pabt] = "pabt",
+	[excep_dabt] = "dabt"
+};
+
+/*****************************************************************************/
+
+/**
+ * Comprueba si un bloque está dentro de la RAM, para no provocar otro fallo al
+ * leerlo
+ * @param addr	Dirección del bloque
+ * @param size	Tamaño del bloque
+ * @return		1 si el bloque está en la RAM, 0 en otro caso
+ */
+static inline uint32_t bsp_crash_in_ram (uint32_t addr, uint32_t size)
+{
+	return addr >= (uint32_t) _ram_base && addr <= (uint32_t) _ram_limit - size;
+}
+
+/*****************************************************************************/
+
+/**
+ * Calcula la suma de comprobación de un registro de fallos
+ * @param crash	Registro de fallos
+ * @return		Suma de todas las palabras anteriores al campo checksum
+ */
+static uint32_t bsp_crash_checksum (const bsp_crash_t *crash)
+{
+	const uint32_t *word = (const uint32_t *) crash;
+	uint32_t i, sum = 0;
+
+	for (i = 0; i < offsetof (bsp_crash_t, checksum) / sizeof (uint32_t); i++)
+		sum += word[i];
+
+	return ~sum;
+}
+
+/*****************************************************************************/
+
+/**
+ * Comprueba si hay un registro de fallos válido
+ * @return	1 si el registro es válido, 0 en otro caso
+ */
+static uint32_t bsp_crash_valid (void)
+{
+	return (bsp_crash_record.magic == BSP_CRASH_MAGIC ||
+			bsp_crash_record.magic == BSP_CRASH_REPORTED) &&
+			bsp_crash_record.checksum == bsp_crash_checksum (&bsp_crash_record);
+}
+
+/*****************************************************************************/
+
+/**
+ * Completa el registro de fallos tras guardar los registros.
+ * La llaman los manejadores de fallo, con las interrupciones deshabilitadas y
+ * usando una pila propia
+ * @param crash	Registro de fallos
+ */
+void bsp_crash_save (bsp_crash_t *crash)
+{
+	uint32_t i, count;
+
+	/* El lr apunta detrás de la instrucción que falló */
+	if (crash->excep == excep_dabt)
+		crash->pc -= 8;
+	else if (crash->excep == excep_undef && (crash->cpsr & BSP_CRASH_THUMB))
+		crash->pc -= 2;
+	else
+		crash->pc -= 4;
+
+	/* sp y lr del contexto interrumpido. Los manejadores usan los sp de los
+	   modos ABT y UND, así que un fallo dentro de ellos no tiene pila */
+	switch (crash->cpsr & BSP_CRASH_MODE_MASK)
+	{
+	case BSP_CRASH_USR_MODE:
+	case BSP_CRASH_SYS_MODE:
+		crash->sp = crash->usr_sp;
+		crash->lr = crash->usr_lr;
+		break;
+	case BSP_CRASH_SVC_MODE:
+		crash->sp = crash->svc_sp;
+		crash->lr = crash->svc_lr;
+		break;
+	case BSP_CRASH_IRQ_MODE:
+		crash->sp = crash->irq_sp;
+		crash->lr = crash->irq_lr;
+		break;
+	case BSP_CRASH_FIQ_MODE:
+		for (i = 0; i < 5; i++)
+			crash->r[8 + i] = crash->fiq_r[i];
+		crash->sp = crash->fiq_sp;
+		crash->lr = crash->fiq_lr;
+		break;
+	case BSP_CRASH_ABT_MODE:
+		crash->sp = 0;
+		crash->lr = crash->abt_lr;
+		break;
+	default:
+		crash->sp = 0;
+		crash->lr = crash->und_lr;
+		break;
+	}
+
+	/* Instrucción que falló, si se puede leer (un prefetch abort indica que no) */
+	crash->insn = 0;
+	if (crash->excep != excep_pabt)
+	{
+		if (crash->cpsr & BSP_CRASH_THUMB)
+		{
+			if (bsp_crash_in_ram (crash->pc & ~1, 2))
+				crash->insn = *(volatile uint16_t *) (crash->pc & ~1);
+		}
+		else if (bsp_crash_in_ram (crash->pc & ~3, 4))
+			crash->insn = *(volatile uint32_t *) (crash->pc & ~3);
+	}
+
+	/* Ventana de la pila, hasta el final de la RAM */
+	for (i = 0; i < BSP_CRASH_STACK_WORDS; i++)
+	{
+		uint32_t addr = (crash->sp & ~3) + i * sizeof (uint32_t);
+
+		crash->stack[i] = (crash->sp && bsp_crash_in_ram (addr, 4)) ?
+				*(volatile uint32_t *) addr : 0;
+	}
+
+	/* Contamos los fallos seguidos mientras no haya un arranque en frío. Los
+	   manejadores no tocan la marca, pero sí los campos de la suma */
+	count = (crash->magic == BSP_CRASH_MAGIC || crash->magic == BSP_CRASH_REPORTED) ?
+			crash->count + 1 : 1;
+	crash->count = count;
+
+	crash->magic = BSP_CRASH_MAGIC;
+	crash->checksum = bsp_crash_checksum (crash);
+}
+
+/*****************************************************************************/
+
+/**
+ * Copia el registro del último fallo, si lo hay
+ * @param crash	Destino del registro
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOENT si no hay un
+ * 			registro válido).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_crash_get (bsp_crash_t *crash)
+{
+	if (crash == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!bsp_crash_valid ())
+	{
+		errno = ENOENT;
+		return -1;
+	}
+
+	*crash = bsp_crash_record;
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe una serie de registros del informe de fallos
+ * @param label	Etiqueta de la línea
+ * @param names	Nombres de los registros, separados por espacios
+ * @param regs	Valores de los registros
+ * @param count	Número de registros
+ */
+static void bsp_crash_print (const char *label, const char *names, const uint32_t *regs, uint32_t count)
+{
+	uint32_t i;
+
+	printf ("crash: %s", label);
+	for (i = 0; i < count; i++)
+	{
+		printf (" ");
+		while (*names && *names != ' ')
+			putchar (*names++);
+		if (*names)
+			names++;
+		printf ("=0x%08lx", (unsigned long) regs[i]);
+	}
+	printf ("\n");
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe en la salida estándar el registro del último fallo, si no se ha
+ * informado ya, y lo marca como informado. El código de arranque la llama antes
+ * de main. La salida se puede decodificar en el host con tools/bin/crash-decode
+ */
+void bsp_crash_report (void)
+{
+	bsp_crash_t *crash = &bsp_crash_record;
+	uint32_t i;
+
+	if (!bsp_crash_valid () || crash->magic != BSP_CRASH_MAGIC)
+		return;
+
+	printf ("crash: %s pc=0x%08lx lr=0x%08lx sp=0x%08lx cpsr=0x%08lx insn=0x%08lx count=%lu\n",
+			(crash->excep < excep_max && bsp_crash_names[crash->excep]) ?
+					bsp_crash_names[crash->excep] : "?",
+			(unsigned long) crash->pc, (unsigned long) crash->lr,
+			(unsigned long) crash->sp, (unsigned long) crash->cpsr,
+			(unsigned long) crash->insn, (unsigned long) crash->count);
+	bsp_crash_print ("regs", "r0 r1 r2 r3 r4 r5 r6", crash->r, 7);
+	bsp_crash_print ("regs", "r7 r8 r9 r10 r11 r12", crash->r + 7, 6);
+	bsp_crash_print ("usr", "sp lr", &crash->usr_sp, 2);
+	bsp_crash_print ("svc", "sp lr spsr", &crash->svc_sp, 3);
+	bsp_crash_print ("abt", "sp lr spsr", &crash->abt_sp, 3);
+	bsp_crash_print ("und", "sp lr spsr", &crash->und_sp, 3);
+	bsp_crash_print ("irq", "sp lr spsr", &crash->irq_sp, 3);
+	bsp_crash_print ("fiq", "r8 r9 r10 r11 r12 sp lr spsr", crash->fiq_r, 8);
+
+	for (i = 0; i < BSP_CRASH_STACK_WORDS; i += 4)
+		printf ("crash: stack %08lx: %08lx %08lx %08lx %08lx\n",
+				(unsigned long) (crash->sp + i * sizeof (uint32_t)),
+				(unsigned long) crash->stack[i], (unsigned long) crash->stack[i + 1],
+				(unsigned long) crash->stack[i + 2], (unsigned long) crash->stack[i + 3]);
+
+	fflush (stdout);
+
+	/* Se mantiene el registro (y la cuenta de fallos) para bsp_crash_get */
+	crash->magic = BSP_CRASH_REPORTED;
+	crash->checksum = bsp_crash_checksum (crash);
+}
+
+/*****************************************************************************/
@@ -0,0 +1,132 @@
+@
+@ Sistemas Empotrados
+@ Manejadores de las excepciones de fallo
+@
+@ Las pilas de los modos ABT y UND sólo tienen 16 bytes, así que los manejadores
+@ usan sp como puntero al registro de fallos (bsp_crash_record) para guardar
+@ primero los registros del contexto interrumpido y después los de cada modo.
+@ Para completar el registro llaman a bsp_crash_save con la pila de fallos
+@ definida en el script de enlazado y terminan con un reinicio en caliente
+@
+
+	.set _IRQ_DISABLE, 0x80 @ cuando el bit I está activo, IRQ está deshabilitado
+	.set _FIQ_DISABLE, 0x40 @ cuando el bit F está activo, FIQ está deshabilitado
+	.set _MODE_MASK, 0x1F
+
+	.set _FIQ_MODE, 0x11
+	.set _IRQ_MODE, 0x12
+	.set _SVC_MODE, 0x13
+	.set _ABT_MODE, 0x17
+	.set _UND_MODE, 0x1B
+	.set _SYS_MODE, 0x1F
+
+	@ Tipos de excepción (ver excep_t)
+	.set _EXCEP_UNDEF, 1
+	.set _EXCEP_PABT, 3
+	.set _EXCEP_DABT, 4
+
+	@ Campos de bsp_crash_t (ver crash.h)
+	.set _CRASH_EXCEP, 0x04
+	.set _CRASH_R0, 0x08
+	.set _CRASH_PC, 0x3C
+	.set _CRASH_CPSR, 0x40
+	.set _CRASH_BANKED, 0x44
+
+	.code 32
+	.text
+
+@
+@ Entrada común: guarda r0-r12, el lr y el spsr del modo de la excepción.
+@ El lr se corrige en bsp_crash_save según el tipo de excepción
+@
+	.macro CRASH_ENTRY excep
+	ldr	sp, =bsp_crash_record + _CRASH_R0
+	stmia	sp, {r0-r12}
+	ldr	r0, =bsp_crash_record
+	mov	r1, #\excep
+	str	r1, [r0, #_CRASH_EXCEP]
+	str	lr, [r0, #_CRASH_PC]
+	mrs	r1, spsr
+	str	r1, [r0, #_CRASH_CPSR]
+	b	bsp_crash_common
+	.endm
+
+@
+@ Guarda sp, lr y spsr de un modo en la dirección r0, que se incrementa.
+@ r7 contiene el cpsr con el campo de modo a 0 y las interrupciones deshabilitadas
+@
+	.macro CRASH_BANKED mode
+	orr	r1, r7, #\mode
+	msr	cpsr_c, r1
+	mov	r2, sp
+	mov	r3, lr
+	mrs	r4, spsr
+	stmia	r0!, {r2-r4}
+	.endm
+
+	.align	4
+	.global	bsp_crash_undef_handler
+	.type	bsp_crash_undef_handler, %function
+bsp_crash_undef_handler:
+	CRASH_ENTRY _EXCEP_UNDEF
+	.size	bsp_crash_undef_handler, .-bsp_crash_undef_handler
+
+	.align	4
+	.global	bsp_crash_pabt_handler
+	.type	bsp_crash_pabt_handler, %function
+bsp_crash_pabt_handler:
+	CRASH_ENTRY _EXCEP_PABT
+	.size	bsp_crash_pabt_handler, .-bsp_crash_pabt_handler
+
+	.align	4
+	.global	bsp_crash_dabt_handler
+	.type	bsp_crash_dabt_handler, %function
+bsp_crash_dabt_handler:
+	CRASH_ENTRY _EXCEP_DABT
+	.size	bsp_crash_dabt_handler, .-bsp_crash_dabt_handler
+
+@
+@ Recorre los modos guardando sus registros en el orden de bsp_crash_t
+@
+	.align	4
+	.type	bsp_crash_common, %function
+bsp_crash_common:
+	mrs	r6, cpsr
+	orr	r6, r6, #(_IRQ_DISABLE | _FIQ_DISABLE)
+	msr	cpsr_c, r6			@ r6 <- modo del fallo, sin interrupciones
+	bic	r7, r6, #_MODE_MASK
+	add	r0, r0, #_CRASH_BANKED
+
+	@ Los modos USR y SYS comparten sp y lr, y no tienen spsr
+	orr	r1, r7, #_SYS_MODE
+	msr	cpsr_c, r1
+	mov	r2, sp
+	mov	r3, lr
+	stmia	r0!, {r2-r3}
+
+	CRASH_BANKED _SVC_MODE
+	CRASH_BANKED _ABT_MODE
+	CRASH_BANKED _UND_MODE
+	CRASH_BANKED _IRQ_MODE
+
+	@ El modo FIQ también tiene sus propios r8-r12
+	orr	r1, r7, #_FIQ_MODE
+	msr	cpsr_c, r1
+	stmia	r0!, {r8-r12}
+	mov	r2, sp
+	mov	r3, lr
+	mrs	r4, spsr
+	stmia	r0!, {r2-r4}
+
+	@ Completamos el registro en C con la pila de fallos
+	msr	cpsr_c, r6
+	ldr	sp, =_crash_stack_top
+	ldr	r0, =bsp_crash_record
+	ldr	r1, =bsp_crash_save
+	mov	lr, pc
+	bx	r1
+
+	@ Reinicio en caliente
+	ldr	r0, =_warm_start
+	bx	r0
+	.size	bsp_crash_common, .-bsp_crash_common
@@ -85,9 +85,45 @@ _fiq_handler:
 	.type	_start, %function
 _start:
 
+@
+@ Arranque en frío: guardamos una copia de .data para poder restaurarla en un
+@ reinicio en caliente
+@
+	ldr	r0, =_data_start
+	ldr	r1, =_data_end
+	ldr	r2, =_data_shadow
+1:	cmp	r0, r1
+	ldrlo	r3, [r0], #4
+	strlo	r3, [r2], #4
+	blo	1b
+	b	_init_stacks
+
+@
+@ Reinicio en caliente tras un fallo (ver crash_asm.s). La RAM no se ha borrado,
+@ así que restauramos .data y ponemos a cero .bss y COMMON. El registro de
+@ fallos, la arena y el heap quedan como estaban
+@
+	.global	_warm_start
+_warm_start:
+	ldr	r0, =_data_start
+	ldr	r1, =_data_end
+	ldr	r2, =_data_shadow
+2:	cmp	r0, r1
+	ldrlo	r3, [r2], #4
+	strlo	r3, [r0], #4
+	blo	2b
+
+	ldr	r0, =_bss_start
+	ldr	r1, =_common_end
+	mov	r3, #0
+3:	cmp	r0, r1
+	strlo	r3, [r0], #4
+	blo	3b
+
 @
 @ Inicializamos las pilas para cada modo
 @   
+_init_stacks:
 
     @No hace falta inicializar nada porque la ram ya esta toda a 0
 
@@ -130,6 +166,14 @@ _start:
 
     msr     cpsr_c, #_USR_MODE
 
+@
+@ Informe del fallo que provocó el último reinicio en caliente, si lo hay
+@
+
+    ldr ip, =bsp_crash_report
+    mov lr, pc
+    bx  ip
+
 @
 @ Salto a main
 @
@@ -0,0 +1,140 @@
+/*
+ * Sistemas operativos empotrados
+ * Cola de trabajo diferido
+ */
+
+#include <errno.h>
+
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Elemento de trabajo diferido
+ */
+typedef struct
+{
+	bsp_work_t func;	/* Función a ejecutar */
+	void *ctx;			/* Puntero que se pasa a la función */
+	uint32_t arg;		/* Argumento que se pasa a la función */
+} bsp_work_item_t;
+
+/*****************************************************************************/
+
+/**
+ * Reserva de elementos de trabajo, gestionada como un búfer circular.
+ * Los índices crecen libremente y se reducen con la máscara al acceder.
+ * Varias isr pueden encolar, por lo que head se actualiza en sección crítica.
+ * Sólo hay un consumidor (ver bsp_defer_running), que es el único que escribe tail
+ */
+static bsp_work_item_t bsp_defer_pool[BSP_DEFER_POOL_SIZE];
+static volatile uint32_t bsp_defer_head = 0;
+static volatile uint32_t bsp_defer_tail = 0;
+
+/*****************************************************************************/
+
+/**
+ * Indica que bsp_run_deferred está vaciando la cola
+ */
+static volatile uint32_t bsp_defer_running = 0;
+
+/*****************************************************************************/
+
+/**
+ * Encola un trabajo para ejecutarlo fuera de la isr.
+ * Se puede llamar desde cualquier isr (IRQ o FIQ) y desde la aplicación. El
+ * elemento se copia en una reserva fija cuyo tamaño se define en "system.h",
+ * por lo que el coste es acotado y no se reserva memoria
+ * @param func	Función a ejecutar
+ * @param ctx	Puntero que se pasa a la función
+ * @param arg	Argumento que se pasa a la función
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_defer (bsp_work_t func, void *ctx, uint32_t arg)
+{
+	itc_critical_t state;
+	bsp_work_item_t *item;
+
+	if (func == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+
+	if (bsp_defer_head - bsp_defer_tail >= BSP_DEFER_POOL_SIZE)
+	{
+		itc_critical_exit (state);
+		errno = EAGAIN;
+		return -1;
+	}
+
+	item = &bsp_defer_pool[bsp_defer_head & (BSP_DEFER_POOL_SIZE - 1)];
+	item->func = func;
+	item->ctx = ctx;
+	item->arg = arg;
+	bsp_defer_head++;
+
+	itc_critical_exit (state);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta los trabajos diferidos pendientes en orden de llegada.
+ * El manejador de IRQ anidado la llama al volver de la interrupción más externa,
+ * en modo SYS y con las interrupciones habilitadas. Con el manejador no anidado
+ * la debe llamar la aplicación (también se llama desde bsp_idle).
+ * Si ya se está ejecutando no hace nada, así que no es reentrante
+ */
+void bsp_run_deferred (void)
+{
+	itc_critical_t state;
+	bsp_work_item_t item;
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+	if (bsp_defer_running)
+	{
+		itc_critical_exit (state);
+		return;
+	}
+	bsp_defer_running = 1;
+
+	for (;;)
+	{
+		/* Dejamos de consumir en la misma sección crítica en la que vemos la
+		   cola vacía, para no perder trabajos encolados justo al terminar */
+		if (bsp_defer_tail == bsp_defer_head)
+		{
+			bsp_defer_running = 0;
+			itc_critical_exit (state);
+			return;
+		}
+		itc_critical_exit (state);
+
+		/* Copiamos el elemento antes de liberar su hueco */
+		item = bsp_defer_pool[bsp_defer_tail & (BSP_DEFER_POOL_SIZE - 1)];
+		bsp_defer_tail++;
+
+		item.func (item.ctx, item.arg);
+
+		state = itc_critical_enter (ITC_SRC_ALL);
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Número de trabajos pendientes
+ * @return	Trabajos encolados y todavía no ejecutados
+ */
+uint32_t bsp_deferred_pending (void)
+{
+	return bsp_defer_head - bsp_defer_tail;
+}
+
+/*****************************************************************************/
@@ -28,7 +28,8 @@ static bsp_dev_t bsp_dev_list[BSP_MAX_DEV] =
 				NULL,			/* Función write por defecto */
 				NULL,			/* Función lseek por defecto */
 				NULL,			/* Función fstat por defecto */
-				NULL			/* Función isatty por defecto */
+				NULL,			/* Función isatty por defecto */
+				NULL			/* Función ioctl por defecto */
 		}
 		/* El resto del array se inicializa a cero */
 };
@@ -70,6 +71,7 @@ static bsp_fd_t bsp_fd_list[BSP_MAX_FD] =
  * @param lseek		Función lseek del dispositivo
  * @param fstat		Función fsat del dispositivo
  * @param isatty	Función isatty del dispositivo
+ * @param ioctl		Función ioctl del dispositivo
  * @return 			El numero de dispositivo asignado o -1 en caso de error
  */
 int32_t bsp_register_dev (const char  *name,
@@ -80,7 +82,8 @@ int32_t bsp_register_dev (const char  *name,
 		ssize_t (*write)(uint32_t id, char *buf, size_t count),
 		off_t (*lseek)(uint32_t id, off_t offset, int whence),
 		int (*fstat)(uint32_t id, struct stat *buf),
-		int (*isatty)(uint32_t id))
+		int (*isatty)(uint32_t id),
+		int (*ioctl)(uint32_t id, uint32_t request, void *arg))
 {
 	int32_t index = -1;
 	if (bsp_next_dev < BSP_MAX_DEV)
@@ -97,6 +100,9 @@ int32_t bsp_register_dev (const char  *name,
 		bsp_dev_list[index].lseek = lseek;
 		bsp_dev_list[index].fstat = fstat;
 		bsp_dev_list[index].isatty = isatty;
+		bsp_dev_list[index].ioctl = ioctl;
+		bsp_mutex_init (&bsp_dev_list[index].rd_lock);
+		bsp_mutex_init (&bsp_dev_list[index].wr_lock);
 	}
 
 	return index;
@@ -0,0 +1,342 @@
+/*
+ * Sistemas operativos empotrados
+ * Despachador de eventos
+ */
+
+#include <errno.h>
+
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Evento encolado. notify distingue los avisos de bsp_event_notify, que son
+ * los únicos que tienen un bit pendiente que borrar al extraerlos
+ */
+typedef struct
+{
+	bsp_event_t event;
+	uint32_t notify;
+} bsp_event_entry_t;
+
+/**
+ * Colas de eventos, una por prioridad, gestionadas como búferes circulares.
+ * Los índices crecen libremente y se reducen con la máscara al acceder. Varias
+ * isr pueden publicar, así que los índices se actualizan en sección crítica
+ */
+typedef struct
+{
+	bsp_event_entry_t entries[BSP_EVENT_QUEUE_SIZE];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+} bsp_event_queue_t;
+
+static bsp_event_queue_t bsp_event_queues[bsp_event_prio_max];
+
+/*****************************************************************************/
+
+/**
+ * Manejadores de cada tipo de evento
+ */
+typedef struct
+{
+	bsp_event_handler_t handler;
+	void *ctx;
+} bsp_event_slot_t;
+
+static bsp_event_slot_t bsp_event_slots[BSP_EVENT_MAX_TYPES];
+
+/*****************************************************************************/
+
+/**
+ * Tipos de evento habilitados, avisos pendientes de cada tipo (un bit por
+ * fuente) y eventos descartados
+ */
+static volatile uint32_t bsp_event_enabled = 0;
+static volatile uint32_t bsp_event_pending[BSP_EVENT_MAX_TYPES];
+static volatile uint32_t bsp_event_dropped = 0;
+
+/*****************************************************************************/
+
+/**
+ * Encola un evento. Se llama en sección crítica
+ * @param type		Tipo de evento
+ * @param source	Instancia que lo produce
+ * @param data		Dato dependiente del tipo
+ * @param prio		Cola en la que se encola
+ * @param notify	1 si es un aviso de bsp_event_notify
+ * @return	Cero en caso de éxito o -1 si la cola está llena
+ */
+static int32_t bsp_event_push (uint32_t type, uint32_t source, uint32_t data, bsp_event_prio_t prio,
+							   uint32_t notify)
+{
+	bsp_event_queue_t *queue = &bsp_event_queues[prio];
+	bsp_event_entry_t *entry;
+
+	if (queue->head - queue->tail >= BSP_EVENT_QUEUE_SIZE)
+	{
+		bsp_event_dropped++;
+		return -1;
+	}
+
+	entry = &queue->entries[queue->head & (BSP_EVENT_QUEUE_SIZE - 1)];
+	entry->event.type = type;
+	entry->event.source = source;
+	entry->event.data = data;
+	entry->notify = notify;
+	queue->head++;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Publica un evento. Se puede llamar desde cualquier isr y desde la aplicación.
+ * Los eventos de tipos no habilitados se descartan sin error
+ * @param type		Tipo de evento
+ * @param source	Instancia que lo produce
+ * @param data		Dato dependiente del tipo
+ * @param prio		Cola en la que se encola
+ * @return	Cero en caso de éxito o -1 en caso de error (EAGAIN si la cola está
+ * 			llena).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_post (uint32_t type, uint32_t source, uint32_t data, bsp_event_prio_t prio)
+{
+	itc_critical_t state;
+	int32_t ret;
+
+	if (type >= BSP_EVENT_MAX_TYPES || prio >= bsp_event_prio_max)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!(bsp_event_enabled & (1 << type)))
+		return 0;
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+	ret = bsp_event_push (type, source, data, prio, 0);
+	itc_critical_exit (state);
+
+	if (ret < 0)
+		errno = EAGAIN;
+
+	return ret;
+}
+
+/*****************************************************************************/
+
+/**
+ * Publica un evento de aviso, sin dato. Si ya hay un aviso del mismo tipo y la
+ * misma fuente pendiente no se encola otro, de modo que una fuente que
+ * interrumpe a menudo no puede llenar las colas
+ * @param type		Tipo de evento
+ * @param source	Instancia que lo produce (menor que 32)
+ * @param prio		Cola en la que se encola
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_notify (uint32_t type, uint32_t source, bsp_event_prio_t prio)
+{
+	itc_critical_t state;
+	int32_t ret = 0;
+
+	if (type >= BSP_EVENT_MAX_TYPES || source >= 32 || prio >= bsp_event_prio_max)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!(bsp_event_enabled & (1 << type)))
+		return 0;
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+	if (!(bsp_event_pending[type] & (1 << source)))
+	{
+		ret = bsp_event_push (type, source, 0, prio, 1);
+		if (ret == 0)
+			bsp_event_pending[type] |= (1 << source);
+	}
+	itc_critical_exit (state);
+
+	if (ret < 0)
+		errno = EAGAIN;
+
+	return ret;
+}
+
+/*****************************************************************************/
+
+/**
+ * Extrae el siguiente evento sin esperar
+ * @param event	Destino del evento
+ * @return	Cero en caso de éxito o -1 en caso de error (EAGAIN si no hay eventos).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_get (bsp_event_t *event)
+{
+	itc_critical_t state;
+	bsp_event_queue_t *queue;
+	bsp_event_entry_t *entry;
+	uint32_t prio;
+
+	if (event == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+
+	for (prio = 0; prio < bsp_event_prio_max; prio++)
+	{
+		queue = &bsp_event_queues[prio];
+		if (queue->head != queue->tail)
+		{
+			entry = &queue->entries[queue->tail & (BSP_EVENT_QUEUE_SIZE - 1)];
+			*event = entry->event;
+			queue->tail++;
+
+			/* Un aviso posterior de la misma fuente se vuelve a encolar. Los
+			 * eventos de bsp_event_post no tocan el bit de un aviso pendiente */
+			if (entry->notify)
+				bsp_event_pending[event->type] &= ~(1 << event->source);
+
+			itc_critical_exit (state);
+			return 0;
+		}
+	}
+
+	itc_critical_exit (state);
+
+	errno = EAGAIN;
+	return -1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Extrae el siguiente evento, esperando en bsp_idle mientras no haya ninguno.
+ * No se debe llamar desde una isr
+ * @param event	Destino del evento
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_wait (bsp_event_t *event)
+{
+	if (event == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (bsp_event_get (event) < 0)
+		bsp_idle ();
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Habilita o deshabilita la publicación de un tipo de evento
+ * @param type		Tipo de evento
+ * @param enable	1 para habilitarlo, 0 para deshabilitarlo
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_enable (uint32_t type, uint32_t enable)
+{
+	itc_critical_t state;
+
+	if (type >= BSP_EVENT_MAX_TYPES)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+	if (enable)
+		bsp_event_enabled |= (1 << type);
+	else
+		bsp_event_enabled &= ~(1 << type);
+	itc_critical_exit (state);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Asigna el manejador de un tipo de evento y habilita su publicación
+ * @param type		Tipo de evento
+ * @param handler	Manejador. NULL para anular una selección anterior
+ * @param ctx		Contexto que se pasa al manejador
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_set_handler (uint32_t type, bsp_event_handler_t handler, void *ctx)
+{
+	if (type >= BSP_EVENT_MAX_TYPES)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	bsp_event_slots[type].handler = handler;
+	bsp_event_slots[type].ctx = ctx;
+
+	return handler ? bsp_event_enable (type, 1) : 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Espera al siguiente evento y llama a su manejador, si lo tiene.
+ * El bucle principal de la aplicación la llama repetidamente
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_dispatch (void)
+{
+	bsp_event_t event;
+	bsp_event_slot_t *slot;
+
+	if (bsp_event_wait (&event) < 0)
+		return -1;
+
+	slot = &bsp_event_slots[event.type];
+	if (slot->handler)
+		slot->handler (&event, slot->ctx);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Número de eventos descartados por tener la cola llena
+ */
+uint32_t bsp_event_overflows (void)
+{
+	return bsp_event_dropped;
+}
+
+/*****************************************************************************/
+
+/**
+ * Número de eventos encolados en todas las colas
+ */
+uint32_t bsp_event_count (void)
+{
+	uint32_t prio, count = 0;
+
+	for (prio = 0; prio < bsp_event_prio_max; prio++)
+		count += bsp_event_queues[prio].head - bsp_event_queues[prio].tail;
+
+	return count;
+}
+
+/*****************************************************************************/
@@ -19,15 +19,25 @@ extern volatile excep_handler_t _excep_handlers[excep_max];
  */
 void excep_init ()
 {
-	excep_set_handler (excep_irq, excep_nonnested_irq_handler);
+	/* El manejador de las IRQ se selecciona en system.h */
+	excep_set_handler (excep_irq, EXCEP_IRQ_HANDLER);
+	excep_set_handler (excep_fiq, excep_fiq_handler);
+
+	/* Llamadas al sistema desde modo USER (ver swi.h) */
+	excep_set_handler (excep_swi, excep_swi_handler);
+
+	/* Los fallos se guardan en el registro de fallos (ver crash.h) */
+	excep_set_handler (excep_undef, bsp_crash_undef_handler);
+	excep_set_handler (excep_pabt, bsp_crash_pabt_handler);
+	excep_set_handler (excep_dabt, bsp_crash_dabt_handler);
 }
 
 /*****************************************************************************/
 
 /**
  * Deshabilita todas las interrupciones
- * Esta función sólo funciona en modos privilegiados. Desde modo USER no se
- * permite alterar los bits I y F de los registros de control
+ * En modo USER, en el que no se permite alterar los bits I y F del CPSR, se hace
+ * mediante una SWI
  * @return	El valor de los bits I y F antes de deshabilitar las interrupciones:
  * 			0: I=0, F=0	(IRQ habilitadas,    FIQ habilitadas)
  * 			1: I=0, F=1	(IRQ habilitadas,    FIQ deshabilitadas)
@@ -37,6 +47,10 @@ void excep_init ()
 inline uint32_t excep_disable_ints ()
 {
     uint32_t if_bits;
+    
+    if(bsp_in_user_mode())
+        return BSP_SWI(bsp_swi_disable_ints, 0, 0, 0);
+    
     asm volatile(
         "mrs %[bits], cpsr\n\t"         /* bits <- cpsr */
         "orr r12, %[bits], #0xC0\n\t"   /* I,F <- 1 */
@@ -52,8 +66,8 @@ inline uint32_t excep_disable_ints ()
 
 /**
  * Deshabilita las interrupciones normales
- * Esta función sólo funciona en modos privilegiados. Desde modo USER no se
- * permite alterar el bit I de los registros de control
+ * En modo USER, en el que no se permite alterar el bit I del CPSR, se hace
+ * mediante una SWI
  * @return	El valor del bit I antes de deshabilitar las interrupciones:
  * 			0: I=0	(IRQ habilitadas)
  * 			1: I=1	(IRQ deshabilitadas)
@@ -61,6 +75,10 @@ inline uint32_t excep_disable_ints ()
 inline uint32_t excep_disable_irq ()
 {
     uint32_t i_bit;
+    
+    if(bsp_in_user_mode())
+        return BSP_SWI(bsp_swi_disable_irq, 0, 0, 0);
+    
     asm volatile(
         "mrs %[bits], cpsr\n\t"         /* bits <- cpsr */
         "orr r12, %[bits], #0x80\n\t"   /* I <- 1 */
@@ -76,8 +94,8 @@ inline uint32_t excep_disable_irq ()
 
 /**
  * Deshabilita las interrupciones rápidas
- * Esta función sólo funciona en modos privilegiados. Desde modo USER no se
- * permite alterar el bit F de los registros de control
+ * En modo USER, en el que no se permite alterar el bit F del CPSR, se hace
+ * mediante una SWI
  * @return	El valor del bit F antes de deshabilitar las interrupciones:
  * 			0: F=0	(FIQ habilitadas)
  * 			1: F=1	(FIQ deshabilitadas)
@@ -85,6 +103,10 @@ inline uint32_t excep_disable_irq ()
 inline uint32_t excep_disable_fiq ()
 {
     uint32_t f_bit;
+    
+    if(bsp_in_user_mode())
+        return BSP_SWI(bsp_swi_disable_fiq, 0, 0, 0);
+    
     asm volatile(
         "mrs %[bits], cpsr\n\t"         /* bits <- cpsr */
         "orr r12, %[bits], #0x40\n\t"   /* I <- 1 */
@@ -100,8 +122,8 @@ inline uint32_t excep_disable_fiq ()
 
 /**
  * Restaura los antiguos valores de las máscaras de interrupción
- * Esta función sólo funciona en modos privilegiados. Desde modo USER no se
- * permite alterar los bits I y F de los registros de control
+ * En modo USER, en el que no se permite alterar los bits I y F del CPSR, se hace
+ * mediante una SWI
  * @param if_bits	Valores anteriores de las máscaras
  * 						0: I=0, F=0	(IRQ habilitadas,    FIQ habilitadas)
  *			 			1: I=0, F=1	(IRQ habilitadas,    FIQ deshabilitadas)
@@ -110,6 +132,11 @@ inline uint32_t excep_disable_fiq ()
  */
 inline void excep_restore_ints (uint32_t if_bits)
 {
+    if(bsp_in_user_mode()){
+        BSP_SWI(bsp_swi_restore_ints, if_bits, 0, 0);
+        return;
+    }
+    
     asm volatile(
         "mrs r12, cpsr\n\t"                     /* r12 <- cpsr */
         "bic r12, r12, #0xC0\n\t"               /* Limpiamos los bits I,F */
@@ -125,14 +152,19 @@ inline void excep_restore_ints (uint32_t if_bits)
 
 /**
  * Restaura el antiguo valor de la máscara de interrupciones normales
- * Esta función sólo funciona en modos privilegiados. Desde modo USER no se
- * permite alterar el bit I de los registros de control
+ * En modo USER, en el que no se permite alterar el bit I del CPSR, se hace
+ * mediante una SWI
  * @param i_bit	Valor anterior de la máscara
  * 						0: I=0	(IRQ habilitadas)
  * 						1: I=1	(IRQ deshabilitadas)
  */
 inline void excep_restore_irq (uint32_t i_bit)
 {
+    if(bsp_in_user_mode()){
+        BSP_SWI(bsp_swi_restore_irq, i_bit, 0, 0);
+        return;
+    }
+    
     asm volatile(
         "mrs r12, cpsr\n\t"                     /* r12 <- cpsr */
         "bic r12, r12, #0x80\n\t"               /* Limpiamos bit I*/
@@ -148,18 +180,23 @@ inline void excep_restore_irq (uint32_t i_bit)
 
 /**
  * Restaura el antiguo valor de la máscara de interrupciones rápidas
- * Esta función sólo funciona en modos privilegiados. Desde modo USER no se
- * permite alterar el bit F de los registros de control
+ * En modo USER, en el que no se permite alterar el bit F del CPSR, se hace
+ * mediante una SWI
  * @param f_bit	Valor anterior de la máscara
  * 						0: F=0	(FIQ habilitadas)
  * 						1: F=1	(FIQ deshabilitadas)
  */
 inline void excep_restore_fiq (uint32_t f_bit)
 {
+    if(bsp_in_user_mode()){
+        BSP_SWI(bsp_swi_restore_fiq, f_bit, 0, 0);
+        return;
+    }
+    
     asm volatile(
         "mrs r12, cpsr\n\t"                     /* r12 <- cpsr */
         "bic r12, r12, #0x40\n\t"               /* Limpiamos bit F */
-        "orr r12, r12, %[bits], LSL #7\n\t"     /* Restauramos */
+        "orr r12, r12, %[bits], LSL #6\n\t"     /* Restauramos */
         "msr cpsr_c, r12"
         :                                       /* Parámetros de salida */
         :    [bits] "r" (f_bit & 1)          /* Parámetros de entrada */
@@ -207,3 +244,16 @@ void excep_nonnested_irq_handler ()
 }
 
 /*****************************************************************************/
+
+/**
+ * Manejador en C para interrupciones rápidas
+ * Atiende la fuente FIQ pendiente mediante el ITC. Los drivers pueden instalar
+ * en su lugar un manejador en ensamblador específico para su fuente
+ */
+__attribute__ ((interrupt("FIQ")))
+void excep_fiq_handler ()
+{
+	itc_service_fast_interrupt();
+}
+
+/*****************************************************************************/
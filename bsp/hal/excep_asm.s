@@ -0,0 +1,125 @@
+@
+@ Sistemas Empotrados
+@ Manejadores de interrupciones normales en ensamblador
+@
+
+	.set _IRQ_DISABLE, 0x80 @ cuando el bit I está activo, IRQ está deshabilitado
+	.set _FIQ_DISABLE, 0x40 @ cuando el bit F está activo, FIQ está deshabilitado
+
+	.set _MODE_MASK, 0x1F
+	.set _USR_MODE, 0x10
+	.set _IRQ_MODE, 0x12
+	.set _SYS_MODE, 0x1F
+
+	@ Sólo se cambia de tarea si el núcleo está en marcha (ver bsp_kernel_ops),
+	@ así que una imagen sin núcleo no necesita enlazar kernel_asm.s
+	.weak	bsp_kernel_irq_switch
+
+	.code 32
+	.text
+
+@
+@ Manejador para interrupciones normales no anidadas.
+@ Equivale al manejador en C con el atributo interrupt: guarda los registros
+@ que puede modificar una función C y atiende la interrupción con el bit I a 1
+@
+	.align	4
+	.global	excep_nonnested_irq_handler_asm
+	.type	excep_nonnested_irq_handler_asm, %function
+excep_nonnested_irq_handler_asm:
+	sub	lr, lr, #4			@ Dirección de retorno
+	stmfd	sp!, {r0-r3, r12, lr}
+
+	ldr	r0, =itc_service_normal_interrupt
+	mov	lr, pc
+	bx	r0
+
+	ldmfd	sp!, {r0-r3, r12, pc}^		@ Retorno restaurando cpsr <- spsr
+	.size	excep_nonnested_irq_handler_asm, .-excep_nonnested_irq_handler_asm
+
+@
+@ Manejador para interrupciones normales anidadas.
+@ Guarda la dirección de retorno y el spsr en la pila del modo IRQ, que es lo
+@ único que sobrescribiría una nueva interrupción, y atiende la interrupción en
+@ modo SYS. itc_service_nested_interrupt enmascara en el ITC las fuentes de
+@ prioridad menor o igual y vuelve a habilitar el bit I, de modo que las
+@ fuentes más prioritarias pueden expulsar al manejador en curso
+@
+	.align	4
+	.global	excep_nested_irq_handler
+	.type	excep_nested_irq_handler, %function
+excep_nested_irq_handler:
+	sub	lr, lr, #4			@ Dirección de retorno
+	stmfd	sp!, {lr}
+	mrs	lr, spsr			@ Una IRQ anidada sobrescribiría spsr_irq
+	stmfd	sp!, {lr}
+
+	@ Pasamos a modo SYS sin habilitar todavía las interrupciones ni tocar el bit F
+	mrs	lr, cpsr
+	orr	lr, lr, #_SYS_MODE
+	msr	cpsr_c, lr
+	stmfd	sp!, {r0-r3, r12, lr}		@ lr_sys pertenece al código interrumpido
+
+	ldr	r0, =itc_service_nested_interrupt
+	mov	lr, pc
+	bx	r0
+
+	@ itc_service_nested_interrupt retorna con el bit I a 1. Si ha despertado a
+	@ una tarea más prioritaria y se retorna a una tarea (modo USER), lo que
+	@ sólo ocurre al salir de la interrupción más externa, se cambia de tarea
+	ldr	r0, =bsp_kernel_switch_pending
+	ldr	r0, [r0]
+	cmp	r0, #0
+	beq	1f
+	mrs	r1, cpsr			@ Los cambios de modo conservan el bit F
+	bic	r1, r1, #_MODE_MASK
+	orr	r1, r1, #_IRQ_MODE
+	msr	cpsr_c, r1
+	ldr	r0, [sp]			@ spsr del código interrumpido
+	orr	r1, r1, #_SYS_MODE
+	msr	cpsr_c, r1
+	and	r0, r0, #_MODE_MASK
+	cmp	r0, #_USR_MODE
+	beq	bsp_kernel_irq_switch		@ ver kernel_asm.s
+
+	@ No queda ningún registro libre para el cambio de modo, así que el bit F
+	@ se conserva eligiendo la instrucción con los flags (ldm no los cambia)
+1:	mrs	r0, cpsr
+	tst	r0, #_FIQ_DISABLE
+	ldmfd	sp!, {r0-r3, r12, lr}
+	msreq	cpsr_c, #(_IRQ_MODE | _IRQ_DISABLE)
+	msrne	cpsr_c, #(_IRQ_MODE | _IRQ_DISABLE | _FIQ_DISABLE)
+
+	ldmfd	sp!, {lr}
+	msr	spsr_cxsf, lr
+	ldmfd	sp!, {pc}^			@ Retorno restaurando cpsr <- spsr
+	.size	excep_nested_irq_handler, .-excep_nested_irq_handler
+
+@
+@ Ejecuta bsp_run_deferred sobre la pila del trabajo diferido. Las isr que lo
+@ expulsan se apilan en ella y, si llaman a su vez a esta función, no vuelven a
+@ su tope: bsp_run_deferred no es reentrante y retorna sin hacer nada
+@
+	.align	4
+	.global	excep_run_deferred
+	.type	excep_run_deferred, %function
+excep_run_deferred:
+	stmfd	sp!, {r4, lr}
+	mov	r4, sp				@ r4 <- pila de la tarea interrumpida
+
+	ldr	r0, =_defer_stack_bottom
+	ldr	r1, =_defer_stack_top
+	cmp	r4, r0
+	bls	1f
+	cmp	r4, r1
+	bls	2f				@ Ya estamos en la pila del trabajo diferido
+1:	mov	sp, r1
+
+2:	ldr	r0, =bsp_run_deferred
+	mov	lr, pc
+	bx	r0
+
+	mov	sp, r4
+	ldmfd	sp!, {r4, lr}
+	bx	lr
+	.size	excep_run_deferred, .-excep_run_deferred
@@ -0,0 +1,60 @@
+/*
+ * Sistemas operativos empotrados
+ * Espera de interrupciones
+ */
+
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Función de bajo consumo seleccionada por la aplicación
+ */
+static volatile bsp_idle_hook_t bsp_idle_hook = NULL;
+
+/*****************************************************************************/
+
+/**
+ * Espera a la próxima interrupción.
+ * La usan las llamadas bloqueantes en vez de consultar el hardware en un bucle
+ * cerrado. Puede volver antes de tiempo, así que quien la llama debe volver a
+ * comprobar su condición de espera. No se debe llamar desde una isr.
+ * Si hay trabajo diferido pendiente lo ejecuta en vez de detener el procesador.
+ * Dentro de una tarea (ver bsp_kernel_in_task) la bloquea hasta la siguiente
+ * interrupción, y las demás tareas siguen ejecutándose
+ */
+void bsp_idle (void)
+{
+	bsp_idle_hook_t hook = bsp_idle_hook;
+
+	if (bsp_kernel_in_task ())
+	{
+		bsp_kernel_wait_irq ();
+		return;
+	}
+
+	if (bsp_deferred_pending ())
+	{
+		bsp_run_deferred ();
+		return;
+	}
+
+	if (hook)
+		hook ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Fija la función que detiene el procesador en bsp_idle.
+ * El ARM7TDMI no dispone de una instrucción de espera de interrupciones, por lo
+ * que la parada depende del modo de bajo consumo que use la aplicación. Por
+ * defecto es el gestor de bajo consumo (ver bsp_power_init)
+ * @param hook	Función de bajo consumo. NULL para no detener el procesador
+ */
+void bsp_set_idle_hook (bsp_idle_hook_t hook)
+{
+	bsp_idle_hook = hook;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,33 @@
+/*
+ * Sistemas operativos empotrados
+ * Arena estática del BSP
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Reserva memoria de la arena estática del BSP.
+ * La arena se define en el script de enlazado y se usa para los búferes de los
+ * drivers, cuyo tamaño se decide al inicializarlos. La memoria reservada no se
+ * libera nunca.
+ * @param size	Tamaño en bytes. Se redondea a un múltiplo del tamaño de palabra
+ * @return		Puntero a la memoria reservada o NULL en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+void * bsp_arena_alloc (uint32_t size);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de bytes que quedan libres en la arena
+ */
+uint32_t bsp_arena_free (void);
+
+/*****************************************************************************/
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,100 @@
+/*
+ * Sistemas operativos empotrados
+ * Registro de fallos
+ */
+
+#ifndef __CRASH_H__
+#define __CRASH_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Marcas del registro de fallos. Cualquier otro valor indica que no hay registro
+ */
+#define BSP_CRASH_MAGIC		0x43525348		/* Registro pendiente de informar */
+#define BSP_CRASH_REPORTED	0x43525250		/* Registro ya informado */
+
+/**
+ * Palabras de la pila del contexto interrumpido que se guardan en el registro
+ */
+#define BSP_CRASH_STACK_WORDS	16
+
+/*****************************************************************************/
+
+/**
+ * Registro de un fallo (excepciones undefined, prefetch abort y data abort).
+ * Se guarda en una sección sin inicializar que sobrevive al reinicio en caliente
+ * que hacen los manejadores tras el fallo. Los manejadores en ensamblador
+ * (crash_asm.s) acceden a los campos por su desplazamiento, así que no se debe
+ * cambiar su orden. El ARM7TDMI no tiene registro de dirección de fallo, así
+ * que para los data abort la dirección accedida se debe deducir de la
+ * instrucción y de los registros
+ */
+typedef struct
+{
+	uint32_t magic;						/* 0x00 BSP_CRASH_MAGIC o BSP_CRASH_REPORTED */
+	uint32_t excep;						/* 0x04 excep_undef, excep_pabt o excep_dabt */
+	uint32_t r[13];						/* 0x08 r0-r12 del contexto interrumpido */
+	uint32_t pc;						/* 0x3C Dirección de la instrucción que falló */
+	uint32_t cpsr;						/* 0x40 cpsr del contexto interrumpido */
+	uint32_t usr_sp, usr_lr;			/* 0x44 Registros de los modos USR y SYS */
+	uint32_t svc_sp, svc_lr, svc_spsr;	/* 0x4C Registros del modo SVC */
+	uint32_t abt_sp, abt_lr, abt_spsr;	/* 0x58 Registros del modo ABT */
+	uint32_t und_sp, und_lr, und_spsr;	/* 0x64 Registros del modo UND */
+	uint32_t irq_sp, irq_lr, irq_spsr;	/* 0x70 Registros del modo IRQ */
+	uint32_t fiq_r[5];					/* 0x7C r8-r12 del modo FIQ */
+	uint32_t fiq_sp, fiq_lr, fiq_spsr;	/* 0x90 Registros del modo FIQ */
+	uint32_t sp;						/* 0x9C sp del contexto interrumpido */
+	uint32_t lr;						/* 0xA0 lr del contexto interrumpido */
+	uint32_t insn;						/* 0xA4 Instrucción que falló */
+	uint32_t stack[BSP_CRASH_STACK_WORDS];	/* 0xA8 Pila a partir de sp */
+	uint32_t count;						/* Fallos seguidos desde el arranque en frío */
+	uint32_t checksum;					/* Suma de comprobación de los campos anteriores */
+} bsp_crash_t;
+
+/*****************************************************************************/
+
+/**
+ * Manejadores de las excepciones de fallo. Guardan los registros de todos los
+ * modos sin usar la pila del modo de la excepción, completan el registro de
+ * fallos y reinician la aplicación en caliente (ver _warm_start en crt0.s)
+ */
+void bsp_crash_undef_handler ();
+void bsp_crash_pabt_handler ();
+void bsp_crash_dabt_handler ();
+
+/*****************************************************************************/
+
+/**
+ * Completa el registro de fallos tras guardar los registros.
+ * La llaman los manejadores de fallo, con las interrupciones deshabilitadas y
+ * usando una pila propia
+ * @param crash	Registro de fallos
+ */
+void bsp_crash_save (bsp_crash_t *crash);
+
+/*****************************************************************************/
+
+/**
+ * Copia el registro del último fallo, si lo hay
+ * @param crash	Destino del registro
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOENT si no hay un
+ * 			registro válido).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_crash_get (bsp_crash_t *crash);
+
+/*****************************************************************************/
+
+/**
+ * Escribe en la salida estándar el registro del último fallo, si no se ha
+ * informado ya, y lo marca como informado. El código de arranque la llama antes
+ * de main. La salida se puede decodificar en el host con tools/bin/crash-decode
+ */
+void bsp_crash_report (void);
+
+/*****************************************************************************/
+
+#endif /* __CRASH_H__ */
@@ -0,0 +1,54 @@
+/*
+ * Sistemas operativos empotrados
+ * Cola de trabajo diferido
+ */
+
+#ifndef __DEFER_H__
+#define __DEFER_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Definición para las funciones de trabajo diferido
+ */
+typedef void (* bsp_work_t) (void *ctx, uint32_t arg);
+
+/*****************************************************************************/
+
+/**
+ * Encola un trabajo para ejecutarlo fuera de la isr.
+ * Se puede llamar desde cualquier isr (IRQ o FIQ) y desde la aplicación. El
+ * elemento se copia en una reserva fija cuyo tamaño se define en "system.h",
+ * por lo que el coste es acotado y no se reserva memoria
+ * @param func	Función a ejecutar
+ * @param ctx	Puntero que se pasa a la función
+ * @param arg	Argumento que se pasa a la función
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_defer (bsp_work_t func, void *ctx, uint32_t arg);
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta los trabajos diferidos pendientes en orden de llegada.
+ * El manejador de IRQ anidado la llama al volver de la interrupción más externa,
+ * en modo SYS y con las interrupciones habilitadas. Con el manejador no anidado
+ * la debe llamar la aplicación (también se llama desde bsp_idle).
+ * Si ya se está ejecutando no hace nada, así que no es reentrante
+ */
+void bsp_run_deferred (void);
+
+/*****************************************************************************/
+
+/**
+ * Número de trabajos pendientes
+ * @return	Trabajos encolados y todavía no ejecutados
+ */
+uint32_t bsp_deferred_pending (void);
+
+/*****************************************************************************/
+
+#endif /* __DEFER_H__ */
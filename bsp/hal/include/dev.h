@@ -8,6 +8,7 @@
 
 #include <sys/stat.h>
 #include "system.h"
+#include "kernel.h"
 
 /*****************************************************************************/
 
@@ -28,10 +29,25 @@ typedef struct
 	off_t (*lseek)(uint32_t id, off_t offset, int whence);	/* Función lseek */
 	int (*fstat)(uint32_t id, struct stat *buf);			/* Función fstat */
 	int (*isatty)(uint32_t id);								/* Función isatty */
+	int (*ioctl)(uint32_t id, uint32_t request, void *arg);	/* Función ioctl */
+	bsp_mutex_t rd_lock;									/* Turno de las tareas que leen */
+	bsp_mutex_t wr_lock;									/* Turno de las tareas que escriben */
 } bsp_dev_t;
 
 /*****************************************************************************/
 
+/**
+ * Peticiones de control comunes a varios dispositivos (ver bsp_ioctl).
+ * El argumento es un puntero a un uint32_t distinto de cero para esperar a que
+ * el dispositivo esté listo, o cero para consultarlo sin esperar. Si no está
+ * listo la petición falla con EAGAIN.
+ * Los drivers numeran sus propias peticiones a partir de 1
+ */
+#define BSP_IOCTL_WAIT_READ		0x80000001u		/* Hay datos para leer */
+#define BSP_IOCTL_WAIT_WRITE	0x80000002u		/* Hay espacio para escribir */
+
+/*****************************************************************************/
+
 /**
  * Estructura de un descriptor de fichero
  */
@@ -54,6 +70,7 @@ typedef struct
  * @param lseek		Función lseek del dispositivo
  * @param fstat		Función fsat del dispositivo
  * @param isatty	Función isatty del dispositivo
+ * @param ioctl		Función ioctl del dispositivo
  * @return 			El numero de dispositivo asignado o -1 en caso de error
  */
 int32_t bsp_register_dev (const char  *name,
@@ -64,7 +81,23 @@ int32_t bsp_register_dev (const char  *name,
 		ssize_t (*write)(uint32_t id, char *buf, size_t count),
 		off_t (*lseek)(uint32_t id, off_t offset, int whence),
 		int (*fstat)(uint32_t id, struct stat *buf),
-		int (*isatty)(uint32_t id));
+		int (*isatty)(uint32_t id),
+		int (*ioctl)(uint32_t id, uint32_t request, void *arg));
+
+/*****************************************************************************/
+
+/**
+ * Operaciones de control específicas de un dispositivo.
+ * Las peticiones las define cada driver en su cabecera. Desde modo USER se
+ * ejecutan en modo SVC mediante una SWI, salvo las esperas, que bloquean la
+ * tarea con el núcleo y por eso se quedan en modo USER, como en _read y _write
+ * @param fd		Descriptor de fichero/dispositivo
+ * @param request	Petición
+ * @param arg		Argumento de la petición
+ * @return			Un valor dependiente de la petición o -1 en caso de error.
+ * 					La condición de error se indica en la variable global errno
+ */
+int bsp_ioctl (int fd, uint32_t request, void *arg);
 
 /*****************************************************************************/
 
@@ -0,0 +1,172 @@
+/*
+ * Sistemas operativos empotrados
+ * Despachador de eventos
+ */
+
+#ifndef __EVENT_H__
+#define __EVENT_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Tipos de evento. Los drivers publican los suyos y la aplicación puede usar
+ * los tipos a partir de bsp_event_user
+ */
+typedef enum
+{
+	bsp_event_uart_rx = 0,		/* Datos recibidos. Fuente: uart */
+	bsp_event_uart_tx,			/* Transmisión terminada. Fuente: uart */
+	bsp_event_uart_frame,		/* Trama recibida. Fuente: uart. Dato: longitud y resultado (BSP_EVENT_FRAME_*) */
+	bsp_event_gpio,				/* Flanco en un pin. Fuente: pin */
+	bsp_event_timer,			/* Vencimiento de un temporizador. Fuente: temporizador */
+	bsp_event_user				/* Primer tipo libre para la aplicación */
+} bsp_event_type_t;
+
+/**
+ * Número máximo de tipos de evento
+ */
+#define BSP_EVENT_MAX_TYPES		16
+
+/**
+ * Campos del dato de bsp_event_uart_frame
+ */
+#define BSP_EVENT_FRAME_LEN(data)		((data) & 0xFFFFFF)
+#define BSP_EVENT_FRAME_STATUS(data)	((data) >> 24)
+
+/*****************************************************************************/
+
+/**
+ * Prioridades de las colas de eventos. Siempre se extrae primero el evento
+ * más antiguo de la cola más prioritaria
+ */
+typedef enum
+{
+	bsp_event_high = 0,
+	bsp_event_normal,
+	bsp_event_low,
+	bsp_event_prio_max
+} bsp_event_prio_t;
+
+/*****************************************************************************/
+
+/**
+ * Evento
+ */
+typedef struct
+{
+	uint16_t type;			/* Tipo de evento (ver bsp_event_type_t) */
+	uint16_t source;		/* Instancia que lo produce (uart, pin, temporizador...) */
+	uint32_t data;			/* Dato dependiente del tipo */
+} bsp_event_t;
+
+/*****************************************************************************/
+
+/**
+ * Prototipo para los manejadores de eventos
+ * @param event	Evento
+ * @param ctx	Contexto indicado al registrar el manejador
+ */
+typedef void (* bsp_event_handler_t) (const bsp_event_t *event, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Publica un evento. Se puede llamar desde cualquier isr y desde la aplicación.
+ * Los eventos de tipos no habilitados se descartan sin error
+ * @param type		Tipo de evento
+ * @param source	Instancia que lo produce
+ * @param data		Dato dependiente del tipo
+ * @param prio		Cola en la que se encola
+ * @return	Cero en caso de éxito o -1 en caso de error (EAGAIN si la cola está
+ * 			llena).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_post (uint32_t type, uint32_t source, uint32_t data, bsp_event_prio_t prio);
+
+/*****************************************************************************/
+
+/**
+ * Publica un evento de aviso, sin dato. Si ya hay un aviso del mismo tipo y la
+ * misma fuente pendiente no se encola otro, de modo que una fuente que
+ * interrumpe a menudo no puede llenar las colas
+ * @param type		Tipo de evento
+ * @param source	Instancia que lo produce (menor que 32)
+ * @param prio		Cola en la que se encola
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_notify (uint32_t type, uint32_t source, bsp_event_prio_t prio);
+
+/*****************************************************************************/
+
+/**
+ * Extrae el siguiente evento sin esperar
+ * @param event	Destino del evento
+ * @return	Cero en caso de éxito o -1 en caso de error (EAGAIN si no hay eventos).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_get (bsp_event_t *event);
+
+/*****************************************************************************/
+
+/**
+ * Extrae el siguiente evento, esperando en bsp_idle mientras no haya ninguno.
+ * No se debe llamar desde una isr
+ * @param event	Destino del evento
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_wait (bsp_event_t *event);
+
+/*****************************************************************************/
+
+/**
+ * Habilita o deshabilita la publicación de un tipo de evento
+ * @param type		Tipo de evento
+ * @param enable	1 para habilitarlo, 0 para deshabilitarlo
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_enable (uint32_t type, uint32_t enable);
+
+/*****************************************************************************/
+
+/**
+ * Asigna el manejador de un tipo de evento y habilita su publicación
+ * @param type		Tipo de evento
+ * @param handler	Manejador. NULL para anular una selección anterior
+ * @param ctx		Contexto que se pasa al manejador
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_set_handler (uint32_t type, bsp_event_handler_t handler, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Espera al siguiente evento y llama a su manejador, si lo tiene.
+ * El bucle principal de la aplicación la llama repetidamente
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_event_dispatch (void);
+
+/*****************************************************************************/
+
+/**
+ * Número de eventos descartados por tener la cola llena
+ */
+uint32_t bsp_event_overflows (void);
+
+/*****************************************************************************/
+
+/**
+ * Número de eventos encolados en todas las colas
+ */
+uint32_t bsp_event_count (void);
+
+/*****************************************************************************/
+
+#endif /* __EVENT_H__ */
@@ -44,8 +44,8 @@ void excep_init ();
 
 /**
  * Deshabilita todas las interrupciones
- * Esta función sólo funciona en modos privilegiados. Desde modo USER no se
- * permite alterar los bits I y F de los registros de control
+ * En modo USER, en el que no se permite alterar los bits I y F del CPSR, se hace
+ * mediante una SWI
  * @return	El valor de los bits I y F antes de deshabilitar las interrupciones:
  * 			0: I=0, F=0	(IRQ habilitadas,    FIQ habilitadas)
  * 			1: I=0, F=1	(IRQ habilitadas,    FIQ deshabilitadas)
@@ -58,8 +58,8 @@ inline uint32_t excep_disable_ints ();
 
 /**
  * Deshabilita las interrupciones normales
- * Esta función sólo funciona en modos privilegiados. Desde modo USER no se
- * permite alterar el bit I de los registros de control
+ * En modo USER, en el que no se permite alterar el bit I del CPSR, se hace
+ * mediante una SWI
  * @return	El valor del bit I antes de deshabilitar las interrupciones:
  * 			0: I=0	(IRQ habilitadas)
  * 			1: I=1	(IRQ deshabilitadas)
@@ -70,8 +70,8 @@ inline uint32_t excep_disable_irq ();
 
 /**
  * Deshabilita las interrupciones rápidas
- * Esta función sólo funciona en modos privilegiados. Desde modo USER no se
- * permite alterar el bit F de los registros de control
+ * En modo USER, en el que no se permite alterar el bit F del CPSR, se hace
+ * mediante una SWI
  * @return	El valor del bit F antes de deshabilitar las interrupciones:
  * 			0: F=0	(FIQ habilitadas)
  * 			1: F=1	(FIQ deshabilitadas)
@@ -82,8 +82,8 @@ inline uint32_t excep_disable_fiq ();
 
 /**
  * Restaura los antiguos valores de las máscaras de interrupción
- * Esta función sólo funciona en modos privilegiados. Desde modo USER no se
- * permite alterar los bits I y F de los registros de control
+ * En modo USER, en el que no se permite alterar los bits I y F del CPSR, se hace
+ * mediante una SWI
  * @param if_bits	Valores anteriores de las máscaras
  * 						0: I=0, F=0	(IRQ habilitadas,    FIQ habilitadas)
  *			 			1: I=0, F=1	(IRQ habilitadas,    FIQ deshabilitadas)
@@ -96,8 +96,8 @@ inline void excep_restore_ints (uint32_t if_bits);
 
 /**
  * Restaura el antiguo valor de la máscara de interrupciones normales
- * Esta función sólo funciona en modos privilegiados. Desde modo USER no se
- * permite alterar el bit I de los registros de control
+ * En modo USER, en el que no se permite alterar el bit I del CPSR, se hace
+ * mediante una SWI
  * @param i_bit	Valor anterior de la máscara
  * 						0: I=0	(IRQ habilitadas)
  * 						1: I=1	(IRQ deshabilitadas)
@@ -108,8 +108,8 @@ inline void excep_restore_irq (uint32_t i_bit);
 
 /**
  * Restaura el antiguo valor de la máscara de interrupciones rápidas
- * Esta función sólo funciona en modos privilegiados. Desde modo USER no se
- * permite alterar el bit F de los registros de control
+ * En modo USER, en el que no se permite alterar el bit F del CPSR, se hace
+ * mediante una SWI
  * @param f_bit	Valor anterior de la máscara
  * 						0: F=0	(FIQ habilitadas)
  * 						1: F=1	(FIQ deshabilitadas)
@@ -160,4 +160,25 @@ void excep_nested_irq_handler ();
 
 /*****************************************************************************/
 
+/**
+ * Ejecuta el trabajo diferido (ver bsp_run_deferred) sobre su propia pila
+ * (_defer_stack_top en el script del enlazador), y no sobre la de la tarea
+ * interrumpida. Si ya se está en esa pila, por una isr que ha expulsado al
+ * propio trabajo diferido, sigue en ella. La llama
+ * itc_service_nested_interrupt en modo SYS al salir de la interrupción más
+ * externa
+ */
+void excep_run_deferred ();
+
+/*****************************************************************************/
+
+/**
+ * Manejador en C para interrupciones rápidas
+ * Atiende la fuente FIQ pendiente mediante el ITC. Los drivers pueden instalar
+ * en su lugar un manejador en ensamblador específico para su fuente
+ */
+void excep_fiq_handler ();
+
+/*****************************************************************************/
+
 #endif /* __EXCEP_H__ */
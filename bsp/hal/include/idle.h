@@ -0,0 +1,44 @@
+/*
+ * Sistemas operativos empotrados
+ * Espera de interrupciones
+ */
+
+#ifndef __IDLE_H__
+#define __IDLE_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Definición para las funciones de bajo consumo
+ */
+typedef void (* bsp_idle_hook_t) (void);
+
+/*****************************************************************************/
+
+/**
+ * Espera a la próxima interrupción.
+ * La usan las llamadas bloqueantes en vez de consultar el hardware en un bucle
+ * cerrado. Puede volver antes de tiempo, así que quien la llama debe volver a
+ * comprobar su condición de espera. No se debe llamar desde una isr.
+ * Si hay trabajo diferido pendiente lo ejecuta en vez de detener el procesador.
+ * Dentro de una tarea (ver bsp_kernel_in_task) la bloquea hasta la siguiente
+ * interrupción, y las demás tareas siguen ejecutándose
+ */
+void bsp_idle (void);
+
+/*****************************************************************************/
+
+/**
+ * Fija la función que detiene el procesador en bsp_idle.
+ * El ARM7TDMI no dispone de una instrucción de espera de interrupciones, por lo
+ * que la parada depende del modo de bajo consumo que use la aplicación. Por
+ * defecto es el gestor de bajo consumo (ver bsp_power_init)
+ * @param hook	Función de bajo consumo. NULL para no detener el procesador
+ */
+void bsp_set_idle_hook (bsp_idle_hook_t hook);
+
+/*****************************************************************************/
+
+#endif /* __IDLE_H__ */
@@ -0,0 +1,342 @@
+/*
+ * Sistemas operativos empotrados
+ * Núcleo de tareas expulsivo por prioridades fijas
+ */
+
+#ifndef __KERNEL_H__
+#define __KERNEL_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Esperas sin límite de tiempo y consultas sin esperar (ver bsp_sem_wait)
+ */
+#define BSP_KERNEL_FOREVER		0xFFFFFFFFu
+#define BSP_KERNEL_NO_WAIT		0
+
+/**
+ * Conversión de milisegundos a ticks del núcleo, redondeando hacia arriba
+ */
+#define BSP_KERNEL_MS(ms)		((((uint32_t) (ms)) * BSP_KERNEL_TICK_HZ + 999) / 1000)
+
+/**
+ * Ticks del reloj monótono por tick del núcleo
+ */
+#define BSP_KERNEL_TMR_TICKS	(TMR_TICK_HZ / BSP_KERNEL_TICK_HZ)
+
+/*****************************************************************************/
+
+/**
+ * Reserva estática de la pila de una tarea. Las isr anidadas se ejecutan en
+ * modo SYS sobre la pila de la tarea interrumpida, así que a cada pila se le
+ * suman BSP_KERNEL_ISR_STACK bytes (ver "system.h"). El trabajo diferido, que
+ * puede usar stdio, se ejecuta en su propia pila (ver excep_run_deferred), y
+ * los manejadores de las isr no deben usar stdio
+ * @param name	Nombre del array
+ * @param size	Bytes que necesita la propia tarea
+ */
+#define BSP_TASK_STACK(name, size)	\
+	static uint64_t name[((size) + BSP_KERNEL_ISR_STACK + 7) / 8]
+
+/**
+ * Tamaño mínimo de una pila: el contexto guardado más el margen de las isr
+ */
+#define BSP_TASK_MIN_STACK		(64 + BSP_KERNEL_ISR_STACK)
+
+/*****************************************************************************/
+
+/**
+ * Estados de las tareas
+ */
+typedef enum
+{
+	bsp_task_ready = 0,		/* Lista para ejecutarse o en ejecución */
+	bsp_task_blocked,		/* Esperando un semáforo, un mutex o una interrupción */
+	bsp_task_sleeping,		/* Esperando un número de ticks */
+	bsp_task_finished		/* Terminada. Su TCB y su pila se pueden reutilizar */
+} bsp_task_state_t;
+
+/*****************************************************************************/
+
+/**
+ * Definición para las funciones de las tareas. Retornar equivale a llamar a
+ * bsp_task_exit
+ * @param arg	Argumento indicado al crear la tarea
+ */
+typedef void (* bsp_task_func_t) (void *arg);
+
+/*****************************************************************************/
+
+/**
+ * Bloque de control de una tarea. Lo reserva la aplicación, normalmente de
+ * forma estática, y sólo lo modifica el núcleo
+ */
+typedef struct bsp_task bsp_task_t;
+struct bsp_task
+{
+	uint32_t *sp;				/* Contexto guardado. Debe ser el primer campo (ver kernel_asm.s) */
+	bsp_task_t *next;			/* Siguiente en la cola de listos o de espera */
+	bsp_task_t *timer_next;		/* Siguiente en la lista de esperas con plazo */
+	bsp_task_t **queue;			/* Cola de espera en la que está bloqueada */
+	uint32_t wake;				/* Tick en el que vence la espera */
+	uint32_t *stack;			/* Base de la pila, NULL para la tarea ociosa */
+	uint32_t stack_size;		/* Tamaño de la pila en bytes */
+	const char *name;			/* Nombre, para depuración */
+	uint32_t switches;			/* Veces que ha pasado a ejecutarse */
+	int32_t result;				/* Resultado de la última espera */
+	uint8_t prio;				/* Prioridad efectiva, con la heredada por los mutex */
+	uint8_t base_prio;			/* Prioridad asignada */
+	uint8_t state;				/* Ver bsp_task_state_t */
+	uint8_t held;				/* Mutex que posee */
+};
+
+/*****************************************************************************/
+
+/**
+ * Semáforo contador. Con max a 1 sirve para señalar eventos desde una isr
+ */
+typedef struct
+{
+	uint32_t count;				/* Valor actual */
+	uint32_t max;				/* Valor máximo */
+	bsp_task_t *waiters;		/* Tareas bloqueadas, por orden de prioridad */
+} bsp_sem_t;
+
+/**
+ * Mutex recursivo con herencia de prioridad
+ */
+typedef struct
+{
+	bsp_task_t *owner;			/* Tarea que lo posee o NULL */
+	uint32_t depth;				/* Veces que lo ha tomado el propietario */
+	bsp_task_t *waiters;		/* Tareas bloqueadas, por orden de prioridad */
+} bsp_mutex_t;
+
+/*****************************************************************************/
+
+/**
+ * Crea una tarea lista para ejecutarse. Antes de bsp_kernel_start sólo la
+ * prepara; después puede expulsar a la tarea que la crea.
+ * Las tareas se ejecutan en modo USER y las de mayor prioridad expulsan a las
+ * de menor en cuanto están listas. Las de igual prioridad se turnan en cada
+ * tick
+ * @param task	Bloque de control, que no debe estar en uso
+ * @param name	Nombre de la tarea
+ * @param prio	Prioridad, de 1 a BSP_KERNEL_PRIO_MAX - 1 (0 es la ociosa)
+ * @param func	Función de la tarea
+ * @param arg	Argumento que se pasa a la función
+ * @param stack	Pila de la tarea (ver BSP_TASK_STACK)
+ * @param size	Tamaño de la pila en bytes, al menos BSP_TASK_MIN_STACK
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_task_create (bsp_task_t *task, const char *name, uint32_t prio,
+						 bsp_task_func_t func, void *arg, void *stack, uint32_t size);
+
+/*****************************************************************************/
+
+/**
+ * Arranca el núcleo y no retorna. La función que lo llama (normalmente main)
+ * pasa a ser la tarea ociosa, de prioridad 0, que usa la pila de modo SYS del
+ * arranque y detiene el procesador en bsp_idle cuando no hay otra lista
+ */
+void bsp_kernel_start (void) __attribute__ ((noreturn));
+
+/*****************************************************************************/
+
+/**
+ * Indica si el llamante es una tarea que puede bloquearse: el núcleo está en
+ * marcha, el procesador en modo USER y no es la tarea ociosa
+ * @return	1 si se puede bloquear, 0 en otro caso
+ */
+uint32_t bsp_kernel_in_task (void);
+
+/*****************************************************************************/
+
+/**
+ * Ticks transcurridos desde bsp_kernel_start, a BSP_KERNEL_TICK_HZ
+ * @return	Número de ticks
+ */
+uint32_t bsp_kernel_ticks (void);
+
+/*****************************************************************************/
+
+/**
+ * Retorna la tarea en ejecución
+ * @return	El bloque de control o NULL si el núcleo no está en marcha
+ */
+bsp_task_t * bsp_task_self (void);
+
+/*****************************************************************************/
+
+/**
+ * Cede la CPU a las demás tareas listas de la misma prioridad
+ */
+void bsp_task_yield (void);
+
+/*****************************************************************************/
+
+/**
+ * Duerme la tarea en ejecución. Fuera de una tarea espera activamente
+ * @param ticks	Ticks a dormir (ver BSP_KERNEL_MS)
+ */
+void bsp_task_sleep (uint32_t ticks);
+
+/*****************************************************************************/
+
+/**
+ * Termina la tarea en ejecución
+ */
+void bsp_task_exit (void) __attribute__ ((noreturn));
+
+/*****************************************************************************/
+
+/**
+ * Cambia la prioridad asignada a una tarea
+ * @param task	Tarea
+ * @param prio	Prioridad, de 1 a BSP_KERNEL_PRIO_MAX - 1
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_task_set_priority (bsp_task_t *task, uint32_t prio);
+
+/*****************************************************************************/
+
+/**
+ * Calcula cuánta pila no ha llegado a usar nunca una tarea
+ * @param task	Tarea
+ * @return	Bytes libres en el peor caso observado
+ */
+uint32_t bsp_task_stack_free (bsp_task_t *task);
+
+/*****************************************************************************/
+
+/**
+ * Inicializa un semáforo
+ * @param sem	Semáforo
+ * @param count	Valor inicial
+ * @param max	Valor máximo, al menos 1
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_sem_init (bsp_sem_t *sem, uint32_t count, uint32_t max);
+
+/*****************************************************************************/
+
+/**
+ * Decrementa un semáforo, bloqueando a la tarea mientras valga cero. Fuera de
+ * una tarea (ver bsp_kernel_in_task) espera en bsp_idle, de modo que los
+ * drivers pueden usarlo aunque el núcleo no esté en marcha
+ * @param sem		Semáforo
+ * @param timeout	Ticks máximos de espera, BSP_KERNEL_FOREVER o
+ * 					BSP_KERNEL_NO_WAIT
+ * @return	Cero en caso de éxito o -1 en caso de error (EAGAIN sin espera o
+ * 			ETIMEDOUT si vence el plazo).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_sem_wait (bsp_sem_t *sem, uint32_t timeout);
+
+/*****************************************************************************/
+
+/**
+ * Incrementa un semáforo o despierta a la tarea más prioritaria que lo espera.
+ * Se puede llamar desde una isr: el cambio de tarea se hace al salir de la
+ * interrupción. Si el contador ya está en su máximo no tiene efecto
+ * @param sem	Semáforo
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_sem_post (bsp_sem_t *sem);
+
+/*****************************************************************************/
+
+/**
+ * Inicializa un mutex libre
+ * @param mutex	Mutex
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_mutex_init (bsp_mutex_t *mutex);
+
+/*****************************************************************************/
+
+/**
+ * Toma un mutex, bloqueando a la tarea mientras lo posea otra. El propietario
+ * hereda la prioridad de la tarea bloqueada más prioritaria hasta que libera
+ * todos sus mutex. Fuera de una tarea no hay con quién competir y no tiene
+ * efecto. No se debe llamar desde una isr
+ * @param mutex		Mutex
+ * @param timeout	Ticks máximos de espera, BSP_KERNEL_FOREVER o
+ * 					BSP_KERNEL_NO_WAIT
+ * @return	Cero en caso de éxito o -1 en caso de error (EAGAIN sin espera o
+ * 			ETIMEDOUT si vence el plazo).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_mutex_lock (bsp_mutex_t *mutex, uint32_t timeout);
+
+/*****************************************************************************/
+
+/**
+ * Libera un mutex. Si hay tareas esperando pasa directamente a la más
+ * prioritaria
+ * @param mutex	Mutex
+ * @return	Cero en caso de éxito o -1 en caso de error (EPERM si no lo posee
+ * 			la tarea en ejecución).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_mutex_unlock (bsp_mutex_t *mutex);
+
+/*****************************************************************************/
+
+/**
+ * Operaciones del planificador que necesitan los semáforos, los mutex y la
+ * espera de interrupciones ("sync.c"). Las instala bsp_kernel_start en
+ * bsp_kernel_ops, que vale NULL hasta entonces, de modo que una imagen que no
+ * arranca el núcleo no enlaza el planificador ni su tick. Se llaman con la IRQ
+ * deshabilitada
+ */
+typedef struct
+{
+	bsp_task_t * (* task) (void);	/* Tarea en ejecución si puede bloquearse, NULL si no */
+	int32_t (* block) (bsp_task_t **queue, uint32_t timeout, bsp_task_state_t state);
+	void (* wake) (bsp_task_t *task, int32_t result);
+	void (* set_prio) (bsp_task_t *task, uint32_t prio);
+} bsp_kernel_ops_t;
+
+extern const bsp_kernel_ops_t *bsp_kernel_ops;
+
+/**
+ * Distinto de cero si hay que cambiar de tarea. Lo consulta
+ * excep_nested_irq_handler antes de retornar a una tarea
+ */
+extern volatile uint32_t bsp_kernel_switch_pending;
+
+/**
+ * Cambia de tarea si hay una más prioritaria lista. Sólo las tareas (modo
+ * USER) pueden ceder la CPU mediante la SWI. Desde una isr o desde el trabajo
+ * diferido el cambio se hace al retornar a la tarea interrumpida. Se llama con
+ * la IRQ deshabilitada
+ */
+void bsp_kernel_switch (void);
+
+/*****************************************************************************/
+
+/**
+ * Bloquea a la tarea en ejecución hasta la siguiente interrupción. Es la espera
+ * de bsp_idle dentro de una tarea
+ */
+void bsp_kernel_wait_irq (void);
+
+/*****************************************************************************/
+
+/**
+ * Despierta a las tareas bloqueadas en bsp_kernel_wait_irq. La llama
+ * itc_service_nested_interrupt al salir de la interrupción más externa
+ */
+void bsp_kernel_irq_exit (void);
+
+/*****************************************************************************/
+
+#endif /* __KERNEL_H__ */
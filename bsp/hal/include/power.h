@@ -0,0 +1,95 @@
+/*
+ * Sistemas operativos empotrados
+ * Gestor de bajo consumo
+ */
+
+#ifndef __POWER_H__
+#define __POWER_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Estados de bajo consumo, de menor a mayor ahorro y coste de despertar
+ */
+typedef enum
+{
+	bsp_power_run = 0,			/* No se detiene el procesador */
+	bsp_power_doze,				/* Ver crm_doze */
+	bsp_power_hibernate,		/* Ver crm_hibernate */
+	bsp_power_state_max
+} bsp_power_state_t;
+
+/*****************************************************************************/
+
+/**
+ * Fuentes de despertar. Las uart sólo pueden recibir en doze, así que si son
+ * fuentes de despertar no se entra nunca en hibernate. Los pines KBI4 a KBI7
+ * despiertan con un flanco de subida en cualquier estado y publican el evento
+ * bsp_event_gpio con el pin (GPIO26 a GPIO29) como fuente. El temporizador
+ * que vence antes (ver tmr_next_expiry) siempre despierta
+ */
+#define BSP_POWER_WAKE_UART1	(1 << 0)
+#define BSP_POWER_WAKE_UART2	(1 << 1)
+#define BSP_POWER_WAKE_KBI(n)	CRM_WAKE_KBI (n)
+
+/*****************************************************************************/
+
+/**
+ * Estadísticas del gestor
+ */
+typedef struct
+{
+	uint32_t dozes;				/* Entradas en doze */
+	uint32_t hibernates;		/* Entradas en hibernate */
+	uint64_t doze_us;			/* Tiempo total en doze */
+	uint64_t hibernate_us;		/* Tiempo total en hibernate */
+} bsp_power_stats_t;
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el gestor con las fuentes de despertar BSP_POWER_WAKEUP (ver
+ * "system.h") y lo instala como función de bajo consumo de bsp_idle.
+ * Cada vez que no hay trabajo diferido ni eventos pendientes, elige el estado
+ * más profundo permitido cuyo tiempo mínimo quepa antes del siguiente
+ * vencimiento de los temporizadores, y programa el temporizador de despertar
+ * del CRM para despertar a tiempo descontando el coste de salir del estado
+ */
+void bsp_power_init (void);
+
+/*****************************************************************************/
+
+/**
+ * Selecciona las fuentes de despertar
+ * @param sources	Máscara de fuentes (ver BSP_POWER_WAKE_UART1, ...)
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_power_set_wakeup (uint32_t sources);
+
+/*****************************************************************************/
+
+/**
+ * Limita el estado de bajo consumo más profundo, por ejemplo mientras un
+ * periférico necesita el oscilador de referencia
+ * @param state	Estado más profundo permitido
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_power_set_max_state (bsp_power_state_t state);
+
+/*****************************************************************************/
+
+/**
+ * Copia las estadísticas del gestor
+ * @param stats	Destino de las estadísticas
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_power_get_stats (bsp_power_stats_t *stats);
+
+/*****************************************************************************/
+
+#endif /* __POWER_H__ */
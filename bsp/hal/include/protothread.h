@@ -0,0 +1,216 @@
+/*
+ * Sistemas operativos empotrados
+ * Planificador de corrutinas sin pila
+ */
+
+#ifndef __PROTOTHREAD_H__
+#define __PROTOTHREAD_H__
+
+#include <stdint.h>
+#include "pt.h"
+
+/*****************************************************************************/
+
+/**
+ * Señales de las fuentes de eventos del BSP. Una corrutina sólo se ejecuta
+ * cuando llega alguna de las señales que espera
+ */
+#define BSP_PT_SIGNAL_UART_RX(uart)	(1u << (uart))			/* Hay datos en el búfer de recepción */
+#define BSP_PT_SIGNAL_UART_TX(uart)	(1u << (2 + (uart)))	/* Hay hueco en el búfer de transmisión */
+#define BSP_PT_SIGNAL_TIMER			(1u << 4)				/* Ha vencido el plazo de alguna corrutina */
+#define BSP_PT_SIGNAL_KBI(n)		(1u << (8 + (n)))		/* Flanco de subida en KBI4 a KBI7 */
+#define BSP_PT_SIGNAL_USER(n)		(1u << (16 + (n)))		/* Señales de la aplicación, de 0 a 15 */
+
+/*****************************************************************************/
+
+/**
+ * Definición para las funciones de las corrutinas
+ * @param bpt	Corrutina
+ * @param ctx	Contexto indicado al arrancarla
+ * @return	PT_WAITING, PT_YIELDED, PT_EXITED o PT_ENDED (ver "pt.h")
+ */
+typedef struct bsp_pt bsp_pt_t;
+typedef int8_t (* bsp_pt_func_t) (bsp_pt_t *bpt, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Corrutina. La reserva la aplicación y sólo ocupa esta estructura: las
+ * corrutinas comparten la pila del bucle que las ejecuta
+ */
+struct bsp_pt
+{
+	pt_t pt;					/* Continuación */
+	uint32_t wait;				/* Señales que espera, 0 para ejecutarse en cada pasada */
+	uint32_t got;				/* Señales esperadas que han llegado */
+	uint32_t deadline;			/* Vencimiento de su plazo, en ms (ver bsp_pt_now) */
+	bsp_pt_func_t func;
+	void *ctx;
+	bsp_pt_t *next;
+};
+
+/*****************************************************************************/
+
+/**
+ * Cuerpo de una corrutina
+ * @param bpt	Corrutina
+ */
+#define BSP_PT_BEGIN(bpt)	PT_BEGIN (&(bpt)->pt)
+#define BSP_PT_END(bpt)		PT_END (&(bpt)->pt)
+
+/*****************************************************************************/
+
+/**
+ * Espera a que se cumpla una condición. Mientras no se cumple, la corrutina
+ * sólo se vuelve a ejecutar cuando llega alguna de las señales indicadas
+ * @param bpt		Corrutina
+ * @param signals	Señales que pueden cambiar la condición (ver BSP_PT_SIGNAL_UART_RX, ...)
+ * @param cond		Condición
+ */
+#define BSP_PT_WAIT_UNTIL(bpt, signals, cond)	\
+	do {										\
+		(bpt)->wait = (signals);				\
+		PT_WAIT_UNTIL (&(bpt)->pt, (cond));		\
+		(bpt)->wait = 0;						\
+	} while (0)
+
+/*****************************************************************************/
+
+/**
+ * Espera a que llegue alguna de las señales indicadas después de empezar a
+ * esperar. Sirve para los flancos de los pines KBI y las señales de la
+ * aplicación, que no dejan un estado que se pueda consultar
+ * @param bpt		Corrutina
+ * @param signals	Señales
+ */
+#define BSP_PT_WAIT_SIGNAL(bpt, signals)		\
+	do {										\
+		(bpt)->got &= ~(signals);				\
+		BSP_PT_WAIT_UNTIL ((bpt), (signals), (bpt)->got & (signals));	\
+	} while (0)
+
+/*****************************************************************************/
+
+/**
+ * Esperas sobre las uart: datos en el búfer de recepción y hueco en el de
+ * transmisión. También con la recepción por FIQ, cuyo manejador cede la fuente
+ * a uart_isr tras copiar bytes para que envíe la señal
+ * @param bpt	Corrutina
+ * @param uart	Identificador de la uart
+ */
+#define BSP_PT_WAIT_UART_RX(bpt, uart)	\
+	BSP_PT_WAIT_UNTIL ((bpt), BSP_PT_SIGNAL_UART_RX (uart), uart_rx_count (uart) > 0)
+
+#define BSP_PT_WAIT_UART_TX(bpt, uart)	\
+	BSP_PT_WAIT_UNTIL ((bpt), BSP_PT_SIGNAL_UART_TX (uart), uart_tx_space (uart) > 0)
+
+/*****************************************************************************/
+
+/**
+ * Duerme una corrutina
+ * @param bpt	Corrutina
+ * @param ms	Milisegundos
+ */
+#define BSP_PT_SLEEP(bpt, ms)					\
+	do {										\
+		bsp_pt_set_timer ((bpt), (ms));			\
+		BSP_PT_WAIT_UNTIL ((bpt), BSP_PT_SIGNAL_TIMER, bsp_pt_timer_expired (bpt));	\
+	} while (0)
+
+/*****************************************************************************/
+
+/**
+ * Arranca una corrutina, que se ejecuta por primera vez en la siguiente pasada
+ * de bsp_pt_run. Se puede llamar desde otra corrutina, pero no desde una isr
+ * @param bpt	Corrutina, que no debe estar en marcha
+ * @param func	Función de la corrutina
+ * @param ctx	Contexto que se pasa a la función
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_pt_start (bsp_pt_t *bpt, bsp_pt_func_t func, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Detiene una corrutina en marcha sin ejecutarla más
+ * @param bpt	Corrutina
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOENT si no estaba
+ * 			en marcha).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_pt_stop (bsp_pt_t *bpt);
+
+/*****************************************************************************/
+
+/**
+ * Hace una pasada por las corrutinas en marcha, ejecutando las que no esperan
+ * ninguna señal y las que esperan alguna de las que han llegado. Las que
+ * terminan se retiran. Después programa un temporizador software con el plazo
+ * más próximo
+ * @return	1 si alguna corrutina quiere ejecutarse en la siguiente pasada sin
+ * 			esperar señales, 0 si se puede llamar a bsp_idle
+ */
+uint32_t bsp_pt_run (void);
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta las corrutinas para siempre, esperando en bsp_idle mientras todas
+ * están bloqueadas. Es el bucle principal de una aplicación hecha sólo de
+ * corrutinas
+ */
+void bsp_pt_loop (void) __attribute__ ((noreturn));
+
+/*****************************************************************************/
+
+/**
+ * Envía señales a las corrutinas. Se puede llamar desde una isr
+ * @param signals	Señales (ver BSP_PT_SIGNAL_USER, ...)
+ */
+void bsp_pt_signal (uint32_t signals);
+
+/*****************************************************************************/
+
+/**
+ * Retorna las señales que han llegado desde la última pasada. El gestor de
+ * bajo consumo no duerme si hay alguna
+ * @return	Máscara de señales
+ */
+uint32_t bsp_pt_pending (void);
+
+/*****************************************************************************/
+
+/**
+ * Tiempo en milisegundos, que da la vuelta cada 49 días. Sólo se compara
+ * mediante diferencias
+ * @return	Milisegundos desde el arranque del reloj monótono
+ */
+uint32_t bsp_pt_now (void);
+
+/*****************************************************************************/
+
+/**
+ * Fija el plazo de una corrutina. Se combina con cualquier espera añadiendo
+ * BSP_PT_SIGNAL_TIMER a sus señales y bsp_pt_timer_expired a su condición
+ * @param bpt	Corrutina
+ * @param ms	Milisegundos desde ahora
+ */
+static inline void bsp_pt_set_timer (bsp_pt_t *bpt, uint32_t ms)
+{
+	bpt->deadline = bsp_pt_now () + ms;
+}
+
+/**
+ * Indica si ha vencido el plazo de una corrutina
+ * @param bpt	Corrutina
+ * @return	1 si ha vencido, 0 en otro caso
+ */
+static inline uint32_t bsp_pt_timer_expired (bsp_pt_t *bpt)
+{
+	return (int32_t) (bsp_pt_now () - bpt->deadline) >= 0;
+}
+
+/*****************************************************************************/
+
+#endif /* __PROTOTHREAD_H__ */
@@ -0,0 +1,106 @@
+/*
+ * Sistemas operativos empotrados
+ * Llamadas al sistema mediante SWI
+ */
+
+#ifndef __SWI_H__
+#define __SWI_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Números de SWI. Los servicios rápidos modifican los bits I y F del código
+ * que hace la llamada y se resuelven en ensamblador. El resto se despachan a
+ * través de la tabla de manejadores, en modo SVC
+ */
+typedef enum
+{
+	bsp_swi_disable_ints = 0,	/* Servicio rápido: excep_disable_ints */
+	bsp_swi_disable_irq,		/* Servicio rápido: excep_disable_irq */
+	bsp_swi_disable_fiq,		/* Servicio rápido: excep_disable_fiq */
+	bsp_swi_restore_ints,		/* Servicio rápido: excep_restore_ints */
+	bsp_swi_restore_irq,		/* Servicio rápido: excep_restore_irq */
+	bsp_swi_restore_fiq,		/* Servicio rápido: excep_restore_fiq */
+	bsp_swi_switch,				/* Servicio rápido: cambio de tarea (ver kernel.h) */
+	bsp_swi_sbrk,				/* _sbrk */
+	bsp_swi_ioctl,				/* bsp_ioctl */
+	bsp_swi_user				/* Primer número libre para la aplicación */
+} bsp_swi_t;
+
+/**
+ * Tamaño de la tabla de manejadores (debe coincidir con _SWI_MAX en swi_asm.s)
+ */
+#define BSP_SWI_MAX		16
+
+/*****************************************************************************/
+
+/**
+ * Prototipo para los manejadores de SWI. Reciben los argumentos en r0-r3 y
+ * retornan el resultado en r0. Se ejecutan en modo SVC con los bits I y F del
+ * código que hace la llamada
+ */
+typedef int32_t (* bsp_swi_handler_t) (uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+/*****************************************************************************/
+
+/**
+ * Hace una llamada al sistema. El número debe ser una constante.
+ * Los manejadores de la tabla son funciones C que pueden modificar r0-r3, y
+ * desde modo SVC la llamada sobrescribe lr_svc, por lo que se indica al
+ * compilador que los modifica
+ * @param num	Número de SWI (ver bsp_swi_t)
+ * @param a0	Primer argumento (r0)
+ * @param a1	Segundo argumento (r1)
+ * @param a2	Tercer argumento (r2)
+ * @return		Resultado del manejador (r0)
+ */
+#define BSP_SWI(num, a0, a1, a2)										\
+	({																	\
+		register uint32_t __r0 asm ("r0") = (uint32_t) (a0);			\
+		register uint32_t __r1 asm ("r1") = (uint32_t) (a1);			\
+		register uint32_t __r2 asm ("r2") = (uint32_t) (a2);			\
+		asm volatile ("swi %[n]"										\
+				: "+r" (__r0), "+r" (__r1), "+r" (__r2)					\
+				: [n] "i" (num)											\
+				: "r3", "r12", "lr", "memory", "cc");					\
+		(int32_t) __r0;													\
+	})
+
+/*****************************************************************************/
+
+/**
+ * Indica si el procesador está en modo USER, en el que las operaciones
+ * privilegiadas se deben hacer mediante una SWI
+ * @return	1 en modo USER, 0 en los modos privilegiados
+ */
+static inline uint32_t bsp_in_user_mode (void)
+{
+	uint32_t cpsr;
+
+	asm volatile ("mrs %[cpsr], cpsr" : [cpsr] "=r" (cpsr));
+	return (cpsr & 0x1F) == 0x10;
+}
+
+/*****************************************************************************/
+
+/**
+ * Asigna un manejador de SWI
+ * @param num		Número de SWI, a partir de bsp_swi_sbrk
+ * @param handler	Manejador. NULL para anular una selección anterior
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_swi_set_handler (uint32_t num, bsp_swi_handler_t handler);
+
+/*****************************************************************************/
+
+/**
+ * Manejador en ensamblador de la excepción SWI
+ */
+void excep_swi_handler ();
+
+/*****************************************************************************/
+
+#endif /* __SWI_H__ */
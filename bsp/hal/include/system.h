@@ -7,11 +7,23 @@
 #define __SYSTEM_H_
 
 #include "excep.h"
+#include "swi.h"
 #include "dev.h"
+#include "arena.h"
+#include "idle.h"
+#include "defer.h"
+#include "event.h"
+#include "timer.h"
+#include "power.h"
+#include "kernel.h"
+#include "protothread.h"
+#include "crash.h"
 
 #include "itc.h"
 #include "gpio.h"
 #include "uart.h"
+#include "tmr.h"
+#include "crm.h"
 
 /*
  * Configuración de la CPU
@@ -26,6 +38,12 @@
 /* Máximo número de ficheros (dispositivos) abiertos simultánemente */
 #define BSP_MAX_FD 8
 
+/* Elementos de trabajo diferido que pueden estar pendientes (potencia de dos) */
+#define BSP_DEFER_POOL_SIZE 16
+
+/* Eventos que caben en cada cola de prioridad del despachador (potencia de dos) */
+#define BSP_EVENT_QUEUE_SIZE 16
+
 /*
  * Configuración del GPIO
  */
@@ -40,11 +58,17 @@
 #define UART1_ID		(uart_1)
 #define UART1_BAUDRATE	(115200)
 #define UART1_NAME 		"/dev/uart1"
+#define UART1_RX_BUFFER_SIZE	(256)		/* Potencia de dos, 0 deshabilita la recepción */
+#define UART1_TX_BUFFER_SIZE	(256)		/* Potencia de dos, 0 deshabilita la transmisión */
 
 #define UART2_BASE 		((void *) 0x8000b000)
 #define UART2_ID		(uart_2)
 #define UART2_BAUDRATE	(115200)
 #define UART2_NAME 		"/dev/uart2"
+#define UART2_RX_BUFFER_SIZE	(256)		/* Potencia de dos, 0 deshabilita la recepción */
+#define UART2_TX_BUFFER_SIZE	(256)		/* Potencia de dos, 0 deshabilita la transmisión */
+
+#define UART_BAUDRATE_TOLERANCE	(10000)		/* Error máximo de la velocidad, en ppm */
 
 /*
  * Configuración de E/S estándar
@@ -53,10 +77,57 @@
 #define BSP_STDIN      UART1_NAME
 #define BSP_STDERR     UART1_NAME
 
+/*
+ * Configuración de los temporizadores
+ */
+#define TMR_BASE		((void *) 0x80007000)
+#define TMR_CLOCK_ID	(tmr_0)				/* Canal del reloj monótono */
+#define TMR_PRESCALER	(3)					/* El reloj de periféricos se divide entre 2^TMR_PRESCALER (0 a 7) */
+#define TMR_TICK_HZ		(CPU_FREQ >> TMR_PRESCALER)
+#define TMR_MIN_TICKS	(64)				/* Intervalo mínimo, mayor que la latencia de la isr */
+
+/*
+ * Configuración de los temporizadores software
+ */
+#define BSP_TIMER_TMR		(tmr_3)			/* Canal que comparten todos */
+#define BSP_TIMER_SHIFT		(9)				/* Resolución: 2^BSP_TIMER_SHIFT ticks (170 us) */
+#define BSP_TIMER_POOL_SIZE	(32)			/* Temporizadores activos a la vez */
+
+/*
+ * Configuración del CRM
+ */
+#define CRM_BASE		((void *) 0x80003000)
+#define CRM_SLEEP_HZ	(2000)				/* Oscilador en anillo del temporizador de despertar, sin calibrar */
+
+/*
+ * Configuración del gestor de bajo consumo
+ */
+#define BSP_POWER_WAKEUP			(BSP_POWER_WAKE_UART1)	/* Fuentes de despertar por defecto: la E/S estándar */
+#define BSP_POWER_DOZE_LATENCY_US	(50)		/* Coste de salir de doze */
+#define BSP_POWER_DOZE_MIN_US		(500)		/* Inactividad mínima para entrar en doze */
+#define BSP_POWER_HIB_LATENCY_US	(3000)		/* Coste de salir de hibernate (arranque del oscilador) */
+#define BSP_POWER_HIB_MIN_US		(30000)		/* Inactividad mínima para entrar en hibernate */
+
+/*
+ * Configuración del núcleo de tareas (requiere excep_nested_irq_handler)
+ */
+#define BSP_KERNEL_TMR			(tmr_1)		/* Canal del tick */
+#define BSP_KERNEL_TICK_HZ		(1000)		/* Frecuencia del tick y del reparto entre tareas de igual prioridad */
+#define BSP_KERNEL_PRIO_MAX		(8)			/* Número de prioridades, como mucho 32 */
+#define BSP_KERNEL_ISR_STACK	(256)		/* Margen de cada pila para las isr anidadas (el trabajo diferido tiene su pila) */
+
 /*
  * Configuración del ITC
  */
 #define ITC_BASE		((void *) 0x80020000)
+/* #define ITC_PROFILING */					/* Mide la espera y duración de los manejadores */
+#define ITC_PROF_TICK_HZ	TMR_TICK_HZ		/* El perfilador usa el reloj monótono */
+
+/*
+ * Configuración de las excepciones
+ */
+/* Sin anidar, la aplicación ejecuta el trabajo diferido con bsp_run_deferred */
+#define EXCEP_IRQ_HANDLER	excep_nested_irq_handler	/* excep_nonnested_irq_handler para no anidar */
 
 
 #endif /* __SYSTEM_H_ */
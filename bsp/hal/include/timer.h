@@ -0,0 +1,73 @@
+/*
+ * Sistemas operativos empotrados
+ * Temporizadores software
+ */
+
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Definición para las funciones de callback de los temporizadores software.
+ * Se ejecutan como trabajo diferido (ver bsp_defer), fuera de la isr y con las
+ * interrupciones habilitadas. Pueden añadir y cancelar temporizadores,
+ * incluido el que las llama
+ * @param id	Identificador del temporizador
+ * @param ctx	Contexto indicado al arrancar el temporizador
+ */
+typedef void (* bsp_timer_callback_t) (int32_t id, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Inicializa los temporizadores software. Todos comparten el canal
+ * BSP_TIMER_TMR (ver "system.h"), que se programa con el vencimiento más
+ * próximo, de modo que no hay interrupciones periódicas
+ */
+void bsp_timer_init (void);
+
+/*****************************************************************************/
+
+/**
+ * Arranca un temporizador software. El coste no depende del número de
+ * temporizadores activos. La resolución es de 2^BSP_TIMER_SHIFT ticks del
+ * reloj, y nunca vence antes de tiempo
+ * @param us		Microsegundos hasta el vencimiento
+ * @param period_us	Periodo en microsegundos, 0 para un temporizador de un disparo
+ * @param func		Función callback
+ * @param ctx		Contexto que se pasa a la callback
+ * @return	El identificador del temporizador o -1 en caso de error (EAGAIN si
+ * 			no quedan temporizadores libres).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_timer_start (uint32_t us, uint32_t period_us, bsp_timer_callback_t func, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Cancela un temporizador software
+ * @param id	Identificador del temporizador
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOENT si ya ha
+ * 			vencido o se había cancelado).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_timer_cancel (int32_t id);
+
+/*****************************************************************************/
+
+/**
+ * Calcula el instante del reloj monótono (ver tmr_now) en que los temporizadores
+ * software tienen trabajo pendiente
+ * @param deadline	Destino del instante
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOENT si no hay
+ * 			temporizadores activos).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_timer_next (uint64_t *deadline);
+
+/*****************************************************************************/
+
+#endif /* __TIMER_H__ */
@@ -0,0 +1,600 @@
+/*
+ * Sistemas operativos empotrados
+ * Núcleo de tareas expulsivo por prioridades fijas
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Contexto guardado en la pila de una tarea (ver kernel_asm.s): spsr, pc,
+ * r4-r11, r0-r3, r12 y lr
+ */
+#define BSP_KERNEL_FRAME_WORDS	16
+#define BSP_KERNEL_FRAME_R4		2
+#define BSP_KERNEL_FRAME_R0		10
+#define BSP_KERNEL_USR_MODE		0x10
+
+/**
+ * Patrón con el que se rellenan las pilas para medir su uso
+ */
+#define BSP_KERNEL_STACK_FILL	0xA5A5A5A5u
+
+/**
+ * Primera instrucción de las tareas (ver kernel_asm.s)
+ */
+void bsp_kernel_task_entry (void);
+
+/*****************************************************************************/
+
+/**
+ * Colas de tareas listas, una por prioridad, y mapa de las que no están
+ * vacías. La tarea en ejecución sigue en su cola
+ */
+static bsp_task_t *bsp_kernel_ready_head[BSP_KERNEL_PRIO_MAX];
+static bsp_task_t *bsp_kernel_ready_tail[BSP_KERNEL_PRIO_MAX];
+static uint32_t bsp_kernel_ready_map = 0;
+
+/**
+ * Tareas con plazo, por orden de vencimiento
+ */
+static bsp_task_t *bsp_kernel_timed = NULL;
+
+/**
+ * Tarea en ejecución (NULL hasta bsp_kernel_start) y tarea ociosa
+ */
+static bsp_task_t *bsp_kernel_current = NULL;
+static bsp_task_t bsp_kernel_idle;
+
+/**
+ * Ticks desde bsp_kernel_start
+ */
+static volatile uint32_t bsp_kernel_tick_count = 0;
+
+/*****************************************************************************/
+
+/**
+ * Calcula la prioridad más alta de un mapa no vacío. El ARM7TDMI no tiene
+ * instrucción CLZ, así que se hace una búsqueda binaria
+ * @param map	Mapa de prioridades
+ * @return	Prioridad más alta
+ */
+static inline uint32_t bsp_kernel_highest (uint32_t map)
+{
+	uint32_t prio = 0;
+
+	if (map & 0xFFFF0000)
+	{
+		map >>= 16;
+		prio += 16;
+	}
+	if (map & 0xFF00)
+	{
+		map >>= 8;
+		prio += 8;
+	}
+	if (map & 0xF0)
+	{
+		map >>= 4;
+		prio += 4;
+	}
+	if (map & 0xC)
+	{
+		map >>= 2;
+		prio += 2;
+	}
+	if (map & 0x2)
+		prio += 1;
+
+	return prio;
+}
+
+/*****************************************************************************/
+
+/**
+ * Añade una tarea al final de la cola de listos de su prioridad.
+ * Todas las funciones internas se llaman con la IRQ deshabilitada
+ * @param task	Tarea
+ */
+static void bsp_kernel_ready_add (bsp_task_t *task)
+{
+	uint32_t prio = task->prio;
+
+	task->next = NULL;
+	if (bsp_kernel_ready_tail[prio])
+		bsp_kernel_ready_tail[prio]->next = task;
+	else
+		bsp_kernel_ready_head[prio] = task;
+	bsp_kernel_ready_tail[prio] = task;
+	bsp_kernel_ready_map |= 1 << prio;
+
+	/* Expulsa a la tarea en ejecución si es menos prioritaria */
+	if (bsp_kernel_current && prio > bsp_kernel_current->prio)
+		bsp_kernel_switch_pending = 1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Saca una tarea de la cola de listos de su prioridad
+ * @param task	Tarea
+ */
+static void bsp_kernel_ready_remove (bsp_task_t *task)
+{
+	uint32_t prio = task->prio;
+	bsp_task_t **link = &bsp_kernel_ready_head[prio];
+	bsp_task_t *prev = NULL;
+
+	while (*link != task)
+	{
+		prev = *link;
+		link = &prev->next;
+	}
+
+	*link = task->next;
+	if (bsp_kernel_ready_tail[prio] == task)
+		bsp_kernel_ready_tail[prio] = prev;
+	if (bsp_kernel_ready_head[prio] == NULL)
+		bsp_kernel_ready_map &= ~(1 << prio);
+	task->next = NULL;
+}
+
+/*****************************************************************************/
+
+/**
+ * Inserta una tarea en una cola de espera, detrás de las de su misma prioridad
+ * @param queue	Cola de espera
+ * @param task	Tarea
+ */
+static void bsp_kernel_queue_insert (bsp_task_t **queue, bsp_task_t *task)
+{
+	while (*queue && (*queue)->prio >= task->prio)
+		queue = &(*queue)->next;
+
+	task->next = *queue;
+	*queue = task;
+}
+
+/*****************************************************************************/
+
+/**
+ * Inserta una tarea en la lista de esperas con plazo
+ * @param task	Tarea
+ * @param ticks	Ticks hasta el vencimiento
+ */
+static void bsp_kernel_timed_insert (bsp_task_t *task, uint32_t ticks)
+{
+	bsp_task_t **link = &bsp_kernel_timed;
+
+	task->wake = bsp_kernel_tick_count + ticks;
+	while (*link && (int32_t) ((*link)->wake - task->wake) <= 0)
+		link = &(*link)->timer_next;
+
+	task->timer_next = *link;
+	*link = task;
+}
+
+/*****************************************************************************/
+
+/**
+ * Saca una tarea de la lista de esperas con plazo, si está en ella
+ * @param task	Tarea
+ */
+static void bsp_kernel_timed_remove (bsp_task_t *task)
+{
+	bsp_task_t **link = &bsp_kernel_timed;
+
+	while (*link && *link != task)
+		link = &(*link)->timer_next;
+
+	if (*link)
+		*link = task->timer_next;
+	task->timer_next = NULL;
+}
+
+/*****************************************************************************/
+
+/**
+ * Cambia la prioridad efectiva de una tarea, moviéndola de cola si está lista.
+ * En las colas de espera conserva su posición
+ * @param task	Tarea
+ * @param prio	Nueva prioridad
+ */
+static void bsp_kernel_set_prio (bsp_task_t *task, uint32_t prio)
+{
+	if (task->prio == prio)
+		return;
+
+	if (task->state == bsp_task_ready)
+	{
+		bsp_kernel_ready_remove (task);
+		task->prio = prio;
+		bsp_kernel_ready_add (task);
+	}
+	else
+		task->prio = prio;
+}
+
+/*****************************************************************************/
+
+/**
+ * Bloquea a la tarea en ejecución y cambia de tarea
+ * @param queue		Cola de espera o NULL
+ * @param timeout	Ticks máximos de espera o BSP_KERNEL_FOREVER
+ * @param state		Estado de la tarea mientras espera
+ * @return	El resultado que indique quien la despierta: 0, o -1 si vence el
+ * 			plazo
+ */
+static int32_t bsp_kernel_block (bsp_task_t **queue, uint32_t timeout, bsp_task_state_t state)
+{
+	bsp_task_t *task = bsp_kernel_current;
+
+	bsp_kernel_ready_remove (task);
+	task->state = state;
+	task->result = 0;
+	task->queue = queue;
+	if (queue)
+		bsp_kernel_queue_insert (queue, task);
+	if (timeout != BSP_KERNEL_FOREVER)
+		bsp_kernel_timed_insert (task, timeout);
+
+	bsp_kernel_switch_pending = 1;
+	bsp_kernel_switch ();
+
+	return task->result;
+}
+
+/*****************************************************************************/
+
+/**
+ * Despierta a una tarea bloqueada o dormida
+ * @param task		Tarea
+ * @param result	Resultado de su espera
+ */
+static void bsp_kernel_wake (bsp_task_t *task, int32_t result)
+{
+	bsp_task_t **queue = task->queue;
+
+	if (queue)
+	{
+		while (*queue != task)
+			queue = &(*queue)->next;
+		*queue = task->next;
+		task->queue = NULL;
+	}
+
+	bsp_kernel_timed_remove (task);
+	task->result = result;
+	task->state = bsp_task_ready;
+	bsp_kernel_ready_add (task);
+}
+
+/*****************************************************************************/
+
+/**
+ * Guarda el contexto de la tarea en ejecución y elige la siguiente, la más
+ * prioritaria de las listas. La llama kernel_asm.s en modo SYS con el bit I a 1
+ * @param sp	Contexto guardado en la pila de la tarea en ejecución
+ * @return	La tarea que pasa a ejecutarse
+ */
+bsp_task_t * bsp_kernel_select (uint32_t *sp)
+{
+	bsp_task_t *task = bsp_kernel_ready_head[bsp_kernel_highest (bsp_kernel_ready_map)];
+
+	bsp_kernel_current->sp = sp;
+	bsp_kernel_switch_pending = 0;
+
+	/* Una pila desbordada ya ha corrompido la memoria de debajo: se provoca una
+	 * excepción undefined para que quede en el registro de fallos */
+	if (bsp_kernel_current->stack && bsp_kernel_current->stack[0] != BSP_KERNEL_STACK_FILL)
+		asm volatile (".word 0xE7F000F0");
+
+	if (task != bsp_kernel_current)
+	{
+		task->switches++;
+		bsp_kernel_current = task;
+	}
+
+	return task;
+}
+
+/*****************************************************************************/
+
+/**
+ * Tarea en ejecución si puede bloquearse (ver bsp_kernel_in_task)
+ * @return	La tarea o NULL
+ */
+static bsp_task_t * bsp_kernel_task (void)
+{
+	if (bsp_kernel_current != &bsp_kernel_idle && bsp_in_user_mode ())
+		return bsp_kernel_current;
+
+	return NULL;
+}
+
+/**
+ * Operaciones que usan los semáforos y los mutex (ver bsp_kernel_ops_t)
+ */
+static const bsp_kernel_ops_t bsp_kernel_sched_ops =
+{
+	bsp_kernel_task,
+	bsp_kernel_block,
+	bsp_kernel_wake,
+	bsp_kernel_set_prio
+};
+
+/*****************************************************************************/
+
+/**
+ * Tick del núcleo, en la isr del temporizador BSP_KERNEL_TMR. Despierta a las
+ * tareas cuyo plazo ha vencido y turna a las de igual prioridad que la
+ * interrumpida
+ * @param tmr	Canal del temporizador
+ * @param ctx	No se usa
+ */
+static void bsp_kernel_tick (tmr_id_t tmr, void *ctx)
+{
+	bsp_task_t *task;
+	uint32_t now, i_bit;
+
+	i_bit = excep_disable_irq ();
+	now = ++bsp_kernel_tick_count;
+
+	while ((task = bsp_kernel_timed) != NULL && (int32_t) (now - task->wake) >= 0)
+		bsp_kernel_wake (task, task->queue ? -1 : 0);
+
+	task = bsp_kernel_current;
+	if (task->state == bsp_task_ready && bsp_kernel_ready_head[task->prio] == task && task->next)
+	{
+		bsp_kernel_ready_remove (task);
+		bsp_kernel_ready_add (task);
+		bsp_kernel_switch_pending = 1;
+	}
+
+	excep_restore_irq (i_bit);
+}
+
+/*****************************************************************************/
+
+/**
+ * Crea una tarea lista para ejecutarse. Antes de bsp_kernel_start sólo la
+ * prepara; después puede expulsar a la tarea que la crea.
+ * Las tareas se ejecutan en modo USER y las de mayor prioridad expulsan a las
+ * de menor en cuanto están listas. Las de igual prioridad se turnan en cada
+ * tick
+ * @param task	Bloque de control, que no debe estar en uso
+ * @param name	Nombre de la tarea
+ * @param prio	Prioridad, de 1 a BSP_KERNEL_PRIO_MAX - 1 (0 es la ociosa)
+ * @param func	Función de la tarea
+ * @param arg	Argumento que se pasa a la función
+ * @param stack	Pila de la tarea (ver BSP_TASK_STACK)
+ * @param size	Tamaño de la pila en bytes, al menos BSP_TASK_MIN_STACK
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_task_create (bsp_task_t *task, const char *name, uint32_t prio,
+						 bsp_task_func_t func, void *arg, void *stack, uint32_t size)
+{
+	uint32_t *sp;
+	uint32_t i_bit;
+
+	if (task == NULL || func == NULL || stack == NULL || ((uint32_t) stack & 3) ||
+		prio == 0 || prio >= BSP_KERNEL_PRIO_MAX || size < BSP_TASK_MIN_STACK)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Contexto inicial: la tarea empieza en modo USER en bsp_kernel_task_entry */
+	memset (stack, 0xA5, size);
+	sp = (uint32_t *) (((uint32_t) stack + size) & ~7u) - BSP_KERNEL_FRAME_WORDS;
+	memset (sp, 0, BSP_KERNEL_FRAME_WORDS * sizeof (uint32_t));
+	sp[0] = BSP_KERNEL_USR_MODE;
+	sp[1] = (uint32_t) bsp_kernel_task_entry;
+	sp[BSP_KERNEL_FRAME_R4] = (uint32_t) func;
+	sp[BSP_KERNEL_FRAME_R0] = (uint32_t) arg;
+
+	memset (task, 0, sizeof (bsp_task_t));
+	task->sp = sp;
+	task->stack = (uint32_t *) stack;
+	task->stack_size = size;
+	task->name = name;
+	task->prio = prio;
+	task->base_prio = prio;
+	task->state = bsp_task_ready;
+
+	i_bit = excep_disable_irq ();
+	bsp_kernel_ready_add (task);
+	bsp_kernel_switch ();
+	excep_restore_irq (i_bit);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Arranca el núcleo y no retorna. La función que lo llama (normalmente main)
+ * pasa a ser la tarea ociosa, de prioridad 0, que usa la pila de modo SYS del
+ * arranque y detiene el procesador en bsp_idle cuando no hay otra lista
+ */
+void bsp_kernel_start (void)
+{
+	bsp_task_t *idle = &bsp_kernel_idle;
+	uint32_t i_bit = excep_disable_irq ();
+
+	memset (idle, 0, sizeof (bsp_task_t));
+	idle->name = "idle";
+	idle->state = bsp_task_ready;
+	bsp_kernel_ready_add (idle);
+	bsp_kernel_current = idle;
+	bsp_kernel_ops = &bsp_kernel_sched_ops;
+
+	tmr_start (BSP_KERNEL_TMR, BSP_KERNEL_TMR_TICKS, tmr_periodic, bsp_kernel_tick, NULL);
+
+	bsp_kernel_switch_pending = 1;
+	bsp_kernel_switch ();
+	excep_restore_irq (i_bit);
+
+	for (;;)
+		bsp_idle ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Ticks transcurridos desde bsp_kernel_start, a BSP_KERNEL_TICK_HZ
+ * @return	Número de ticks
+ */
+uint32_t bsp_kernel_ticks (void)
+{
+	return bsp_kernel_tick_count;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna la tarea en ejecución
+ * @return	El bloque de control o NULL si el núcleo no está en marcha
+ */
+bsp_task_t * bsp_task_self (void)
+{
+	return bsp_kernel_current;
+}
+
+/*****************************************************************************/
+
+/**
+ * Cede la CPU a las demás tareas listas de la misma prioridad
+ */
+void bsp_task_yield (void)
+{
+	bsp_task_t *task = bsp_kernel_current;
+	uint32_t i_bit;
+
+	if (!bsp_kernel_in_task ())
+		return;
+
+	i_bit = excep_disable_irq ();
+	if (task->next)
+	{
+		bsp_kernel_ready_remove (task);
+		bsp_kernel_ready_add (task);
+		bsp_kernel_switch_pending = 1;
+	}
+	bsp_kernel_switch ();
+	excep_restore_irq (i_bit);
+}
+
+/*****************************************************************************/
+
+/**
+ * Duerme la tarea en ejecución. Fuera de una tarea espera activamente
+ * @param ticks	Ticks a dormir (ver BSP_KERNEL_MS)
+ */
+void bsp_task_sleep (uint32_t ticks)
+{
+	uint64_t deadline;
+	uint32_t i_bit;
+
+	if (ticks == 0)
+	{
+		bsp_task_yield ();
+		return;
+	}
+
+	if (bsp_kernel_in_task ())
+	{
+		i_bit = excep_disable_irq ();
+		bsp_kernel_block (NULL, ticks, bsp_task_sleeping);
+		excep_restore_irq (i_bit);
+		return;
+	}
+
+	deadline = tmr_now () + (uint64_t) ticks * BSP_KERNEL_TMR_TICKS;
+	while (tmr_now () < deadline)
+		bsp_idle ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Termina la tarea en ejecución
+ */
+void bsp_task_exit (void)
+{
+	bsp_task_t *task = bsp_kernel_current;
+
+	excep_disable_irq ();
+	if (bsp_kernel_in_task ())
+	{
+		bsp_kernel_ready_remove (task);
+		task->state = bsp_task_finished;
+		bsp_kernel_switch_pending = 1;
+		bsp_kernel_switch ();
+	}
+
+	/* Fuera de una tarea no hay a quién ceder la CPU */
+	excep_restore_irq (0);
+	for (;;)
+		bsp_idle ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Cambia la prioridad asignada a una tarea
+ * @param task	Tarea
+ * @param prio	Prioridad, de 1 a BSP_KERNEL_PRIO_MAX - 1
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_task_set_priority (bsp_task_t *task, uint32_t prio)
+{
+	uint32_t i_bit;
+
+	if (task == NULL || task == &bsp_kernel_idle || prio == 0 || prio >= BSP_KERNEL_PRIO_MAX)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	i_bit = excep_disable_irq ();
+
+	/* Mientras posea algún mutex conserva la prioridad heredada si es mayor */
+	task->base_prio = prio;
+	if (task->held == 0 || prio > task->prio)
+		bsp_kernel_set_prio (task, prio);
+
+	bsp_kernel_switch_pending = 1;
+	bsp_kernel_switch ();
+	excep_restore_irq (i_bit);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Calcula cuánta pila no ha llegado a usar nunca una tarea
+ * @param task	Tarea
+ * @return	Bytes libres en el peor caso observado
+ */
+uint32_t bsp_task_stack_free (bsp_task_t *task)
+{
+	uint32_t i, words;
+
+	if (task == NULL || task->stack == NULL)
+		return 0;
+
+	words = task->stack_size / sizeof (uint32_t);
+	for (i = 0; i < words && task->stack[i] == BSP_KERNEL_STACK_FILL; i++);
+
+	return i * sizeof (uint32_t);
+}
+
+/*****************************************************************************/
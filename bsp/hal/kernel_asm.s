@@ -0,0 +1,113 @@
+@
+@ Sistemas Empotrados
+@ Cambio de contexto del núcleo de tareas
+@
+@ El contexto de una tarea se guarda en su propia pila (la de los modos USER y
+@ SYS) y el puntero de pila resultante en el primer campo de bsp_task_t:
+@
+@	sp ->	spsr, pc, r4-r11, r0-r3, r12, lr
+@
+@ Se restaura siempre igual, retornando desde el modo IRQ, así que da igual que
+@ se guardara al salir de una interrupción o en la SWI de cambio de tarea.
+@ Los cambios de modo sólo tocan el campo de modo y el bit I, y conservan el
+@ bit F
+@
+
+	.set _IRQ_DISABLE, 0x80 @ cuando el bit I está activo, IRQ está deshabilitado
+	.set _FIQ_DISABLE, 0x40 @ cuando el bit F está activo, FIQ está deshabilitado
+
+	.set _MODE_MASK, 0x1F
+	.set _USR_MODE, 0x10
+	.set _IRQ_MODE, 0x12
+	.set _SYS_MODE, 0x1F
+
+	.code 32
+	.text
+
+@
+@ Cambio de tarea al retornar de una interrupción a una tarea. Lo llama
+@ excep_nested_irq_handler en modo SYS con el bit I a 1, con r0-r3, r12 y lr
+@ guardados en la pila de la tarea y el spsr y la dirección de retorno en la
+@ pila del modo IRQ, que se vacía
+@
+	.align	4
+	.global	bsp_kernel_irq_switch
+	.type	bsp_kernel_irq_switch, %function
+bsp_kernel_irq_switch:
+	stmfd	sp!, {r4-r11}
+	mrs	r2, cpsr
+	bic	r2, r2, #_MODE_MASK
+	orr	r2, r2, #_IRQ_MODE
+	msr	cpsr_c, r2
+	ldmfd	sp!, {r0, r1}			@ r0 <- spsr, r1 <- dirección de retorno
+	orr	r2, r2, #_SYS_MODE
+	msr	cpsr_c, r2
+	stmfd	sp!, {r0, r1}
+	b	bsp_kernel_switch_context
+	.size	bsp_kernel_irq_switch, .-bsp_kernel_irq_switch
+
+@
+@ Servicio rápido bsp_swi_switch (ver swi_asm.s). Lo llama excep_swi_handler
+@ con r4, r5, r12 y lr guardados en la pila del modo SVC y el cpsr del llamante
+@ en r4. Sólo las tareas (modo USER) pueden ceder la CPU. La SWI no conserva
+@ r3 ni r12 (ver BSP_SWI), así que sirven para llevar el cpsr y la dirección
+@ de retorno a la pila de la tarea
+@
+	.align	4
+	.global	bsp_kernel_swi_switch
+	.type	bsp_kernel_swi_switch, %function
+bsp_kernel_swi_switch:
+	and	r12, r4, #_MODE_MASK
+	cmp	r12, #_USR_MODE
+	ldmnefd	sp!, {r4, r5, r12, pc}^
+
+	mov	r3, r4				@ r3 <- cpsr del llamante
+	ldmfd	sp!, {r4, r5, r12, lr}
+	mov	r12, lr				@ r12 <- dirección de retorno
+	mrs	lr, cpsr			@ lr_svc ya no hace falta
+	orr	lr, lr, #(_SYS_MODE | _IRQ_DISABLE)
+	msr	cpsr_c, lr
+	stmfd	sp!, {r0-r3, r12, lr}
+	stmfd	sp!, {r4-r11}
+	stmfd	sp!, {r3, r12}
+
+	@ Guarda el contexto, elige la siguiente tarea y restaura su contexto
+bsp_kernel_switch_context:
+	mov	r0, sp
+	ldr	r1, =bsp_kernel_select
+	mov	lr, pc
+	bx	r1				@ r0 <- tarea que pasa a ejecutarse
+	ldr	sp, [r0]
+
+	ldmfd	sp!, {r0, r1}			@ r0 <- spsr, r1 <- dirección de retorno
+	mrs	r2, cpsr
+	bic	r2, r2, #_MODE_MASK
+	orr	r2, r2, #_IRQ_MODE
+	msr	cpsr_c, r2
+	msr	spsr_cxsf, r0
+	stmfd	sp!, {r1}
+	orr	r2, r2, #_SYS_MODE
+	msr	cpsr_c, r2
+	ldmfd	sp!, {r4-r11}
+
+	@ Sin registros libres, el bit F se conserva eligiendo la instrucción con
+	@ los flags, que ldm no cambia y que el retorno restaura del spsr
+	tst	r2, #_FIQ_DISABLE
+	ldmfd	sp!, {r0-r3, r12, lr}
+	msreq	cpsr_c, #(_IRQ_MODE | _IRQ_DISABLE)
+	msrne	cpsr_c, #(_IRQ_MODE | _IRQ_DISABLE | _FIQ_DISABLE)
+	ldmfd	sp!, {pc}^			@ Retorno restaurando cpsr <- spsr
+	.size	bsp_kernel_swi_switch, .-bsp_kernel_swi_switch
+
+@
+@ Primera instrucción de las tareas (ver bsp_task_create). Llama a la función
+@ de la tarea, que está en r4, con su argumento en r0. Si retorna, la tarea
+@ termina
+@
+	.align	4
+	.global	bsp_kernel_task_entry
+	.type	bsp_kernel_task_entry, %function
+bsp_kernel_task_entry:
+	ldr	lr, =bsp_task_exit
+	bx	r4
+	.size	bsp_kernel_task_entry, .-bsp_kernel_task_entry
@@ -0,0 +1,216 @@
+/*
+ * Sistemas operativos empotrados
+ * Gestor de bajo consumo
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Fuentes de despertar y estado más profundo permitido
+ */
+static volatile uint32_t bsp_power_wakeup;
+static volatile bsp_power_state_t bsp_power_max_state;
+
+#define BSP_POWER_WAKE_UARTS	(BSP_POWER_WAKE_UART1 | BSP_POWER_WAKE_UART2)
+#define BSP_POWER_WAKE_ALL		(BSP_POWER_WAKE_UARTS | CRM_WAKE_KBI_ALL)
+
+/**
+ * Estadísticas
+ */
+static bsp_power_stats_t bsp_power_stats;
+
+/*****************************************************************************/
+
+/**
+ * Elige el estado de bajo consumo para un tiempo de inactividad
+ * @param idle_us	Microsegundos hasta el siguiente vencimiento, si timed vale 1
+ * @param timed		1 si hay algún temporizador en marcha
+ * @return	El estado elegido
+ */
+static bsp_power_state_t bsp_power_select (uint64_t idle_us, uint32_t timed)
+{
+	bsp_power_state_t state = bsp_power_max_state;
+	uint32_t wakeup = bsp_power_wakeup;
+
+	/* En hibernate las uart se paran, así que no pueden recibir ni terminar de
+	 * transmitir, y sin temporizador ni KBI no se despertaría nunca */
+	if (state == bsp_power_hibernate &&
+		((wakeup & BSP_POWER_WAKE_UARTS) || uart_tx_busy (uart_1) || uart_tx_busy (uart_2) ||
+		 (timed && idle_us < BSP_POWER_HIB_MIN_US) || (!timed && !(wakeup & CRM_WAKE_KBI_ALL))))
+		state = bsp_power_doze;
+
+	if (state == bsp_power_doze && timed && idle_us < BSP_POWER_DOZE_MIN_US)
+		state = bsp_power_run;
+
+	return state;
+}
+
+/*****************************************************************************/
+
+/**
+ * Función de bajo consumo instalada en bsp_idle. Comprueba que no haya trabajo
+ * diferido, eventos ni señales de las corrutinas pendientes y duerme con la
+ * IRQ deshabilitada, de modo que una interrupción que llegue entre la
+ * comprobación y la parada no se pierde: despierta a la CPU y se atiende al
+ * restaurar la IRQ
+ */
+static void bsp_power_idle (void)
+{
+	bsp_power_state_t state;
+	uint64_t now, deadline, idle_us = 0, timeout, slept_us;
+	uint32_t i_bit, timed, latency, slept, cause, kbi;
+
+	i_bit = excep_disable_irq ();
+
+	if (bsp_deferred_pending () || bsp_event_count () || bsp_pt_pending ())
+	{
+		excep_restore_irq (i_bit);
+		return;
+	}
+
+	now = tmr_now ();
+	timed = (tmr_next_expiry (&deadline) == 0);
+	if (timed && deadline > now)
+		idle_us = tmr_ticks_to_us (deadline - now);
+
+	state = bsp_power_select (idle_us, timed);
+	if (state == bsp_power_run)
+	{
+		excep_restore_irq (i_bit);
+		return;
+	}
+
+	/* Se despierta antes de tiempo lo que cuesta salir del estado */
+	latency = (state == bsp_power_hibernate) ? BSP_POWER_HIB_LATENCY_US : BSP_POWER_DOZE_LATENCY_US;
+	timeout = 0;
+	if (timed)
+	{
+		timeout = (idle_us > latency) ? ((idle_us - latency) * CRM_SLEEP_HZ) / 1000000 : 0;
+		if (timeout == 0)
+			timeout = 1;
+		if (timeout > 0xFFFFFFFF)
+			timeout = 0xFFFFFFFF;
+	}
+
+	kbi = bsp_power_wakeup & CRM_WAKE_KBI_ALL;
+	cause = crm_sleep ((state == bsp_power_hibernate) ? crm_hibernate : crm_doze,
+					   (uint32_t) timeout, kbi, &slept);
+
+	if (state == bsp_power_hibernate)
+	{
+		/* Los temporizadores han estado parados: se adelantan lo dormido */
+		slept_us = ((uint64_t) slept * 1000000) / CRM_SLEEP_HZ;
+		tmr_advance (((uint64_t) slept * TMR_TICK_HZ) / CRM_SLEEP_HZ);
+		bsp_power_stats.hibernates++;
+		bsp_power_stats.hibernate_us += slept_us;
+	}
+	else
+	{
+		bsp_power_stats.dozes++;
+		bsp_power_stats.doze_us += tmr_ticks_to_us (tmr_now () - now);
+	}
+
+	/* KBI0 a KBI7 son los GPIO22 a GPIO29 */
+	for (kbi = 4; kbi < 8; kbi++)
+		if (cause & CRM_WAKE_KBI (kbi))
+		{
+			bsp_event_notify (bsp_event_gpio, gpio_pin_22 + kbi, bsp_event_normal);
+			bsp_pt_signal (BSP_PT_SIGNAL_KBI (kbi));
+		}
+
+	excep_restore_irq (i_bit);
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa el gestor con las fuentes de despertar BSP_POWER_WAKEUP (ver
+ * "system.h") y lo instala como función de bajo consumo de bsp_idle.
+ * Cada vez que no hay trabajo diferido ni eventos pendientes, elige el estado
+ * más profundo permitido cuyo tiempo mínimo quepa antes del siguiente
+ * vencimiento de los temporizadores, y programa el temporizador de despertar
+ * del CRM para despertar a tiempo descontando el coste de salir del estado
+ */
+void bsp_power_init (void)
+{
+	crm_init ();
+
+	bsp_power_wakeup = BSP_POWER_WAKEUP;
+	bsp_power_max_state = bsp_power_hibernate;
+	memset (&bsp_power_stats, 0, sizeof (bsp_power_stats));
+
+	bsp_set_idle_hook (bsp_power_idle);
+}
+
+/*****************************************************************************/
+
+/**
+ * Selecciona las fuentes de despertar
+ * @param sources	Máscara de fuentes (ver BSP_POWER_WAKE_UART1, ...)
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_power_set_wakeup (uint32_t sources)
+{
+	if (sources & ~BSP_POWER_WAKE_ALL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	bsp_power_wakeup = sources;
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Limita el estado de bajo consumo más profundo, por ejemplo mientras un
+ * periférico necesita el oscilador de referencia
+ * @param state	Estado más profundo permitido
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_power_set_max_state (bsp_power_state_t state)
+{
+	if (state >= bsp_power_state_max)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	bsp_power_max_state = state;
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Copia las estadísticas del gestor
+ * @param stats	Destino de las estadísticas
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_power_get_stats (bsp_power_stats_t *stats)
+{
+	uint32_t i_bit;
+
+	if (stats == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	i_bit = excep_disable_irq ();
+	*stats = bsp_power_stats;
+	excep_restore_irq (i_bit);
+
+	return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,275 @@
+/*
+ * Sistemas operativos empotrados
+ * Planificador de corrutinas sin pila
+ */
+
+#include <errno.h>
+
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Corrutinas en marcha, por orden de arranque
+ */
+static bsp_pt_t *bsp_pt_list = NULL;
+
+/**
+ * Señales que han llegado desde la última pasada
+ */
+static volatile uint32_t bsp_pt_signals = 0;
+
+/**
+ * Temporizador software del plazo más próximo
+ */
+static volatile uint32_t bsp_pt_timer_armed = 0;
+static volatile int32_t bsp_pt_timer_id;
+static uint32_t bsp_pt_timer_deadline;
+
+/*****************************************************************************/
+
+/**
+ * Callback del temporizador software. Despierta a las corrutinas con plazo,
+ * que comprueban cada una el suyo
+ * @param id	Identificador del temporizador
+ * @param ctx	No se usa
+ */
+static void bsp_pt_timer_expire (int32_t id, void *ctx)
+{
+	if (bsp_pt_timer_armed && id == bsp_pt_timer_id)
+		bsp_pt_timer_armed = 0;
+
+	bsp_pt_signal (BSP_PT_SIGNAL_TIMER);
+}
+
+/*****************************************************************************/
+
+/**
+ * Programa el temporizador software con el plazo más próximo, si no lo estaba
+ * ya. Si el plazo ha vencido, envía la señal directamente
+ * @param timed		1 si alguna corrutina espera un plazo
+ * @param deadline	Plazo más próximo, en ms
+ * @param now		Instante actual, en ms
+ */
+static void bsp_pt_arm_timer (uint32_t timed, uint32_t deadline, uint32_t now)
+{
+	int32_t left = (int32_t) (deadline - now);
+	int32_t id;
+	uint32_t i_bit;
+
+	if (bsp_pt_timer_armed && (!timed || left <= 0 || bsp_pt_timer_deadline != deadline))
+	{
+		bsp_pt_timer_armed = 0;
+		bsp_timer_cancel (bsp_pt_timer_id);
+	}
+
+	if (!timed || bsp_pt_timer_armed)
+		return;
+
+	if (left <= 0)
+	{
+		bsp_pt_signal (BSP_PT_SIGNAL_TIMER);
+		return;
+	}
+
+	/* now está truncado a ms, así que el temporizador nunca vence antes que el
+	 * plazo. Con la IRQ deshabilitada la callback no puede ejecutarse antes de
+	 * que quede anotado */
+	i_bit = excep_disable_irq ();
+	id = bsp_timer_start ((uint32_t) left * 1000, 0, bsp_pt_timer_expire, NULL);
+	if (id >= 0)
+	{
+		bsp_pt_timer_id = id;
+		bsp_pt_timer_deadline = deadline;
+		bsp_pt_timer_armed = 1;
+	}
+	excep_restore_irq (i_bit);
+
+	/* Sin temporizadores libres se consulta el plazo en la siguiente pasada */
+	if (id < 0)
+		bsp_pt_signal (BSP_PT_SIGNAL_TIMER);
+}
+
+/*****************************************************************************/
+
+/**
+ * Arranca una corrutina, que se ejecuta por primera vez en la siguiente pasada
+ * de bsp_pt_run. Se puede llamar desde otra corrutina, pero no desde una isr
+ * @param bpt	Corrutina, que no debe estar en marcha
+ * @param func	Función de la corrutina
+ * @param ctx	Contexto que se pasa a la función
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_pt_start (bsp_pt_t *bpt, bsp_pt_func_t func, void *ctx)
+{
+	bsp_pt_t **link;
+
+	if (bpt == NULL || func == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (link = &bsp_pt_list; *link != NULL; link = &(*link)->next)
+		if (*link == bpt)
+		{
+			errno = EBUSY;
+			return -1;
+		}
+
+	PT_INIT (&bpt->pt);
+	bpt->wait = 0;
+	bpt->got = 0;
+	bpt->deadline = 0;
+	bpt->func = func;
+	bpt->ctx = ctx;
+	bpt->next = NULL;
+	*link = bpt;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Detiene una corrutina en marcha sin ejecutarla más
+ * @param bpt	Corrutina
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOENT si no estaba
+ * 			en marcha).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_pt_stop (bsp_pt_t *bpt)
+{
+	bsp_pt_t **link;
+
+	for (link = &bsp_pt_list; *link != NULL; link = &(*link)->next)
+		if (*link == bpt)
+		{
+			/* Se conserva next por si la pasada en curso está en ella */
+			*link = bpt->next;
+			return 0;
+		}
+
+	errno = ENOENT;
+	return -1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Hace una pasada por las corrutinas en marcha, ejecutando las que no esperan
+ * ninguna señal y las que esperan alguna de las que han llegado. Las que
+ * terminan se retiran. Después programa un temporizador software con el plazo
+ * más próximo
+ * @return	1 si alguna corrutina quiere ejecutarse en la siguiente pasada sin
+ * 			esperar señales, 0 si se puede llamar a bsp_idle
+ */
+uint32_t bsp_pt_run (void)
+{
+	bsp_pt_t **link = &bsp_pt_list;
+	bsp_pt_t *bpt;
+	uint32_t i_bit, signals, now, deadline = 0;
+	uint32_t busy = 0, timed = 0;
+	int8_t ret;
+
+	/* Las señales que lleguen durante la pasada se quedan para la siguiente */
+	i_bit = excep_disable_irq ();
+	signals = bsp_pt_signals;
+	bsp_pt_signals = 0;
+	excep_restore_irq (i_bit);
+
+	while ((bpt = *link) != NULL)
+	{
+		if (bpt->wait == 0 || (bpt->wait & signals))
+		{
+			bpt->got |= bpt->wait & signals;
+			ret = bpt->func (bpt, bpt->ctx);
+
+			/* Se ha detenido ella misma con bsp_pt_stop */
+			if (*link != bpt)
+				continue;
+
+			if (ret >= PT_EXITED)
+			{
+				*link = bpt->next;
+				continue;
+			}
+		}
+
+		link = &bpt->next;
+	}
+
+	/* Se recorren otra vez porque una corrutina puede detener a otra */
+	now = bsp_pt_now ();
+	for (bpt = bsp_pt_list; bpt != NULL; bpt = bpt->next)
+	{
+		if (bpt->wait == 0)
+			busy = 1;
+		else if ((bpt->wait & BSP_PT_SIGNAL_TIMER) &&
+				 (!timed || (int32_t) (bpt->deadline - deadline) < 0))
+		{
+			deadline = bpt->deadline;
+			timed = 1;
+		}
+	}
+
+	bsp_pt_arm_timer (timed, deadline, now);
+
+	return busy;
+}
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta las corrutinas para siempre, esperando en bsp_idle mientras todas
+ * están bloqueadas. Es el bucle principal de una aplicación hecha sólo de
+ * corrutinas
+ */
+void bsp_pt_loop (void)
+{
+	while (1)
+		if (!bsp_pt_run () && !bsp_pt_pending ())
+			bsp_idle ();
+}
+
+/*****************************************************************************/
+
+/**
+ * Envía señales a las corrutinas. Se puede llamar desde una isr
+ * @param signals	Señales (ver BSP_PT_SIGNAL_USER, ...)
+ */
+void bsp_pt_signal (uint32_t signals)
+{
+	uint32_t i_bit;
+
+	i_bit = excep_disable_irq ();
+	bsp_pt_signals |= signals;
+	excep_restore_irq (i_bit);
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna las señales que han llegado desde la última pasada. El gestor de
+ * bajo consumo no duerme si hay alguna
+ * @return	Máscara de señales
+ */
+uint32_t bsp_pt_pending (void)
+{
+	return bsp_pt_signals;
+}
+
+/*****************************************************************************/
+
+/**
+ * Tiempo en milisegundos, que da la vuelta cada 49 días. Sólo se compara
+ * mediante diferencias
+ * @return	Milisegundos desde el arranque del reloj monótono
+ */
+uint32_t bsp_pt_now (void)
+{
+	return (uint32_t) (tmr_now () / (TMR_TICK_HZ / 1000));
+}
+
+/*****************************************************************************/
@@ -0,0 +1,91 @@
+/*
+ * Sistemas operativos empotrados
+ * Llamadas al sistema mediante SWI
+ */
+
+#include <errno.h>
+#include <stdint.h>
+
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Prototipos de las llamadas que se atienden a través de la tabla
+ */
+void * _sbrk (intptr_t incr);
+
+/*****************************************************************************/
+
+/**
+ * Manejador de los números de SWI sin asignar. Lo usa también swi_asm.s para
+ * los números fuera de la tabla
+ * @return	-1. La condición de error (ENOSYS) se indica en la variable global errno
+ */
+int32_t bsp_swi_nosys (uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Manejador de la SWI de _sbrk
+ * @param incr	Tamaño del incremento solicitado (en bytes)
+ * @return		El antiguo límite del heap o -1 en caso de error
+ */
+static int32_t bsp_swi_sbrk_handler (uint32_t incr, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+	return (int32_t) _sbrk ((intptr_t) incr);
+}
+
+/*****************************************************************************/
+
+/**
+ * Manejador de la SWI de bsp_ioctl
+ * @param fd		Descriptor de fichero/dispositivo
+ * @param request	Operación solicitada
+ * @param arg		Argumento de la operación
+ * @return			El resultado de bsp_ioctl
+ */
+static int32_t bsp_swi_ioctl_handler (uint32_t fd, uint32_t request, uint32_t arg, uint32_t a3)
+{
+	return bsp_ioctl ((int) fd, request, (void *) arg);
+}
+
+/*****************************************************************************/
+
+/**
+ * Tabla de manejadores, indexada por el número de SWI. Los servicios rápidos
+ * no pasan por la tabla
+ */
+bsp_swi_handler_t bsp_swi_table[BSP_SWI_MAX] =
+{
+	[0 ... BSP_SWI_MAX - 1] = bsp_swi_nosys,
+	[bsp_swi_sbrk] = bsp_swi_sbrk_handler,
+	[bsp_swi_ioctl] = bsp_swi_ioctl_handler
+};
+
+/*****************************************************************************/
+
+/**
+ * Asigna un manejador de SWI
+ * @param num		Número de SWI, a partir de bsp_swi_sbrk
+ * @param handler	Manejador. NULL para anular una selección anterior
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_swi_set_handler (uint32_t num, bsp_swi_handler_t handler)
+{
+	if (num < bsp_swi_sbrk || num >= BSP_SWI_MAX)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	bsp_swi_table[num] = handler ? handler : bsp_swi_nosys;
+	return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,111 @@
+@
+@ Sistemas Empotrados
+@ Manejador de llamadas al sistema (SWI)
+@
+@ El número de servicio es el inmediato de la instrucción swi y los argumentos
+@ se pasan en r0-r3. Los servicios rápidos modifican los bits I y F del spsr,
+@ de modo que el código en modo USER puede usar secciones críticas basadas en
+@ el CPSR, o cambian de tarea (ver kernel_asm.s). El resto se despachan a través de bsp_swi_table (ver swi.c)
+@
+
+	.set _IRQ_DISABLE, 0x80 @ cuando el bit I está activo, IRQ está deshabilitado
+	.set _FIQ_DISABLE, 0x40 @ cuando el bit F está activo, FIQ está deshabilitado
+	.set _THUMB, 0x20
+
+	.set _SWI_FAST_MAX, 7	@ Servicios rápidos (ver bsp_swi_t)
+	.set _SWI_MAX, 16		@ Tamaño de la tabla (ver BSP_SWI_MAX)
+
+	@ Sólo el núcleo en marcha hace la SWI de cambio de tarea (ver
+	@ bsp_kernel_switch), así que una imagen sin núcleo no necesita enlazar
+	@ kernel_asm.s
+	.weak	bsp_kernel_swi_switch
+
+	.code 32
+	.text
+
+	.align	4
+	.global	excep_swi_handler
+	.type	excep_swi_handler, %function
+excep_swi_handler:
+	stmfd	sp!, {r4, r5, r12, lr}
+	mrs	r4, spsr			@ r4 <- cpsr del llamante, se conserva en las llamadas
+
+	@ Número de servicio a partir de la instrucción swi, en ARM o Thumb
+	tst	r4, #_THUMB
+	ldrneh	r12, [lr, #-2]
+	bicne	r12, r12, #0xFF00
+	ldreq	r12, [lr, #-4]
+	biceq	r12, r12, #0xFF000000
+
+	@ Servicios rápidos
+	cmp	r12, #_SWI_FAST_MAX
+	addlo	pc, pc, r12, lsl #2
+	b	2f
+	b	swi_disable_ints
+	b	swi_disable_irq
+	b	swi_disable_fiq
+	b	swi_restore_ints
+	b	swi_restore_irq
+	b	swi_restore_fiq
+	b	bsp_kernel_swi_switch	@ ver kernel_asm.s
+
+swi_disable_ints:
+	mov	r0, r4, lsr #6
+	and	r0, r0, #3
+	orr	r4, r4, #(_IRQ_DISABLE | _FIQ_DISABLE)
+	b	1f
+
+swi_disable_irq:
+	mov	r0, r4, lsr #7
+	and	r0, r0, #1
+	orr	r4, r4, #_IRQ_DISABLE
+	b	1f
+
+swi_disable_fiq:
+	mov	r0, r4, lsr #6
+	and	r0, r0, #1
+	orr	r4, r4, #_FIQ_DISABLE
+	b	1f
+
+swi_restore_ints:
+	bic	r4, r4, #(_IRQ_DISABLE | _FIQ_DISABLE)
+	and	r0, r0, #3
+	orr	r4, r4, r0, lsl #6
+	b	1f
+
+swi_restore_irq:
+	bic	r4, r4, #_IRQ_DISABLE
+	and	r0, r0, #1
+	orr	r4, r4, r0, lsl #7
+	b	1f
+
+swi_restore_fiq:
+	bic	r4, r4, #_FIQ_DISABLE
+	and	r0, r0, #1
+	orr	r4, r4, r0, lsl #6
+
+	@ Retorno restaurando cpsr <- spsr
+1:	msr	spsr_cxsf, r4
+	ldmfd	sp!, {r4, r5, r12, pc}^
+
+	@ Servicios de la tabla, con los bits I y F del llamante
+2:	cmp	r12, #_SWI_MAX
+	ldrlo	r5, =bsp_swi_table
+	ldrlo	r12, [r5, r12, lsl #2]
+	ldrhs	r12, =bsp_swi_nosys
+
+	and	r5, r4, #(_IRQ_DISABLE | _FIQ_DISABLE)
+	mrs	lr, cpsr
+	bic	lr, lr, #(_IRQ_DISABLE | _FIQ_DISABLE)
+	orr	lr, lr, r5
+	msr	cpsr_c, lr
+
+	mov	lr, pc
+	bx	r12
+
+	@ Una SWI anidada desde una isr sobrescribiría spsr_svc
+	mrs	r12, cpsr
+	orr	r12, r12, #_IRQ_DISABLE
+	msr	cpsr_c, r12
+	b	1b
+	.size	excep_swi_handler, .-excep_swi_handler
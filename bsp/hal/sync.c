@@ -0,0 +1,367 @@
+/*
+ * Sistemas operativos empotrados
+ * Semáforos y mutex del núcleo de tareas
+ *
+ * Los drivers los usan aunque la aplicación no arranque el núcleo, así que
+ * sólo llegan al planificador a través de bsp_kernel_ops, que instala
+ * bsp_kernel_start. Sin núcleo las esperas se hacen en bsp_idle
+ */
+
+#include <errno.h>
+
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Operaciones del planificador, NULL mientras el núcleo no está en marcha
+ */
+const bsp_kernel_ops_t *bsp_kernel_ops = NULL;
+
+/**
+ * Distinto de cero si hay que cambiar de tarea. Lo consulta
+ * excep_nested_irq_handler antes de retornar a una tarea
+ */
+volatile uint32_t bsp_kernel_switch_pending = 0;
+
+/**
+ * Tareas que esperan una interrupción
+ */
+static bsp_task_t *bsp_kernel_irq_waiters = NULL;
+
+/*****************************************************************************/
+
+/**
+ * Cambia de tarea si hay una más prioritaria lista. Sólo las tareas (modo
+ * USER) pueden ceder la CPU mediante la SWI. Desde una isr o desde el trabajo
+ * diferido el cambio se hace al retornar a la tarea interrumpida. Se llama con
+ * la IRQ deshabilitada
+ */
+void bsp_kernel_switch (void)
+{
+	if (bsp_kernel_switch_pending && bsp_kernel_ops && bsp_in_user_mode ())
+		BSP_SWI (bsp_swi_switch, 0, 0, 0);
+}
+
+/*****************************************************************************/
+
+/**
+ * Indica si el llamante es una tarea que puede bloquearse: el núcleo está en
+ * marcha, el procesador en modo USER y no es la tarea ociosa
+ * @return	1 si se puede bloquear, 0 en otro caso
+ */
+uint32_t bsp_kernel_in_task (void)
+{
+	return bsp_kernel_ops != NULL && bsp_kernel_ops->task () != NULL;
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa un semáforo
+ * @param sem	Semáforo
+ * @param count	Valor inicial
+ * @param max	Valor máximo, al menos 1
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_sem_init (bsp_sem_t *sem, uint32_t count, uint32_t max)
+{
+	if (sem == NULL || max == 0 || count > max)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	sem->count = count;
+	sem->max = max;
+	sem->waiters = NULL;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Decrementa un semáforo, bloqueando a la tarea mientras valga cero. Fuera de
+ * una tarea (ver bsp_kernel_in_task) espera en bsp_idle, de modo que los
+ * drivers pueden usarlo aunque el núcleo no esté en marcha
+ * @param sem		Semáforo
+ * @param timeout	Ticks máximos de espera, BSP_KERNEL_FOREVER o
+ * 					BSP_KERNEL_NO_WAIT
+ * @return	Cero en caso de éxito o -1 en caso de error (EAGAIN sin espera o
+ * 			ETIMEDOUT si vence el plazo).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_sem_wait (bsp_sem_t *sem, uint32_t timeout)
+{
+	uint64_t deadline = 0;
+	uint32_t i_bit;
+	int32_t ret;
+
+	if (sem == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (timeout != BSP_KERNEL_FOREVER)
+		deadline = tmr_now () + (uint64_t) timeout * BSP_KERNEL_TMR_TICKS;
+
+	for (;;)
+	{
+		i_bit = excep_disable_irq ();
+
+		if (sem->count > 0)
+		{
+			sem->count--;
+			excep_restore_irq (i_bit);
+			return 0;
+		}
+
+		if (timeout == BSP_KERNEL_NO_WAIT)
+		{
+			excep_restore_irq (i_bit);
+			errno = EAGAIN;
+			return -1;
+		}
+
+		/* bsp_sem_post entrega la unidad directamente a la tarea que despierta */
+		if (bsp_kernel_in_task ())
+		{
+			ret = bsp_kernel_ops->block (&sem->waiters, timeout, bsp_task_blocked);
+			excep_restore_irq (i_bit);
+			if (ret < 0)
+			{
+				errno = ETIMEDOUT;
+				return -1;
+			}
+			return 0;
+		}
+
+		excep_restore_irq (i_bit);
+
+		if (timeout != BSP_KERNEL_FOREVER && tmr_now () >= deadline)
+		{
+			errno = ETIMEDOUT;
+			return -1;
+		}
+
+		bsp_idle ();
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Incrementa un semáforo o despierta a la tarea más prioritaria que lo espera.
+ * Se puede llamar desde una isr: el cambio de tarea se hace al salir de la
+ * interrupción. Si el contador ya está en su máximo no tiene efecto
+ * @param sem	Semáforo
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_sem_post (bsp_sem_t *sem)
+{
+	uint32_t i_bit;
+
+	if (sem == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	i_bit = excep_disable_irq ();
+
+	if (sem->waiters)
+		bsp_kernel_ops->wake (sem->waiters, 0);
+	else if (sem->count < sem->max)
+		sem->count++;
+
+	bsp_kernel_switch ();
+	excep_restore_irq (i_bit);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa un mutex libre
+ * @param mutex	Mutex
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_mutex_init (bsp_mutex_t *mutex)
+{
+	if (mutex == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	mutex->owner = NULL;
+	mutex->depth = 0;
+	mutex->waiters = NULL;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Toma un mutex, bloqueando a la tarea mientras lo posea otra. El propietario
+ * hereda la prioridad de la tarea bloqueada más prioritaria hasta que libera
+ * todos sus mutex. Fuera de una tarea no hay con quién competir y no tiene
+ * efecto. No se debe llamar desde una isr
+ * @param mutex		Mutex
+ * @param timeout	Ticks máximos de espera, BSP_KERNEL_FOREVER o
+ * 					BSP_KERNEL_NO_WAIT
+ * @return	Cero en caso de éxito o -1 en caso de error (EAGAIN sin espera o
+ * 			ETIMEDOUT si vence el plazo).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_mutex_lock (bsp_mutex_t *mutex, uint32_t timeout)
+{
+	bsp_task_t *task;
+	uint32_t i_bit;
+	int32_t ret;
+
+	if (mutex == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!bsp_kernel_in_task ())
+		return 0;
+
+	i_bit = excep_disable_irq ();
+	task = bsp_kernel_ops->task ();
+
+	if (mutex->owner == NULL || mutex->owner == task)
+	{
+		if (mutex->owner == NULL)
+			task->held++;
+		mutex->owner = task;
+		mutex->depth++;
+		excep_restore_irq (i_bit);
+		return 0;
+	}
+
+	if (timeout == BSP_KERNEL_NO_WAIT)
+	{
+		excep_restore_irq (i_bit);
+		errno = EAGAIN;
+		return -1;
+	}
+
+	/* Herencia de prioridad: el propietario no puede quedar por debajo de la
+	 * tarea que espera, o cualquier tarea intermedia la retrasaría */
+	if (mutex->owner->prio < task->prio)
+		bsp_kernel_ops->set_prio (mutex->owner, task->prio);
+
+	/* Si lo obtiene, bsp_mutex_unlock ya la ha hecho propietaria */
+	ret = bsp_kernel_ops->block (&mutex->waiters, timeout, bsp_task_blocked);
+	excep_restore_irq (i_bit);
+
+	if (ret < 0)
+	{
+		errno = ETIMEDOUT;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Libera un mutex. Si hay tareas esperando pasa directamente a la más
+ * prioritaria
+ * @param mutex	Mutex
+ * @return	Cero en caso de éxito o -1 en caso de error (EPERM si no lo posee
+ * 			la tarea en ejecución).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_mutex_unlock (bsp_mutex_t *mutex)
+{
+	bsp_task_t *task;
+	bsp_task_t *next;
+	uint32_t i_bit;
+
+	if (mutex == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!bsp_kernel_in_task ())
+		return 0;
+
+	i_bit = excep_disable_irq ();
+	task = bsp_kernel_ops->task ();
+
+	if (mutex->owner != task)
+	{
+		excep_restore_irq (i_bit);
+		errno = EPERM;
+		return -1;
+	}
+
+	if (--mutex->depth == 0)
+	{
+		task->held--;
+
+		next = mutex->waiters;
+		mutex->owner = next;
+		if (next)
+		{
+			mutex->depth = 1;
+			next->held++;
+			bsp_kernel_ops->wake (next, 0);
+		}
+
+		/* Al liberar todos sus mutex recupera la prioridad asignada */
+		if (task->held == 0 && task->prio != task->base_prio)
+		{
+			bsp_kernel_ops->set_prio (task, task->base_prio);
+			bsp_kernel_switch_pending = 1;
+		}
+	}
+
+	bsp_kernel_switch ();
+	excep_restore_irq (i_bit);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Bloquea a la tarea en ejecución hasta la siguiente interrupción. Es la espera
+ * de bsp_idle dentro de una tarea
+ */
+void bsp_kernel_wait_irq (void)
+{
+	uint32_t i_bit = excep_disable_irq ();
+
+	if (bsp_kernel_in_task ())
+		bsp_kernel_ops->block (&bsp_kernel_irq_waiters, BSP_KERNEL_FOREVER, bsp_task_blocked);
+
+	excep_restore_irq (i_bit);
+}
+
+/*****************************************************************************/
+
+/**
+ * Despierta a las tareas bloqueadas en bsp_kernel_wait_irq. La llama
+ * itc_service_nested_interrupt al salir de la interrupción más externa
+ */
+void bsp_kernel_irq_exit (void)
+{
+	while (bsp_kernel_irq_waiters)
+		bsp_kernel_ops->wake (bsp_kernel_irq_waiters, 0);
+}
+
+/*****************************************************************************/
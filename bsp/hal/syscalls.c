@@ -6,6 +6,7 @@
 #include <sys/types.h>
 #include <reent.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include "system.h"
 
@@ -21,7 +22,7 @@ extern void _heap_start, _heap_end;
 /**
  * Incrementa el tamaño de área reservada para datos dentro del heap.
  * Las funciones de gestión de memoria dinamica (malloc) depende de esta llamada
- * al sistema.
+ * al sistema. Desde modo USER se ejecuta en modo SVC mediante una SWI
  * @param incr	Tamaño del incremento solicitado (en bytes)
  * @return		Un puntero al nuevo bloque de memoria asignado o -1 en caso de error.
  * 				La condición de error se indica en la variable global errno.
@@ -29,11 +30,17 @@ extern void _heap_start, _heap_end;
 void * _sbrk (intptr_t incr)
 {
 	static void *current_break = &_heap_start;
-	void *last_break = current_break;
+	void *last_break;
+	itc_critical_t critical;
+
+	if (bsp_in_user_mode ())
+		return (void *) BSP_SWI (bsp_swi_sbrk, incr, 0, 0);
+
+	last_break = current_break;
 
 	/* Anulamos las interrupciones durante el proceso de reserva */
-	/* Comienzo de la sección crítica */
-	itc_disable_ints();
+	/* Comienzo de la sección crítica, que puede estar anidada en la de un driver */
+	critical = itc_critical_enter (ITC_SRC_ALL);
 
 	/* Forzamos a que el incremento sea un múltiplo del tamaño de la palabra */
 	incr = (intptr_t) (((unsigned int)incr + 3) & ~3);
@@ -52,13 +59,37 @@ void * _sbrk (intptr_t incr)
 
 	/* Volvemos a habilitar las interrupciones */
 	/* Fin de la sección crítica */
-	itc_restore_ints();
+	itc_critical_exit (critical);
 
 	return last_break;
 }
 
 /*****************************************************************************/
 
+/**
+ * Espera a que un dispositivo esté listo para leer o escribir, salvo que el
+ * fichero se haya abierto con O_NONBLOCK
+ * @param dev		Dispositivo
+ * @param fd		Descriptor de fichero/dispositivo
+ * @param request	BSP_IOCTL_WAIT_READ o BSP_IOCTL_WAIT_WRITE
+ * @return			0 si el dispositivo está listo o -1 en caso de error.
+ * 					EAGAIN indica que no está listo y no se debe esperar y
+ * 					ENOTTY que el dispositivo no admite esperas
+ */
+static int bsp_dev_wait (bsp_dev_t *dev, int fd, uint32_t request)
+{
+    uint32_t block = !(get_flags(fd) & O_NONBLOCK);
+    
+    if(dev->ioctl == NULL){
+        errno = ENOTTY;
+        return -1;
+    }
+    
+    return dev->ioctl(dev->id, request, &block);
+}
+
+/*****************************************************************************/
+
 /**
  * Abre un dispositivo/fichero
  * @param pathname	Nombre del dispositivo/fichero
@@ -112,7 +143,10 @@ int _close (int fd)
 /*****************************************************************************/
 
 /**
- * Lectura de un dispositivo/fichero
+ * Lectura de un dispositivo/fichero.
+ * Si el dispositivo admite esperas y no hay datos, la llamada se bloquea hasta
+ * que llegue alguno, o falla con EAGAIN si el fichero se abrió con O_NONBLOCK.
+ * Las tareas que leen del mismo dispositivo lo hacen por turnos
  * @param fd	Descriptor de fichero/dispositivo
  * @param buf	Puntero al búfer donde se almacenarán los datos
  * @param count	Número de bytes que se quieren leer
@@ -122,9 +156,19 @@ int _close (int fd)
 ssize_t _read(int fd, char *buf, size_t count)
 {
     bsp_dev_t *dev = get_dev(fd);
+    ssize_t ret;
     
     if(dev && dev->read){
-        return dev->read(dev->id, buf, count);
+        bsp_mutex_lock(&dev->rd_lock, BSP_KERNEL_FOREVER);
+        while((ret = dev->read(dev->id, buf, count)) == 0 && count > 0){
+            if(bsp_dev_wait(dev, fd, BSP_IOCTL_WAIT_READ) < 0){
+                if(errno == EAGAIN)
+                    ret = -1;
+                break; //El dispositivo no admite esperas
+            }
+        }
+        bsp_mutex_unlock(&dev->rd_lock);
+        return ret;
     }
     else{
         return 0;
@@ -134,7 +178,11 @@ ssize_t _read(int fd, char *buf, size_t count)
 /*****************************************************************************/
 
 /**
- * Escritura en un dispositivo/fichero
+ * Escritura en un dispositivo/fichero.
+ * Si el dispositivo admite esperas, la llamada se bloquea hasta escribir todos
+ * los datos. Con O_NONBLOCK escribe lo que quepa, y falla con EAGAIN si no
+ * cabe nada. Las tareas que escriben en el mismo dispositivo lo hacen por
+ * turnos, así que sus escrituras no se mezclan
  * @param fd	Descriptor de fichero/dispositivo
  * @param buf	Puntero al búfer que almacena los datos
  * @param count	Número de bytes que se quieren escribir
@@ -144,9 +192,27 @@ ssize_t _read(int fd, char *buf, size_t count)
 ssize_t _write (int fd, char *buf, size_t count)
 {
     bsp_dev_t *dev = get_dev(fd);
+    ssize_t ret;
+    size_t done = 0;
+    uint32_t failed = 0;
     
     if(dev && dev->write){
-        return dev->write(dev->id, buf, count);
+        bsp_mutex_lock(&dev->wr_lock, BSP_KERNEL_FOREVER);
+        while(done < count){
+            if((ret = dev->write(dev->id, buf + done, count - done)) < 0){
+                failed = (done == 0);
+                break;
+            }
+            done += ret;
+            
+            if(done < count && bsp_dev_wait(dev, fd, BSP_IOCTL_WAIT_WRITE) < 0){
+                failed = (errno == EAGAIN && done == 0);
+                break; //No se puede esperar más
+            }
+        }
+        bsp_mutex_unlock(&dev->wr_lock);
+        
+        return failed ? -1 : done;
     }
     else{
         return count;
@@ -218,3 +284,37 @@ int _isatty (int fd)
 }
 
 /*****************************************************************************/
+
+/**
+ * Operaciones de control específicas de un dispositivo.
+ * Las peticiones las define cada driver en su cabecera. Desde modo USER se
+ * ejecutan en modo SVC mediante una SWI, salvo las esperas, que bloquean la
+ * tarea con el núcleo y por eso se quedan en modo USER, como en _read y _write
+ * @param fd		Descriptor de fichero/dispositivo
+ * @param request	Petición
+ * @param arg		Argumento de la petición
+ * @return			Un valor dependiente de la petición o -1 en caso de error.
+ * 					La condición de error se indica en la variable global errno
+ */
+int bsp_ioctl (int fd, uint32_t request, void *arg)
+{
+    bsp_dev_t * dev;
+    
+    if(bsp_in_user_mode() && request != BSP_IOCTL_WAIT_READ && request != BSP_IOCTL_WAIT_WRITE)
+        return BSP_SWI(bsp_swi_ioctl, fd, request, arg);
+    
+    if(fd < 0 || fd >= BSP_MAX_FD || (dev = get_dev(fd)) == NULL){
+        errno = EBADF;
+        return -1;
+    }
+    
+    if(dev->ioctl){
+        return dev->ioctl(dev->id, request, arg);
+    }
+    else{
+        errno = ENOTTY; //El dispositivo no admite operaciones de control
+        return -1;
+    }
+}
+
+/*****************************************************************************/
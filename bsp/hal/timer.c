@@ -0,0 +1,277 @@
+/*
+ * Sistemas operativos empotrados
+ * Temporizadores software
+ */
+
+#include <errno.h>
+
+#include "system.h"
+#include "timer_wheel.h"
+
+/*****************************************************************************/
+
+/**
+ * Rueda de temporizadores y reserva de nodos. El tiempo de la rueda se mide en
+ * unidades de 2^BSP_TIMER_SHIFT ticks del reloj monótono
+ */
+static timer_wheel_node_t bsp_timer_pool[BSP_TIMER_POOL_SIZE];
+static timer_wheel_t bsp_timer_wheel;
+
+/**
+ * Unidad programada en el canal BSP_TIMER_TMR, si armed vale 1
+ */
+static volatile uint32_t bsp_timer_armed = 0;
+static uint32_t bsp_timer_armed_unit;
+
+/**
+ * Indica que se están ejecutando las callbacks
+ */
+static volatile uint32_t bsp_timer_running = 0;
+
+/*****************************************************************************/
+
+/**
+ * Convierte un instante del reloj monótono a unidades de la rueda
+ * @param ticks	Instante
+ * @return	Unidad que contiene el instante
+ */
+static inline uint32_t bsp_timer_unit (uint64_t ticks)
+{
+	return (uint32_t) (ticks >> BSP_TIMER_SHIFT);
+}
+
+/*****************************************************************************/
+
+/**
+ * Convierte una unidad de la rueda al instante del reloj monótono en que empieza
+ * @param unit	Unidad
+ * @param now	Instante actual
+ * @return	Instante, o now si la unidad ya ha pasado
+ */
+static uint64_t bsp_timer_deadline (uint32_t unit, uint64_t now)
+{
+	int32_t delta = unit - bsp_timer_unit (now);
+
+	if (delta <= 0)
+		return now;
+
+	return ((now >> BSP_TIMER_SHIFT) + delta) << BSP_TIMER_SHIFT;
+}
+
+/*****************************************************************************/
+
+static void bsp_timer_expired (tmr_id_t tmr, void *ctx);
+
+/**
+ * Programa el canal hardware con el próximo trabajo de la rueda, salvo que ya
+ * esté programado antes. Se llama en sección crítica
+ */
+static void bsp_timer_arm (void)
+{
+	uint32_t unit;
+
+	if (timer_wheel_next (&bsp_timer_wheel, &unit) < 0)
+	{
+		if (bsp_timer_armed)
+			tmr_stop (BSP_TIMER_TMR);
+		bsp_timer_armed = 0;
+		return;
+	}
+
+	if (bsp_timer_armed && (int32_t) (unit - bsp_timer_armed_unit) >= 0)
+		return;
+
+	bsp_timer_armed = 1;
+	bsp_timer_armed_unit = unit;
+	tmr_set_deadline (BSP_TIMER_TMR, bsp_timer_deadline (unit, tmr_now ()), bsp_timer_expired, NULL);
+}
+
+/*****************************************************************************/
+
+/**
+ * Trabajo diferido que avanza la rueda hasta el instante actual, ejecuta las
+ * callbacks vencidas y vuelve a programar el canal hardware
+ * @param ctx	No se usa
+ * @param arg	No se usa
+ */
+static void bsp_timer_work (void *ctx, uint32_t arg)
+{
+	bsp_timer_callback_t func;
+	void *func_ctx;
+	itc_critical_t state;
+	uint32_t now;
+	int32_t id;
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+	if (bsp_timer_running)
+	{
+		/* La ejecución en curso vuelve a programar el canal al terminar */
+		itc_critical_exit (state);
+		return;
+	}
+	bsp_timer_running = 1;
+	itc_critical_exit (state);
+
+	now = bsp_timer_unit (tmr_now ());
+
+	while (1)
+	{
+		state = itc_critical_enter (ITC_SRC_ALL);
+		id = timer_wheel_expire (&bsp_timer_wheel, now, &func, &func_ctx);
+		itc_critical_exit (state);
+
+		if (id < 0)
+			break;
+
+		if (func)
+			func (id, func_ctx);
+
+		state = itc_critical_enter (ITC_SRC_ALL);
+		timer_wheel_finish (&bsp_timer_wheel, id);
+		itc_critical_exit (state);
+	}
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+	bsp_timer_running = 0;
+	bsp_timer_arm ();
+	itc_critical_exit (state);
+}
+
+/*****************************************************************************/
+
+/**
+ * Callback del canal hardware. Se ejecuta en la isr, así que sólo encola el
+ * trabajo, salvo que la reserva de trabajo diferido esté llena
+ * @param tmr	Canal (BSP_TIMER_TMR)
+ * @param ctx	No se usa
+ */
+static void bsp_timer_expired (tmr_id_t tmr, void *ctx)
+{
+	bsp_timer_armed = 0;
+
+	if (bsp_defer (bsp_timer_work, NULL, 0) < 0)
+		bsp_timer_work (NULL, 0);
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa los temporizadores software. Todos comparten el canal
+ * BSP_TIMER_TMR (ver "system.h"), que se programa con el vencimiento más
+ * próximo, de modo que no hay interrupciones periódicas
+ */
+void bsp_timer_init (void)
+{
+	bsp_timer_armed = 0;
+	bsp_timer_running = 0;
+	timer_wheel_init (&bsp_timer_wheel, bsp_timer_pool, BSP_TIMER_POOL_SIZE,
+					  bsp_timer_unit (tmr_now ()));
+}
+
+/*****************************************************************************/
+
+/**
+ * Arranca un temporizador software. El coste no depende del número de
+ * temporizadores activos. La resolución es de 2^BSP_TIMER_SHIFT ticks del
+ * reloj, y nunca vence antes de tiempo
+ * @param us		Microsegundos hasta el vencimiento
+ * @param period_us	Periodo en microsegundos, 0 para un temporizador de un disparo
+ * @param func		Función callback
+ * @param ctx		Contexto que se pasa a la callback
+ * @return	El identificador del temporizador o -1 en caso de error (EAGAIN si
+ * 			no quedan temporizadores libres).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_timer_start (uint32_t us, uint32_t period_us, bsp_timer_callback_t func, void *ctx)
+{
+	const uint64_t round = (1 << BSP_TIMER_SHIFT) - 1;
+	itc_critical_t state;
+	uint64_t now;
+	uint32_t expires, period;
+	int32_t id;
+
+	if (func == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Se redondea hacia arriba para no vencer nunca antes de tiempo */
+	now = tmr_now ();
+	expires = bsp_timer_unit (now + tmr_us_to_ticks (us) + round);
+	period = period_us ? bsp_timer_unit (tmr_us_to_ticks (period_us) + round) : 0;
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+	id = timer_wheel_add (&bsp_timer_wheel, bsp_timer_unit (now), expires, period, func, ctx);
+	if (id >= 0)
+		bsp_timer_arm ();
+	itc_critical_exit (state);
+
+	if (id < 0)
+		errno = EAGAIN;
+
+	return id;
+}
+
+/*****************************************************************************/
+
+/**
+ * Cancela un temporizador software
+ * @param id	Identificador del temporizador
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOENT si ya ha
+ * 			vencido o se había cancelado).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_timer_cancel (int32_t id)
+{
+	itc_critical_t state;
+	int32_t ret;
+
+	/* El canal se queda programado: como mucho habrá una interrupción de más */
+	state = itc_critical_enter (ITC_SRC_ALL);
+	ret = timer_wheel_cancel (&bsp_timer_wheel, id);
+	itc_critical_exit (state);
+
+	if (ret < 0)
+		errno = ENOENT;
+
+	return ret;
+}
+
+/*****************************************************************************/
+
+/**
+ * Calcula el instante del reloj monótono (ver tmr_now) en que los temporizadores
+ * software tienen trabajo pendiente
+ * @param deadline	Destino del instante
+ * @return	Cero en caso de éxito o -1 en caso de error (ENOENT si no hay
+ * 			temporizadores activos).
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t bsp_timer_next (uint64_t *deadline)
+{
+	itc_critical_t state;
+	uint32_t unit;
+	int32_t ret;
+
+	if (deadline == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	state = itc_critical_enter (ITC_SRC_ALL);
+	ret = timer_wheel_next (&bsp_timer_wheel, &unit);
+	itc_critical_exit (state);
+
+	if (ret < 0)
+	{
+		errno = ENOENT;
+		return -1;
+	}
+
+	*deadline = bsp_timer_deadline (unit, tmr_now ());
+	return 0;
+}
+
+/*****************************************************************************/
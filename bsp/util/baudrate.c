@@ -0,0 +1,179 @@
+/*
+ * Sistemas operativos empotrados
+ * Cálculo de los divisores de velocidad de las uart
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include "baudrate.h"
+
+/*****************************************************************************/
+
+/**
+ * Máximo valor de (inc + 1) y (mod + 1)
+ */
+#define BAUDRATE_DIV_MAX	65536u
+
+/*****************************************************************************/
+
+/**
+ * Calcula la velocidad obtenida y su error para una razón dada
+ * @param clk			Frecuencia de reloj de la uart, en Hz
+ * @param baud			Velocidad pedida, en baudios
+ * @param oversampling	Sobremuestreo
+ * @param num			inc + 1
+ * @param den			mod + 1
+ * @param result		Configuración a completar
+ */
+static void baudrate_eval (uint32_t clk, uint32_t baud, uint32_t oversampling,
+		uint32_t num, uint32_t den, baudrate_t *result)
+{
+	int64_t target = (int64_t) baud * oversampling * den;
+	int64_t actual = (int64_t) clk * num;
+
+	result->inc = num - 1;
+	result->mod = den - 1;
+	result->oversampling = oversampling;
+	result->rate = (actual + (int64_t) oversampling * den / 2) / ((int64_t) oversampling * den);
+	result->error_ppm = ((actual - target) * 1000000) / target;
+}
+
+/*****************************************************************************/
+
+/**
+ * Resuelve el divisor para un sobremuestreo concreto.
+ * Busca la fracción num/den más próxima a baud * oversampling / clk con
+ * num, den <= BAUDRATE_DIV_MAX, comparando el último convergente admisible con
+ * el mejor semiconvergente
+ * @param clk			Frecuencia de reloj de la uart, en Hz
+ * @param baud			Velocidad pedida, en baudios
+ * @param oversampling	Sobremuestreo
+ * @param result		Configuración obtenida
+ * @return				Cero en caso de éxito o -1 si la velocidad no se puede
+ * 						representar
+ */
+static int32_t baudrate_solve_os (uint32_t clk, uint32_t baud, uint32_t oversampling,
+		baudrate_t *result)
+{
+	uint64_t p = (uint64_t) baud * oversampling;
+	uint64_t q = clk;
+	uint64_t h0 = 0, k0 = 1, h1 = 1, k1 = 0;
+	uint64_t a, h2, k2, r, s;
+	baudrate_t semi;
+
+	if (p == 0)
+		return -1;
+
+	/* La razón debe ser como mucho 1 (inc <= mod). Por encima, la razón
+	   admisible más próxima es 1 y la tolerancia decide si vale */
+	if (p >= q)
+	{
+		baudrate_eval (clk, baud, oversampling, 1, 1, result);
+		return 0;
+	}
+
+	/* Convergentes h1/k1 de la fracción continua de p/q */
+	for (;;)
+	{
+		a = p / q;
+		h2 = a * h1 + h0;
+		k2 = a * k1 + k0;
+		if (h2 > BAUDRATE_DIV_MAX || k2 > BAUDRATE_DIV_MAX)
+			break;
+
+		h0 = h1; k0 = k1;
+		h1 = h2; k1 = k2;
+
+		r = p % q;
+		if (r == 0)
+			break;
+		p = q;
+		q = r;
+	}
+
+	if (h1 == 0)
+		return -1;
+
+	baudrate_eval (clk, baud, oversampling, h1, k1, result);
+
+	/* El mejor semiconvergente entre el penúltimo y el último convergente */
+	s = (BAUDRATE_DIV_MAX - k0) / k1;
+	if ((BAUDRATE_DIV_MAX - h0) / h1 < s)
+		s = (BAUDRATE_DIV_MAX - h0) / h1;
+	if (s > 0)
+	{
+		baudrate_eval (clk, baud, oversampling, h0 + s * h1, k0 + s * k1, &semi);
+		if ((semi.error_ppm < 0 ? -semi.error_ppm : semi.error_ppm) <
+				(result->error_ppm < 0 ? -result->error_ppm : result->error_ppm))
+			*result = semi;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Busca la pareja INC/MOD cuya velocidad se aproxima más a la pedida.
+ * La razón (inc + 1) / (mod + 1) se obtiene como la mejor aproximación racional
+ * con numerador y denominador de 16 bits mediante fracciones continuas, por lo
+ * que el resultado es óptimo y no hace falta recorrer todas las parejas.
+ * No depende del hardware y se puede probar en el host
+ * @param clk			Frecuencia de reloj de la uart, en Hz
+ * @param baud			Velocidad pedida, en baudios
+ * @param oversampling	16 u 8 para fijar el sobremuestreo, o 0 para elegir el
+ * 						de menor error (16 en caso de empate)
+ * @param tolerance_ppm	Error máximo admitido, en ppm
+ * @param result		Configuración obtenida
+ * @return				Cero en caso de éxito o -1 si la velocidad no se puede
+ * 						conseguir con ese error. La condición de error se indica
+ * 						en la variable global errno
+ */
+int32_t baudrate_solve (uint32_t clk, uint32_t baud, uint32_t oversampling,
+		uint32_t tolerance_ppm, baudrate_t *result)
+{
+	baudrate_t best, other;
+	int32_t found;
+	uint32_t error;
+
+	if (result == NULL)
+	{
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (oversampling != 0 && oversampling != 16 && oversampling != 8)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* El sobremuestreo de 16x tolera mejor el ruido, así que se prueba primero */
+	found = (oversampling != 8 && baudrate_solve_os (clk, baud, 16, &best) == 0);
+
+	if (oversampling != 16 && baudrate_solve_os (clk, baud, 8, &other) == 0)
+	{
+		if (!found || (other.error_ppm < 0 ? -other.error_ppm : other.error_ppm) <
+				(best.error_ppm < 0 ? -best.error_ppm : best.error_ppm))
+			best = other;
+		found = 1;
+	}
+
+	if (!found)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	error = best.error_ppm < 0 ? -best.error_ppm : best.error_ppm;
+	if (error > tolerance_ppm)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	*result = best;
+	return 0;
+}
+
+/*****************************************************************************/
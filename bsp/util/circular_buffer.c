@@ -3,6 +3,7 @@
  * Búfer circular
  */
 
+#include <string.h>
 #include "circular_buffer.h"
 
 /*****************************************************************************/
@@ -96,3 +97,151 @@ int32_t circular_buffer_read (volatile circular_buffer_t *cb)
 }
 
 /*****************************************************************************/
+
+/**
+ * Escribe un bloque de bytes en un búfer circular
+ * La copia se realiza como mucho en dos tramos contiguos y los índices del
+ * búfer se actualizan una única vez
+ * @param cb	Búfer circular
+ * @param buf	Bytes a escribir
+ * @param count	Número de bytes a escribir
+ * @return		El número de bytes realmente escritos
+ */
+uint32_t circular_buffer_write_block (volatile circular_buffer_t *cb, const uint8_t *buf, uint32_t count)
+{
+	uint32_t end = cb->end;
+	uint32_t size = cb->size;
+	uint32_t free = size - cb->count;
+	uint32_t first;
+
+	/* Escribimos sólo lo que quepa */
+	if (count > free)
+		count = free;
+
+	/* Primer tramo hasta el final del búfer, segundo desde el principio */
+	first = size - end;
+	if (first > count)
+		first = count;
+
+	memcpy (cb->data + end, buf, first);
+	memcpy (cb->data, buf + first, count - first);
+
+	circular_buffer_commit_write (cb, count);
+
+	return count;
+}
+
+/*****************************************************************************/
+
+/**
+ * Lee un bloque de bytes de un búfer circular
+ * La copia se realiza como mucho en dos tramos contiguos y los índices del
+ * búfer se actualizan una única vez
+ * @param cb	Búfer circular
+ * @param buf	Búfer donde se almacenarán los bytes
+ * @param count	Número de bytes a leer
+ * @return		El número de bytes realmente leídos
+ */
+uint32_t circular_buffer_read_block (volatile circular_buffer_t *cb, uint8_t *buf, uint32_t count)
+{
+	uint32_t start = cb->start;
+	uint32_t size = cb->size;
+	uint32_t used = cb->count;
+	uint32_t first;
+
+	/* Leemos sólo lo que haya */
+	if (count > used)
+		count = used;
+
+	/* Primer tramo hasta el final del búfer, segundo desde el principio */
+	first = size - start;
+	if (first > count)
+		first = count;
+
+	memcpy (buf, cb->data + start, first);
+	memcpy (buf + first, cb->data, count - first);
+
+	circular_buffer_commit_read (cb, count);
+
+	return count;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el tramo contiguo de datos listos para leer, sin consumirlos
+ * Los datos se consumen posteriormente con circular_buffer_commit_read
+ * @param cb	Búfer circular
+ * @param span	Puntero donde se almacenará el comienzo del tramo
+ * @return		El número de bytes contiguos disponibles a partir de *span
+ */
+uint32_t circular_buffer_peek_read (volatile circular_buffer_t *cb, uint8_t **span)
+{
+	uint32_t start = cb->start;
+	uint32_t count = cb->count;
+	uint32_t size = cb->size;
+
+	*span = cb->data + start;
+
+	/* El tramo termina en el final de los datos o en el final del búfer */
+	return (count < size - start) ? count : size - start;
+}
+
+/*****************************************************************************/
+
+/**
+ * Consume bytes previamente obtenidos con circular_buffer_peek_read
+ * @param cb	Búfer circular
+ * @param count	Número de bytes consumidos. No debe superar el tamaño del tramo
+ */
+void circular_buffer_commit_read (volatile circular_buffer_t *cb, uint32_t count)
+{
+	uint32_t start = cb->start + count;
+
+	if (start >= cb->size)
+		start -= cb->size;
+
+	cb->start = start;
+	cb->count -= count;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el tramo contiguo de espacio libre para escribir
+ * Los bytes escritos en el tramo se publican con circular_buffer_commit_write
+ * @param cb	Búfer circular
+ * @param span	Puntero donde se almacenará el comienzo del tramo
+ * @return		El número de bytes contiguos libres a partir de *span
+ */
+uint32_t circular_buffer_peek_write (volatile circular_buffer_t *cb, uint8_t **span)
+{
+	uint32_t end = cb->end;
+	uint32_t free = cb->size - cb->count;
+	uint32_t size = cb->size;
+
+	*span = cb->data + end;
+
+	/* El tramo termina en el comienzo de los datos o en el final del búfer */
+	return (free < size - end) ? free : size - end;
+}
+
+/*****************************************************************************/
+
+/**
+ * Publica bytes escritos en el tramo obtenido con circular_buffer_peek_write
+ * @param cb	Búfer circular
+ * @param count	Número de bytes escritos. No debe superar el tamaño del tramo
+ */
+void circular_buffer_commit_write (volatile circular_buffer_t *cb, uint32_t count)
+{
+	uint32_t end = cb->end + count;
+
+	if (end >= cb->size)
+		end -= cb->size;
+
+	cb->end = end;
+	cb->count += count;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,38 @@
+/*
+ * Sistemas operativos empotrados
+ * CRC-16 CCITT
+ */
+
+#include "crc16.h"
+
+/*****************************************************************************/
+
+/**
+ * Tabla de 16 entradas para calcular el CRC de nibble en nibble.
+ * Es un compromiso entre velocidad (se usa desde las isr) y memoria
+ */
+static const uint16_t crc16_table[16] =
+{
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+	0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+/*****************************************************************************/
+
+/**
+ * Actualiza un CRC-16 CCITT (polinomio 0x1021, sin reflexión) con un byte.
+ * Si se calcula sobre unos datos seguidos de su propio CRC (byte alto primero)
+ * el resultado es cero
+ * @param crc	Valor anterior del CRC
+ * @param byte	Byte a añadir
+ * @return		El nuevo valor del CRC
+ */
+uint16_t crc16_update (uint16_t crc, uint8_t byte)
+{
+	crc = (crc << 4) ^ crc16_table[(crc >> 12) ^ (byte >> 4)];
+	crc = (crc << 4) ^ crc16_table[(crc >> 12) ^ (byte & 0x0F)];
+
+	return crc;
+}
+
+/*****************************************************************************/
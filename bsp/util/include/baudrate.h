@@ -0,0 +1,49 @@
+/*
+ * Sistemas operativos empotrados
+ * Cálculo de los divisores de velocidad de las uart
+ */
+
+#ifndef __BAUDRATE_H__
+#define __BAUDRATE_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Configuración del divisor de una uart.
+ * La velocidad obtenida es clk * (inc + 1) / ((mod + 1) * oversampling)
+ */
+typedef struct
+{
+	uint16_t inc;			/* Valor para UBRINC */
+	uint16_t mod;			/* Valor para UBRMOD */
+	uint32_t oversampling;	/* Sobremuestreo, 16 (xTIM = 0) u 8 (xTIM = 1) */
+	uint32_t rate;			/* Velocidad obtenida, en baudios */
+	int32_t error_ppm;		/* Error relativo a la velocidad pedida, en ppm */
+} baudrate_t;
+
+/*****************************************************************************/
+
+/**
+ * Busca la pareja INC/MOD cuya velocidad se aproxima más a la pedida.
+ * La razón (inc + 1) / (mod + 1) se obtiene como la mejor aproximación racional
+ * con numerador y denominador de 16 bits mediante fracciones continuas, por lo
+ * que el resultado es óptimo y no hace falta recorrer todas las parejas.
+ * No depende del hardware y se puede probar en el host
+ * @param clk			Frecuencia de reloj de la uart, en Hz
+ * @param baud			Velocidad pedida, en baudios
+ * @param oversampling	16 u 8 para fijar el sobremuestreo, o 0 para elegir el
+ * 						de menor error (16 en caso de empate)
+ * @param tolerance_ppm	Error máximo admitido, en ppm
+ * @param result		Configuración obtenida
+ * @return				Cero en caso de éxito o -1 si la velocidad no se puede
+ * 						conseguir con ese error. La condición de error se indica
+ * 						en la variable global errno
+ */
+int32_t baudrate_solve (uint32_t clk, uint32_t baud, uint32_t oversampling,
+		uint32_t tolerance_ppm, baudrate_t *result);
+
+/*****************************************************************************/
+
+#endif /* __BAUDRATE_H__ */
@@ -71,4 +71,70 @@ int32_t circular_buffer_read (volatile circular_buffer_t *cb);
 
 /*****************************************************************************/
 
+/**
+ * Escribe un bloque de bytes en un búfer circular
+ * La copia se realiza como mucho en dos tramos contiguos y los índices del
+ * búfer se actualizan una única vez
+ * @param cb	Búfer circular
+ * @param buf	Bytes a escribir
+ * @param count	Número de bytes a escribir
+ * @return		El número de bytes realmente escritos
+ */
+uint32_t circular_buffer_write_block (volatile circular_buffer_t *cb, const uint8_t *buf, uint32_t count);
+
+/*****************************************************************************/
+
+/**
+ * Lee un bloque de bytes de un búfer circular
+ * La copia se realiza como mucho en dos tramos contiguos y los índices del
+ * búfer se actualizan una única vez
+ * @param cb	Búfer circular
+ * @param buf	Búfer donde se almacenarán los bytes
+ * @param count	Número de bytes a leer
+ * @return		El número de bytes realmente leídos
+ */
+uint32_t circular_buffer_read_block (volatile circular_buffer_t *cb, uint8_t *buf, uint32_t count);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el tramo contiguo de datos listos para leer, sin consumirlos
+ * Los datos se consumen posteriormente con circular_buffer_commit_read
+ * @param cb	Búfer circular
+ * @param span	Puntero donde se almacenará el comienzo del tramo
+ * @return		El número de bytes contiguos disponibles a partir de *span
+ */
+uint32_t circular_buffer_peek_read (volatile circular_buffer_t *cb, uint8_t **span);
+
+/*****************************************************************************/
+
+/**
+ * Consume bytes previamente obtenidos con circular_buffer_peek_read
+ * @param cb	Búfer circular
+ * @param count	Número de bytes consumidos. No debe superar el tamaño del tramo
+ */
+void circular_buffer_commit_read (volatile circular_buffer_t *cb, uint32_t count);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el tramo contiguo de espacio libre para escribir
+ * Los bytes escritos en el tramo se publican con circular_buffer_commit_write
+ * @param cb	Búfer circular
+ * @param span	Puntero donde se almacenará el comienzo del tramo
+ * @return		El número de bytes contiguos libres a partir de *span
+ */
+uint32_t circular_buffer_peek_write (volatile circular_buffer_t *cb, uint8_t **span);
+
+/*****************************************************************************/
+
+/**
+ * Publica bytes escritos en el tramo obtenido con circular_buffer_peek_write
+ * @param cb	Búfer circular
+ * @param count	Número de bytes escritos. No debe superar el tamaño del tramo
+ */
+void circular_buffer_commit_write (volatile circular_buffer_t *cb, uint32_t count);
+
+/*****************************************************************************/
+
 #endif /* __CIRCULAR_BUFFER_H__ */
@@ -0,0 +1,32 @@
+/*
+ * Sistemas operativos empotrados
+ * CRC-16 CCITT
+ */
+
+#ifndef __CRC16_H__
+#define __CRC16_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Valor inicial del CRC
+ */
+#define CRC16_INIT	0xFFFF
+
+/*****************************************************************************/
+
+/**
+ * Actualiza un CRC-16 CCITT (polinomio 0x1021, sin reflexión) con un byte.
+ * Si se calcula sobre unos datos seguidos de su propio CRC (byte alto primero)
+ * el resultado es cero
+ * @param crc	Valor anterior del CRC
+ * @param byte	Byte a añadir
+ * @return		El nuevo valor del CRC
+ */
+uint16_t crc16_update (uint16_t crc, uint8_t byte);
+
+/*****************************************************************************/
+
+#endif /* __CRC16_H__ */
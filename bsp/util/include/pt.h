@@ -0,0 +1,156 @@
+/*
+ * Sistemas operativos empotrados
+ * Corrutinas sin pila (protothreads)
+ */
+
+#ifndef __PT_H__
+#define __PT_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Continuación de una corrutina: la línea del código en la que se quedó.
+ * Es todo su estado, así que las variables locales no se conservan entre dos
+ * esperas y lo que deba sobrevivir a ellas tiene que ser estático o estar en
+ * una estructura del llamante. Como las continuaciones son etiquetas case, no
+ * se puede esperar dentro de un switch de la propia corrutina ni poner dos
+ * esperas en la misma línea
+ */
+typedef struct
+{
+	uint16_t lc;
+} pt_t;
+
+/*****************************************************************************/
+
+/**
+ * Valores que retorna una corrutina
+ */
+#define PT_WAITING	0		/* Bloqueada en una espera */
+#define PT_YIELDED	1		/* Ha cedido la CPU y quiere seguir */
+#define PT_EXITED	2		/* Ha terminado con PT_EXIT */
+#define PT_ENDED	3		/* Ha llegado a PT_END */
+
+/*****************************************************************************/
+
+/**
+ * Declaración de una corrutina
+ * @param name_args	Nombre y parámetros de la función
+ */
+#define PT_THREAD(name_args)	int8_t name_args
+
+/**
+ * Prepara una corrutina para empezar desde el principio
+ * @param pt	Continuación
+ */
+#define PT_INIT(pt)		((pt)->lc = 0)
+
+/*****************************************************************************/
+
+/**
+ * Principio y fin del cuerpo de una corrutina. PT_BEGIN salta a la línea en la
+ * que se quedó y PT_END la termina, de modo que después sólo retorna PT_ENDED
+ * hasta que se reinicia
+ * @param pt	Continuación
+ */
+#define PT_BEGIN(pt)	{ int8_t pt_yielded = 1; (void) pt_yielded; switch ((pt)->lc) { case 0:
+
+#define PT_END(pt)		(pt)->lc = 0xFFFF; case 0xFFFF: ; } return PT_ENDED; }
+
+/*****************************************************************************/
+
+/**
+ * Guarda la continuación en la línea actual
+ */
+#define PT_SET(pt)		(pt)->lc = __LINE__; case __LINE__:
+
+/*****************************************************************************/
+
+/**
+ * Espera a que se cumpla una condición, retornando PT_WAITING mientras no se
+ * cumple. La condición se vuelve a evaluar cada vez que se ejecuta la corrutina
+ * @param pt		Continuación
+ * @param cond		Condición
+ */
+#define PT_WAIT_UNTIL(pt, cond)		\
+	do {							\
+		PT_SET (pt)					\
+		if (!(cond))				\
+			return PT_WAITING;		\
+	} while (0)
+
+#define PT_WAIT_WHILE(pt, cond)		PT_WAIT_UNTIL ((pt), !(cond))
+
+/*****************************************************************************/
+
+/**
+ * Cede la CPU una vez, retornando PT_YIELDED. PT_YIELD_UNTIL además no sigue
+ * hasta que se cumple la condición
+ * @param pt		Continuación
+ * @param cond		Condición
+ */
+#define PT_YIELD(pt)				\
+	do {							\
+		pt_yielded = 0;				\
+		PT_SET (pt)					\
+		if (pt_yielded == 0)		\
+			return PT_YIELDED;		\
+	} while (0)
+
+#define PT_YIELD_UNTIL(pt, cond)	\
+	do {							\
+		pt_yielded = 0;				\
+		PT_SET (pt)					\
+		if (pt_yielded == 0 || !(cond))	\
+			return PT_YIELDED;		\
+	} while (0)
+
+/*****************************************************************************/
+
+/**
+ * Termina la corrutina o la reinicia desde el principio
+ * @param pt	Continuación
+ */
+#define PT_EXIT(pt)					\
+	do {							\
+		(pt)->lc = 0xFFFF;			\
+		return PT_EXITED;			\
+	} while (0)
+
+#define PT_RESTART(pt)				\
+	do {							\
+		PT_INIT (pt);				\
+		return PT_WAITING;			\
+	} while (0)
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta una corrutina hija hasta que termina. La hija se llama cada vez que
+ * se ejecuta la madre, así que hereda sus esperas
+ * @param pt		Continuación de la madre
+ * @param child		Continuación de la hija
+ * @param thread	Llamada a la hija
+ */
+#define PT_WAIT_THREAD(pt, thread)	PT_WAIT_WHILE ((pt), PT_SCHEDULE (thread))
+
+#define PT_SPAWN(pt, child, thread)	\
+	do {							\
+		PT_INIT (child);			\
+		PT_WAIT_THREAD ((pt), (thread));	\
+	} while (0)
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta una corrutina una vez
+ * @param thread	Llamada a la corrutina
+ * @return	1 si sigue viva, 0 si ha terminado
+ */
+#define PT_SCHEDULE(thread)		((thread) < PT_EXITED)
+
+/*****************************************************************************/
+
+#endif /* __PT_H__ */
@@ -0,0 +1,234 @@
+/*
+ * Sistemas operativos empotrados
+ * Búfer circular para un productor y un consumidor (SPSC)
+ */
+
+#ifndef __SPSC_BUFFER_H__
+#define __SPSC_BUFFER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Estructura para gestionar un búfer circular con un único productor y un
+ * único consumidor.
+ * El productor (p.ej. la isr de recepción) es el único que modifica head y el
+ * consumidor (p.ej. la aplicación) es el único que modifica tail, por lo que
+ * no es necesario deshabilitar interrupciones para acceder al búfer.
+ * La capacidad es siempre una potencia de dos y los índices avanzan libremente
+ * (sólo se reducen con la máscara al acceder a los datos), por lo que no hace
+ * falta un contador ni comparar con el final del búfer en cada byte.
+ */
+typedef struct
+{
+	uint8_t *data;
+	uint32_t mask;				/* Capacidad - 1 */
+	volatile uint32_t head;		/* Número de bytes escritos (productor) */
+	volatile uint32_t tail;		/* Número de bytes leídos (consumidor) */
+} spsc_buffer_t;
+
+/*****************************************************************************/
+
+/**
+ * Comprueba en tiempo de compilación si un tamaño es potencia de dos
+ */
+#define SPSC_BUFFER_IS_POW2(size)	((size) != 0 && ((size) & ((size) - 1)) == 0)
+
+/*****************************************************************************/
+
+/**
+ * Define un búfer privado al módulo (static) con capacidad fijada en tiempo de
+ * compilación, que debe ser una potencia de dos. La máscara es constante y no
+ * necesita spsc_buffer_init, así que el búfer está listo antes de arrancar
+ * cualquier productor. Los búferes que se reservan en ejecución usan
+ * spsc_buffer_init. Ejemplo: SPSC_BUFFER_DEFINE (uart1_rx, 256);
+ * @param name	Nombre de la variable spsc_buffer_t
+ * @param size	Capacidad en bytes
+ */
+#define SPSC_BUFFER_DEFINE(name, size)											\
+	typedef char name##_size_not_power_of_two[SPSC_BUFFER_IS_POW2 (size) ? 1 : -1];	\
+	static uint8_t name##_data[(size)];											\
+	static spsc_buffer_t name = { name##_data, (size) - 1, 0, 0 }
+
+/*****************************************************************************/
+
+/**
+ * Barrera para el compilador. Garantiza que los datos se escriben (o leen)
+ * antes de publicar el nuevo índice
+ */
+#define spsc_buffer_barrier()	asm volatile ("" : : : "memory")
+
+/*****************************************************************************/
+
+/**
+ * Inicializa un búfer circular dado un puntero a una zona de memoria y su tamaño
+ * @param cb	Puntero a la estructura de gestión del búfer circular
+ * @param addr	Puntero a la zona de memoria que se gestionará como un búfer circular
+ * @param size	Tamaño en bytes del búfer. Si no es potencia de dos sólo se usa
+ * 				la mayor potencia de dos que quepa
+ */
+void spsc_buffer_init (spsc_buffer_t *cb, uint8_t *addr, uint32_t size);
+
+/*****************************************************************************/
+
+/**
+ * Vacía el búfer. No debe haber ningún productor ni consumidor activo
+ * @param cb	Búfer circular
+ */
+static inline void spsc_buffer_flush (spsc_buffer_t *cb)
+{
+	cb->head = 0;
+	cb->tail = 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de bytes almacenados en el búfer
+ * @param cb	Búfer circular
+ */
+static inline uint32_t spsc_buffer_count (spsc_buffer_t *cb)
+{
+	return cb->head - cb->tail;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna la capacidad del búfer
+ * @param cb	Búfer circular
+ */
+static inline uint32_t spsc_buffer_size (spsc_buffer_t *cb)
+{
+	return (cb->data != NULL) ? cb->mask + 1 : 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna 1 si el búfer está lleno
+ * @param cb	Búfer circular
+ */
+static inline uint32_t spsc_buffer_is_full (spsc_buffer_t *cb)
+{
+	return spsc_buffer_count (cb) >= spsc_buffer_size (cb);
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna 1 si el búfer está vacío
+ * @param cb	Búfer circular
+ */
+static inline uint32_t spsc_buffer_is_empty (spsc_buffer_t *cb)
+{
+	return cb->head == cb->tail;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retornan el número total de bytes escritos y leídos. Crecen libremente, así
+ * que la diferencia entre dos posiciones indica cuántos bytes del flujo las
+ * separan aunque los índices hayan dado la vuelta
+ * @param cb	Búfer circular
+ */
+static inline uint32_t spsc_buffer_write_pos (spsc_buffer_t *cb)
+{
+	return cb->head;
+}
+
+static inline uint32_t spsc_buffer_read_pos (spsc_buffer_t *cb)
+{
+	return cb->tail;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe un byte en el espacio libre del búfer sin publicarlo, a una distancia
+ * dada de la posición de escritura. Permite al productor construir un bloque
+ * en su sitio y decidir después si lo publica (spsc_buffer_commit_write) o lo
+ * descarta. Sólo la puede llamar el productor
+ * @param cb		Búfer circular
+ * @param offset	Distancia desde la posición de escritura
+ * @param byte		Byte a escribir
+ * @return			1 si el byte cabe en el búfer o 0 en otro caso
+ */
+static inline uint32_t spsc_buffer_stage (spsc_buffer_t *cb, uint32_t offset, uint8_t byte)
+{
+	/* Con el búfer lleno mask - count daría la vuelta */
+	if (offset >= spsc_buffer_size (cb) - spsc_buffer_count (cb))
+		return 0;
+
+	cb->data[(cb->head + offset) & cb->mask] = byte;
+	return 1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe un bloque de bytes en el búfer. Sólo la puede llamar el productor
+ * @param cb	Búfer circular
+ * @param buf	Bytes a escribir
+ * @param count	Número de bytes a escribir
+ * @return		El número de bytes realmente escritos
+ */
+uint32_t spsc_buffer_write_block (spsc_buffer_t *cb, const uint8_t *buf, uint32_t count);
+
+/*****************************************************************************/
+
+/**
+ * Lee un bloque de bytes del búfer. Sólo la puede llamar el consumidor
+ * @param cb	Búfer circular
+ * @param buf	Búfer donde se almacenarán los bytes
+ * @param count	Número de bytes a leer
+ * @return		El número de bytes realmente leídos
+ */
+uint32_t spsc_buffer_read_block (spsc_buffer_t *cb, uint8_t *buf, uint32_t count);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el tramo contiguo de datos listos para leer, sin consumirlos.
+ * Sólo la puede llamar el consumidor
+ * @param cb	Búfer circular
+ * @param span	Puntero donde se almacenará el comienzo del tramo
+ * @return		El número de bytes contiguos disponibles a partir de *span
+ */
+uint32_t spsc_buffer_peek_read (spsc_buffer_t *cb, uint8_t **span);
+
+/*****************************************************************************/
+
+/**
+ * Consume bytes previamente obtenidos con spsc_buffer_peek_read
+ * @param cb	Búfer circular
+ * @param count	Número de bytes consumidos. No debe superar el tamaño del tramo
+ */
+void spsc_buffer_commit_read (spsc_buffer_t *cb, uint32_t count);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el tramo contiguo de espacio libre para escribir.
+ * Sólo la puede llamar el productor
+ * @param cb	Búfer circular
+ * @param span	Puntero donde se almacenará el comienzo del tramo
+ * @return		El número de bytes contiguos libres a partir de *span
+ */
+uint32_t spsc_buffer_peek_write (spsc_buffer_t *cb, uint8_t **span);
+
+/*****************************************************************************/
+
+/**
+ * Publica bytes escritos en el tramo obtenido con spsc_buffer_peek_write
+ * @param cb	Búfer circular
+ * @param count	Número de bytes escritos. No debe superar el tamaño del tramo
+ */
+void spsc_buffer_commit_write (spsc_buffer_t *cb, uint32_t count);
+
+/*****************************************************************************/
+
+#endif /* __SPSC_BUFFER_H__ */
@@ -0,0 +1,153 @@
+/*
+ * Sistemas operativos empotrados
+ * Rueda jerárquica de temporizadores
+ */
+
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Geometría de la rueda: TIMER_WHEEL_LEVELS niveles de TIMER_WHEEL_SLOTS
+ * ranuras. Cada ranura del nivel n abarca TIMER_WHEEL_SLOTS^n unidades, así que
+ * la rueda cubre TIMER_WHEEL_RANGE unidades. Los vencimientos más lejanos se
+ * guardan en la última ranura y se recolocan al llegar a ella
+ */
+#define TIMER_WHEEL_BITS	6
+#define TIMER_WHEEL_SLOTS	(1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS	4
+#define TIMER_WHEEL_RANGE	(1u << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+/*****************************************************************************/
+
+/**
+ * Definición para las funciones de callback de los temporizadores
+ * @param id	Identificador del temporizador
+ * @param ctx	Contexto indicado al añadir el temporizador
+ */
+typedef void (* timer_wheel_callback_t) (int32_t id, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Nodo de un temporizador. Los nodos salen de una reserva fija que proporciona
+ * quien inicializa la rueda
+ */
+typedef struct timer_wheel_node timer_wheel_node_t;
+
+struct timer_wheel_node
+{
+	timer_wheel_node_t *next;
+	timer_wheel_node_t *prev;
+	uint32_t expires;				/* Instante de vencimiento, en unidades */
+	uint32_t period;				/* Periodo, 0 si es de un disparo */
+	timer_wheel_callback_t func;
+	void *ctx;
+	uint16_t gen;					/* Generación, invalida los identificadores antiguos */
+	uint8_t state;					/* Estado del nodo (ver timer_wheel.c) */
+	uint8_t slot;					/* Nivel * TIMER_WHEEL_SLOTS + ranura */
+};
+
+/*****************************************************************************/
+
+/**
+ * Rueda de temporizadores.
+ * El tiempo se mide en unidades de 32 bits que dan la vuelta, por lo que los
+ * instantes sólo se comparan mediante su diferencia. La rueda no lee ningún
+ * reloj: quien la usa le pasa el instante actual, y tampoco es reentrante, así
+ * que las llamadas se deben proteger con una sección crítica si hace falta
+ */
+typedef struct
+{
+	timer_wheel_node_t *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+	uint64_t bitmap[TIMER_WHEEL_LEVELS];	/* Ranuras ocupadas de cada nivel */
+	timer_wheel_node_t *pool;
+	uint32_t size;
+	timer_wheel_node_t *free;				/* Nodos libres */
+	timer_wheel_node_t *expired;			/* Nodos vencidos aún no entregados */
+	uint32_t now;							/* Siguiente unidad por procesar */
+	uint32_t active;						/* Nodos en la rueda o vencidos */
+} timer_wheel_t;
+
+/*****************************************************************************/
+
+/**
+ * Inicializa una rueda vacía
+ * @param w		Rueda
+ * @param pool	Reserva de nodos
+ * @param size	Número de nodos de la reserva (menor que 65536)
+ * @param now	Instante actual
+ */
+void timer_wheel_init (timer_wheel_t *w, timer_wheel_node_t *pool, uint32_t size, uint32_t now);
+
+/*****************************************************************************/
+
+/**
+ * Añade un temporizador en tiempo constante
+ * @param w			Rueda
+ * @param now		Instante actual
+ * @param expires	Instante de vencimiento. Los instantes pasados vencen en la
+ * 					siguiente unidad
+ * @param period	Periodo, 0 para un temporizador de un disparo
+ * @param func		Callback
+ * @param ctx		Contexto que se pasa a la callback
+ * @return	El identificador del temporizador o -1 si no quedan nodos libres
+ */
+int32_t timer_wheel_add (timer_wheel_t *w, uint32_t now, uint32_t expires, uint32_t period,
+						 timer_wheel_callback_t func, void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Cancela un temporizador en tiempo constante. Se puede llamar desde su propia
+ * callback, entre timer_wheel_expire y timer_wheel_finish
+ * @param w		Rueda
+ * @param id	Identificador del temporizador
+ * @return	Cero en caso de éxito o -1 si el temporizador ya no está activo
+ */
+int32_t timer_wheel_cancel (timer_wheel_t *w, int32_t id);
+
+/*****************************************************************************/
+
+/**
+ * Calcula el próximo instante en que la rueda tiene trabajo: un vencimiento o
+ * el paso de una ranura de un nivel superior al nivel inferior. Es el instante
+ * que se debe programar en el temporizador hardware
+ * @param w		Rueda
+ * @param when	Destino del instante
+ * @return	Cero en caso de éxito o -1 si la rueda está vacía
+ */
+int32_t timer_wheel_next (timer_wheel_t *w, uint32_t *when);
+
+/*****************************************************************************/
+
+/**
+ * Extrae el siguiente temporizador vencido hasta el instante indicado. Avanza
+ * la rueda saltando las ranuras vacías, así que el coste no depende del tiempo
+ * transcurrido. Cada temporizador extraído se debe terminar con
+ * timer_wheel_finish después de llamar a su callback
+ * @param w		Rueda
+ * @param now	Instante actual
+ * @param func	Destino de la callback
+ * @param ctx	Destino del contexto
+ * @return	El identificador del temporizador o -1 si no hay más vencidos
+ */
+int32_t timer_wheel_expire (timer_wheel_t *w, uint32_t now, timer_wheel_callback_t *func, void **ctx);
+
+/*****************************************************************************/
+
+/**
+ * Termina un temporizador extraído con timer_wheel_expire: vuelve a añadir los
+ * periódicos un periodo después de su vencimiento anterior, para que no
+ * acumulen deriva, y libera el resto
+ * @param w		Rueda
+ * @param id	Identificador del temporizador
+ */
+void timer_wheel_finish (timer_wheel_t *w, int32_t id);
+
+/*****************************************************************************/
+
+#endif /* __TIMER_WHEEL_H__ */
@@ -0,0 +1,175 @@
+/*
+ * Sistemas operativos empotrados
+ * Búfer circular para un productor y un consumidor (SPSC)
+ */
+
+#include <string.h>
+#include "spsc_buffer.h"
+
+/*****************************************************************************/
+
+/**
+ * Inicializa un búfer circular dado un puntero a una zona de memoria y su tamaño
+ * @param cb	Puntero a la estructura de gestión del búfer circular
+ * @param addr	Puntero a la zona de memoria que se gestionará como un búfer circular
+ * @param size	Tamaño en bytes del búfer. Si no es potencia de dos sólo se usa
+ * 				la mayor potencia de dos que quepa. Con 0 el búfer queda
+ * 				deshabilitado: siempre está vacío y lleno a la vez
+ */
+void spsc_buffer_init (spsc_buffer_t *cb, uint8_t *addr, uint32_t size)
+{
+	/* Nos quedamos con el bit más significativo */
+	while (size & (size - 1))
+		size &= size - 1;
+
+	/* Sin memoria no hay capacidad (ver spsc_buffer_size) */
+	if (size == 0)
+		addr = NULL;
+
+	cb->data = addr;
+	cb->mask = size ? size - 1 : 0;
+	cb->head = 0;
+	cb->tail = 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe un bloque de bytes en el búfer. Sólo la puede llamar el productor
+ * @param cb	Búfer circular
+ * @param buf	Bytes a escribir
+ * @param count	Número de bytes a escribir
+ * @return		El número de bytes realmente escritos
+ */
+uint32_t spsc_buffer_write_block (spsc_buffer_t *cb, const uint8_t *buf, uint32_t count)
+{
+	uint32_t size = spsc_buffer_size (cb);
+	uint32_t index = cb->head & cb->mask;
+	uint32_t free = size - spsc_buffer_count (cb);
+	uint32_t first;
+
+	/* Escribimos sólo lo que quepa */
+	if (count > free)
+		count = free;
+	if (count == 0)
+		return 0;
+
+	/* Primer tramo hasta el final del búfer, segundo desde el principio */
+	first = size - index;
+	if (first > count)
+		first = count;
+
+	memcpy (cb->data + index, buf, first);
+	memcpy (cb->data, buf + first, count - first);
+
+	spsc_buffer_commit_write (cb, count);
+
+	return count;
+}
+
+/*****************************************************************************/
+
+/**
+ * Lee un bloque de bytes del búfer. Sólo la puede llamar el consumidor
+ * @param cb	Búfer circular
+ * @param buf	Búfer donde se almacenarán los bytes
+ * @param count	Número de bytes a leer
+ * @return		El número de bytes realmente leídos
+ */
+uint32_t spsc_buffer_read_block (spsc_buffer_t *cb, uint8_t *buf, uint32_t count)
+{
+	uint32_t size = spsc_buffer_size (cb);
+	uint32_t index = cb->tail & cb->mask;
+	uint32_t used = spsc_buffer_count (cb);
+	uint32_t first;
+
+	/* Leemos sólo lo que haya */
+	if (count > used)
+		count = used;
+	if (count == 0)
+		return 0;
+
+	/* Primer tramo hasta el final del búfer, segundo desde el principio */
+	first = size - index;
+	if (first > count)
+		first = count;
+
+	memcpy (buf, cb->data + index, first);
+	memcpy (buf + first, cb->data, count - first);
+
+	spsc_buffer_commit_read (cb, count);
+
+	return count;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el tramo contiguo de datos listos para leer, sin consumirlos.
+ * Sólo la puede llamar el consumidor
+ * @param cb	Búfer circular
+ * @param span	Puntero donde se almacenará el comienzo del tramo
+ * @return		El número de bytes contiguos disponibles a partir de *span
+ */
+uint32_t spsc_buffer_peek_read (spsc_buffer_t *cb, uint8_t **span)
+{
+	uint32_t index = cb->tail & cb->mask;
+	uint32_t used = spsc_buffer_count (cb);
+	uint32_t contig = spsc_buffer_size (cb) - index;
+
+	*span = cb->data + index;
+
+	/* El tramo termina en el final de los datos o en el final del búfer */
+	return (used < contig) ? used : contig;
+}
+
+/*****************************************************************************/
+
+/**
+ * Consume bytes previamente obtenidos con spsc_buffer_peek_read
+ * @param cb	Búfer circular
+ * @param count	Número de bytes consumidos. No debe superar el tamaño del tramo
+ */
+void spsc_buffer_commit_read (spsc_buffer_t *cb, uint32_t count)
+{
+	/* Los datos deben haberse leído antes de liberar su espacio */
+	spsc_buffer_barrier ();
+	cb->tail += count;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el tramo contiguo de espacio libre para escribir.
+ * Sólo la puede llamar el productor
+ * @param cb	Búfer circular
+ * @param span	Puntero donde se almacenará el comienzo del tramo
+ * @return		El número de bytes contiguos libres a partir de *span
+ */
+uint32_t spsc_buffer_peek_write (spsc_buffer_t *cb, uint8_t **span)
+{
+	uint32_t index = cb->head & cb->mask;
+	uint32_t free = spsc_buffer_size (cb) - spsc_buffer_count (cb);
+	uint32_t contig = spsc_buffer_size (cb) - index;
+
+	*span = cb->data + index;
+
+	/* El tramo termina en el comienzo de los datos o en el final del búfer */
+	return (free < contig) ? free : contig;
+}
+
+/*****************************************************************************/
+
+/**
+ * Publica bytes escritos en el tramo obtenido con spsc_buffer_peek_write
+ * @param cb	Búfer circular
+ * @param count	Número de bytes escritos. No debe superar el tamaño del tramo
+ */
+void spsc_buffer_commit_write (spsc_buffer_t *cb, uint32_t count)
+{
+	/* Los datos deben estar escritos antes de publicarlos */
+	spsc_buffer_barrier ();
+	cb->head += count;
+}
+
+/*****************************************************************************/
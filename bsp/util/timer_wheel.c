@@ -0,0 +1,457 @@
+/*
+ * Sistemas operativos empotrados
+ * Rueda jerárquica de temporizadores
+ */
+
+#include <stddef.h>
+#include "timer_wheel.h"
+
+/*****************************************************************************/
+
+/**
+ * Estados de los nodos
+ */
+#define TIMER_WHEEL_FREE		0		/* En la lista de libres */
+#define TIMER_WHEEL_PENDING		1		/* En una ranura */
+#define TIMER_WHEEL_EXPIRED		2		/* En la lista de vencidos */
+#define TIMER_WHEEL_FIRING		3		/* Entregado, esperando a timer_wheel_finish */
+#define TIMER_WHEEL_CANCELLED	4		/* Cancelado mientras se entregaba */
+
+/**
+ * Los identificadores combinan la generación (15 bits, para que sean
+ * positivos) y el índice del nodo en la reserva
+ */
+#define TIMER_WHEEL_ID(w, node)		((int32_t) ((((node)->gen & 0x7FFF) << 16) | ((node) - (w)->pool)))
+
+/*****************************************************************************/
+
+/**
+ * Inserta un nodo al principio de una lista
+ * @param head	Cabeza de la lista
+ * @param node	Nodo
+ */
+static inline void timer_wheel_link (timer_wheel_node_t **head, timer_wheel_node_t *node)
+{
+	node->prev = NULL;
+	node->next = *head;
+	if (*head)
+		(*head)->prev = node;
+	*head = node;
+}
+
+/*****************************************************************************/
+
+/**
+ * Saca un nodo de una lista
+ * @param head	Cabeza de la lista
+ * @param node	Nodo
+ */
+static inline void timer_wheel_unlink (timer_wheel_node_t **head, timer_wheel_node_t *node)
+{
+	if (node->prev)
+		node->prev->next = node->next;
+	else
+		*head = node->next;
+	if (node->next)
+		node->next->prev = node->prev;
+}
+
+/*****************************************************************************/
+
+/**
+ * Calcula el número de ceros a la derecha de una máscara no nula en un número
+ * fijo de pasos (el ARM7TDMI no tiene instrucción para ello)
+ * @param bits	Máscara
+ * @return	Posición del bit a 1 menos significativo
+ */
+static inline uint32_t timer_wheel_ctz (uint64_t bits)
+{
+	uint32_t low = (uint32_t) bits;
+	uint32_t i = 0;
+
+	if (!low)
+	{
+		low = (uint32_t) (bits >> 32);
+		i += 32;
+	}
+	if (!(low & 0xFFFF)) { low >>= 16; i += 16; }
+	if (!(low & 0xFF)) { low >>= 8; i += 8; }
+	if (!(low & 0xF)) { low >>= 4; i += 4; }
+	if (!(low & 0x3)) { low >>= 2; i += 2; }
+	if (!(low & 0x1)) { i += 1; }
+
+	return i;
+}
+
+/*****************************************************************************/
+
+/**
+ * Coloca un nodo pendiente en la ranura que le corresponde según la distancia
+ * de su vencimiento al instante actual de la rueda
+ * @param w		Rueda
+ * @param node	Nodo
+ */
+static void timer_wheel_place (timer_wheel_t *w, timer_wheel_node_t *node)
+{
+	uint32_t delta = node->expires - w->now;
+	uint32_t expires = node->expires;
+	uint32_t level = 0;
+	uint32_t index;
+
+	if ((int32_t) delta < 0)
+	{
+		/* Vencido: se entrega en la siguiente unidad */
+		node->expires = expires = w->now;
+		delta = 0;
+	}
+	else if (delta >= TIMER_WHEEL_RANGE)
+	{
+		/* Fuera de rango: se recoloca al llegar a la última ranura */
+		expires = w->now + TIMER_WHEEL_RANGE - 1;
+		delta = TIMER_WHEEL_RANGE - 1;
+	}
+
+	while (delta >= ((uint32_t) TIMER_WHEEL_SLOTS << (TIMER_WHEEL_BITS * level)))
+		level++;
+
+	index = (expires >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+
+	node->state = TIMER_WHEEL_PENDING;
+	node->slot = level * TIMER_WHEEL_SLOTS + index;
+	timer_wheel_link (&w->slots[level][index], node);
+	w->bitmap[level] |= (uint64_t) 1 << index;
+}
+
+/*****************************************************************************/
+
+/**
+ * Saca un nodo pendiente de su ranura
+ * @param w		Rueda
+ * @param node	Nodo
+ */
+static void timer_wheel_remove (timer_wheel_t *w, timer_wheel_node_t *node)
+{
+	uint32_t level = node->slot / TIMER_WHEEL_SLOTS;
+	uint32_t index = node->slot % TIMER_WHEEL_SLOTS;
+
+	timer_wheel_unlink (&w->slots[level][index], node);
+	if (!w->slots[level][index])
+		w->bitmap[level] &= ~((uint64_t) 1 << index);
+}
+
+/*****************************************************************************/
+
+/**
+ * Devuelve un nodo a la lista de libres, invalidando su identificador
+ * @param w		Rueda
+ * @param node	Nodo
+ */
+static void timer_wheel_release (timer_wheel_t *w, timer_wheel_node_t *node)
+{
+	node->gen++;
+	node->state = TIMER_WHEEL_FREE;
+	node->func = NULL;
+	node->next = w->free;
+	w->free = node;
+	w->active--;
+}
+
+/*****************************************************************************/
+
+/**
+ * Busca un nodo a partir de su identificador
+ * @param w		Rueda
+ * @param id	Identificador
+ * @return	El nodo o NULL si el identificador no es válido
+ */
+static timer_wheel_node_t *timer_wheel_lookup (timer_wheel_t *w, int32_t id)
+{
+	uint32_t index = id & 0xFFFF;
+	timer_wheel_node_t *node;
+
+	if (id < 0 || index >= w->size)
+		return NULL;
+
+	node = &w->pool[index];
+	if (node->state == TIMER_WHEEL_FREE || (node->gen & 0x7FFF) != ((uint32_t) id >> 16))
+		return NULL;
+
+	return node;
+}
+
+/*****************************************************************************/
+
+/**
+ * Procesa una unidad: baja a los niveles inferiores las ranuras que empiezan en
+ * ella y pasa los vencimientos a la lista de vencidos
+ * @param w		Rueda
+ * @param unit	Unidad, que pasa a ser el instante actual de la rueda
+ */
+static void timer_wheel_process (timer_wheel_t *w, uint32_t unit)
+{
+	timer_wheel_node_t *list, *node;
+	uint32_t level, index;
+
+	w->now = unit;
+
+	for (level = 1; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		if (unit & ((1u << (TIMER_WHEEL_BITS * level)) - 1))
+			break;
+
+		index = (unit >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+		list = w->slots[level][index];
+		w->slots[level][index] = NULL;
+		w->bitmap[level] &= ~((uint64_t) 1 << index);
+
+		while (list)
+		{
+			node = list;
+			list = list->next;
+			timer_wheel_place (w, node);
+		}
+	}
+
+	index = unit & (TIMER_WHEEL_SLOTS - 1);
+	list = w->slots[0][index];
+	w->slots[0][index] = NULL;
+	w->bitmap[0] &= ~((uint64_t) 1 << index);
+
+	while (list)
+	{
+		node = list;
+		list = list->next;
+		node->state = TIMER_WHEEL_EXPIRED;
+		timer_wheel_link (&w->expired, node);
+	}
+
+	/* Lo que se añada desde las callbacks ya no cae en esta unidad */
+	w->now = unit + 1;
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa una rueda vacía
+ * @param w		Rueda
+ * @param pool	Reserva de nodos
+ * @param size	Número de nodos de la reserva (menor que 65536)
+ * @param now	Instante actual
+ */
+void timer_wheel_init (timer_wheel_t *w, timer_wheel_node_t *pool, uint32_t size, uint32_t now)
+{
+	uint32_t level, index;
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		for (index = 0; index < TIMER_WHEEL_SLOTS; index++)
+			w->slots[level][index] = NULL;
+		w->bitmap[level] = 0;
+	}
+
+	w->pool = pool;
+	w->size = size;
+	w->free = NULL;
+	w->expired = NULL;
+	w->now = now;
+	w->active = size;
+
+	/* Los nodos se liberan en orden inverso para que el primero sea el 0 */
+	while (size--)
+	{
+		pool[size].gen = 0;
+		timer_wheel_release (w, &pool[size]);
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Añade un temporizador en tiempo constante
+ * @param w			Rueda
+ * @param now		Instante actual
+ * @param expires	Instante de vencimiento. Los instantes pasados vencen en la
+ * 					siguiente unidad
+ * @param period	Periodo, 0 para un temporizador de un disparo
+ * @param func		Callback
+ * @param ctx		Contexto que se pasa a la callback
+ * @return	El identificador del temporizador o -1 si no quedan nodos libres
+ */
+int32_t timer_wheel_add (timer_wheel_t *w, uint32_t now, uint32_t expires, uint32_t period,
+						 timer_wheel_callback_t func, void *ctx)
+{
+	timer_wheel_node_t *node = w->free;
+
+	if (!node)
+		return -1;
+
+	/* Con la rueda vacía no hay ranuras que procesar hasta el instante actual */
+	if (w->active == 0)
+		w->now = now;
+
+	w->free = node->next;
+	w->active++;
+
+	node->expires = expires;
+	node->period = period;
+	node->func = func;
+	node->ctx = ctx;
+	timer_wheel_place (w, node);
+
+	return TIMER_WHEEL_ID (w, node);
+}
+
+/*****************************************************************************/
+
+/**
+ * Cancela un temporizador en tiempo constante. Se puede llamar desde su propia
+ * callback, entre timer_wheel_expire y timer_wheel_finish
+ * @param w		Rueda
+ * @param id	Identificador del temporizador
+ * @return	Cero en caso de éxito o -1 si el temporizador ya no está activo
+ */
+int32_t timer_wheel_cancel (timer_wheel_t *w, int32_t id)
+{
+	timer_wheel_node_t *node = timer_wheel_lookup (w, id);
+
+	if (!node)
+		return -1;
+
+	switch (node->state)
+	{
+		case TIMER_WHEEL_PENDING:
+			timer_wheel_remove (w, node);
+			timer_wheel_release (w, node);
+			break;
+		case TIMER_WHEEL_EXPIRED:
+			timer_wheel_unlink (&w->expired, node);
+			timer_wheel_release (w, node);
+			break;
+		case TIMER_WHEEL_FIRING:
+			/* Lo libera timer_wheel_finish */
+			node->state = TIMER_WHEEL_CANCELLED;
+			break;
+		default:
+			return -1;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Calcula el próximo instante en que la rueda tiene trabajo: un vencimiento o
+ * el paso de una ranura de un nivel superior al nivel inferior. Es el instante
+ * que se debe programar en el temporizador hardware
+ * @param w		Rueda
+ * @param when	Destino del instante
+ * @return	Cero en caso de éxito o -1 si la rueda está vacía
+ */
+int32_t timer_wheel_next (timer_wheel_t *w, uint32_t *when)
+{
+	uint32_t level, shift, start, base, unit;
+	uint32_t best = 0, found = 0;
+	uint64_t bits;
+
+	if (w->expired)
+	{
+		*when = w->now;
+		return 0;
+	}
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		bits = w->bitmap[level];
+		if (!bits)
+			continue;
+
+		/* Primera unidad a partir de now en la que empieza una ranura del nivel */
+		shift = TIMER_WHEEL_BITS * level;
+		base = (w->now + (1u << shift) - 1) & ~((1u << shift) - 1);
+		start = (base >> shift) & (TIMER_WHEEL_SLOTS - 1);
+
+		/* Primera ranura ocupada, dando la vuelta desde la actual */
+		if (start)
+			bits = (bits >> start) | (bits << (TIMER_WHEEL_SLOTS - start));
+		unit = base + (timer_wheel_ctz (bits) << shift);
+
+		if (!found || unit - w->now < best - w->now)
+			best = unit;
+		found = 1;
+	}
+
+	if (!found)
+		return -1;
+
+	*when = best;
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Extrae el siguiente temporizador vencido hasta el instante indicado. Avanza
+ * la rueda saltando las ranuras vacías, así que el coste no depende del tiempo
+ * transcurrido. Cada temporizador extraído se debe terminar con
+ * timer_wheel_finish después de llamar a su callback
+ * @param w		Rueda
+ * @param now	Instante actual
+ * @param func	Destino de la callback
+ * @param ctx	Destino del contexto
+ * @return	El identificador del temporizador o -1 si no hay más vencidos
+ */
+int32_t timer_wheel_expire (timer_wheel_t *w, uint32_t now, timer_wheel_callback_t *func, void **ctx)
+{
+	timer_wheel_node_t *node;
+	uint32_t unit;
+
+	while (!w->expired)
+	{
+		if (timer_wheel_next (w, &unit) < 0 || (int32_t) (unit - now) > 0)
+		{
+			/* Nada hasta now: las unidades intermedias están vacías */
+			if ((int32_t) (now + 1 - w->now) > 0)
+				w->now = now + 1;
+			return -1;
+		}
+
+		timer_wheel_process (w, unit);
+	}
+
+	node = w->expired;
+	timer_wheel_unlink (&w->expired, node);
+	node->state = TIMER_WHEEL_FIRING;
+
+	*func = node->func;
+	*ctx = node->ctx;
+
+	return TIMER_WHEEL_ID (w, node);
+}
+
+/*****************************************************************************/
+
+/**
+ * Termina un temporizador extraído con timer_wheel_expire: vuelve a añadir los
+ * periódicos un periodo después de su vencimiento anterior, para que no
+ * acumulen deriva, y libera el resto
+ * @param w		Rueda
+ * @param id	Identificador del temporizador
+ */
+void timer_wheel_finish (timer_wheel_t *w, int32_t id)
+{
+	timer_wheel_node_t *node = timer_wheel_lookup (w, id);
+
+	if (!node || (node->state != TIMER_WHEEL_FIRING && node->state != TIMER_WHEEL_CANCELLED))
+		return;
+
+	if (node->state == TIMER_WHEEL_FIRING && node->period)
+	{
+		node->expires += node->period;
+		timer_wheel_place (w, node);
+	}
+	else
+		timer_wheel_release (w, node);
+}
+
+/*****************************************************************************/
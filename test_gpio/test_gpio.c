@@ -118,7 +118,7 @@ void undef_handler(void){
  * Manejador de interrupciones ASM 
  */
 
-void asm_handler(void){
+void asm_handler(itc_src_t src, void *ctx){
     gpio_set_pin(GREEN_LED);
     itc_unforce_interrupt(itc_src_asm);
 }
@@ -132,7 +132,7 @@ int main ()
 {
     gpio_init();
 
-    itc_set_handler(itc_src_asm, asm_handler);
+    itc_set_handler(itc_src_asm, asm_handler, NULL);
     excep_set_handler(excep_undef, undef_handler);
     
 //     itc_enable_interrupt(itc_src_asm);
@@ -99,7 +99,7 @@ void undef_handler(void){
  * Manejador de interrupciones ASM 
  */
 
-void asm_handler(void){
+void asm_handler(itc_src_t src, void *ctx){
     *reg_gpio_data_set1 = led_green_mask;
     itc_unforce_interrupt(itc_src_asm);
 }
@@ -113,7 +113,7 @@ int main ()
 {
     gpio_init();
 
-    itc_set_handler(itc_src_asm, asm_handler);
+    itc_set_handler(itc_src_asm, asm_handler, NULL);
     excep_set_handler(excep_undef, undef_handler);
     
     itc_enable_interrupt(itc_src_asm);
@@ -0,0 +1,173 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Sistemas Empotrados                                                       */
+/* Programa para testear el núcleo de tareas                                 */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "system.h"
+
+/*
+ * Constantes relativas a la plataforma
+ */
+
+// El led rojo está en el GPIO 44
+#define RED_LED gpio_pin_44
+
+// El led verde está en el GPIO 45
+#define GREEN_LED gpio_pin_45
+
+/*
+ * Constantes relativas a la aplicacion
+ */
+
+// Periodo de parpadeo del led rojo, en milisegundos
+#define BLINK_PERIOD_MS 250
+
+// Periodo de los informes, en milisegundos
+#define REPORT_PERIOD_MS 1000
+
+// Prioridades: el puente de la uart expulsa a las demás en cuanto llega un byte
+#define BRIDGE_PRIO  3
+#define BLINK_PRIO   2
+#define SAMPLER_PRIO 1
+
+/*
+ * Tareas y sus pilas
+ */
+bsp_task_t bridge_task, blink_task, sampler_task, report_task;
+BSP_TASK_STACK(bridge_stack, 512);
+BSP_TASK_STACK(blink_stack, 256);
+BSP_TASK_STACK(sampler_stack, 256);
+BSP_TASK_STACK(report_stack, 1024);
+
+//Contadores compartidos, protegidos por el mutex
+bsp_mutex_t stats_lock;
+uint32_t echoed = 0;
+uint32_t samples = 0;
+
+/*****************************************************************************/
+
+/*
+ * Inicialización de los pines de E/S
+ */
+void gpio_init(void)
+{
+    // Configuramos el GPIO44 y GPIO45 para que sea de salida
+    gpio_set_port_dir_output(gpio_port_1, 1 << (RED_LED - 32) | 1 << (GREEN_LED - 32));
+}
+
+/*****************************************************************************/
+
+/*
+ * Puente de la uart: devuelve lo que recibe. Se bloquea en read sin consumir
+ * CPU mientras no llegan datos
+ */
+void bridge(void *arg){
+    char buf[16];
+    ssize_t n;
+
+    while(1){
+        n = read(STDIN_FILENO, buf, sizeof(buf));
+        if(n > 0){
+            write(STDOUT_FILENO, buf, n);
+            bsp_mutex_lock(&stats_lock, BSP_KERNEL_FOREVER);
+            echoed += n;
+            bsp_mutex_unlock(&stats_lock);
+        }
+    }
+}
+
+/*****************************************************************************/
+
+/*
+ * Parpadeo del led rojo con esperas del núcleo
+ */
+void blink(void *arg){
+    uint8_t on = 0;
+
+    while(1){
+        on = !on;
+        if(on){
+            gpio_set_pin(RED_LED);
+        }
+        else{
+            gpio_clear_pin(RED_LED);
+        }
+        bsp_task_sleep(BSP_KERNEL_MS(BLINK_PERIOD_MS));
+    }
+}
+
+/*****************************************************************************/
+
+/*
+ * Muestreo sin esperas: sólo avanza cuando las demás tareas están bloqueadas,
+ * y cambia el led verde cada 100000 muestras
+ */
+void sampler(void *arg){
+    while(1){
+        bsp_mutex_lock(&stats_lock, BSP_KERNEL_FOREVER);
+        samples++;
+        if(samples % 100000 == 0){
+            gpio_set_port(gpio_port_1, 1 << (GREEN_LED - 32));
+        }
+        else if(samples % 100000 == 50000){
+            gpio_clear_port(gpio_port_1, 1 << (GREEN_LED - 32));
+        }
+        bsp_mutex_unlock(&stats_lock);
+    }
+}
+
+/*****************************************************************************/
+
+/*
+ * Informe periódico. Tiene la misma prioridad que el muestreo, con el que se
+ * turna en cada tick mientras no duerme
+ */
+void report(void *arg){
+    uint32_t e, s;
+
+    while(1){
+        bsp_task_sleep(BSP_KERNEL_MS(REPORT_PERIOD_MS));
+
+        bsp_mutex_lock(&stats_lock, BSP_KERNEL_FOREVER);
+        e = echoed;
+        s = samples;
+        bsp_mutex_unlock(&stats_lock);
+
+        printf("\r\nt = %lu ticks, eco = %lu bytes, muestras = %lu, pila libre = %lu/%lu/%lu/%lu\r\n",
+               (unsigned long) bsp_kernel_ticks(), (unsigned long) e, (unsigned long) s,
+               (unsigned long) bsp_task_stack_free(&bridge_task),
+               (unsigned long) bsp_task_stack_free(&blink_task),
+               (unsigned long) bsp_task_stack_free(&sampler_task),
+               (unsigned long) bsp_task_stack_free(&report_task));
+    }
+}
+
+/*****************************************************************************/
+
+/*
+ * Programa principal
+ */
+int main ()
+{
+    gpio_init();
+    bsp_mutex_init(&stats_lock);
+
+    bsp_task_create(&bridge_task, "bridge", BRIDGE_PRIO, bridge, NULL, bridge_stack, sizeof(bridge_stack));
+    bsp_task_create(&blink_task, "blink", BLINK_PRIO, blink, NULL, blink_stack, sizeof(blink_stack));
+    bsp_task_create(&sampler_task, "sampler", SAMPLER_PRIO, sampler, NULL, sampler_stack, sizeof(sampler_stack));
+    bsp_task_create(&report_task, "report", SAMPLER_PRIO, report, NULL, report_stack, sizeof(report_stack));
+
+    printf("Arrancando el núcleo\r\n");
+
+    //main pasa a ser la tarea ociosa
+    bsp_kernel_start();
+
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,241 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Sistemas Empotrados                                                       */
+/* Programa para testear las corrutinas sin pila                             */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include "system.h"
+
+/*
+ * Constantes relativas a la plataforma
+ */
+
+// El led rojo está en el GPIO 44
+#define RED_LED gpio_pin_44
+
+// El led verde está en el GPIO 45
+#define GREEN_LED gpio_pin_45
+
+// Pin de salida del switch S3
+#define KBI0            gpio_pin_22
+
+// Pin de entrada del switch S3, que es KBI4
+#define KBI4            gpio_pin_26
+
+/*
+ * Constantes relativas a la aplicacion
+ */
+
+// Periodo de parpadeo del led rojo, en milisegundos
+#define BLINK_PERIOD_MS 250
+
+// Tiempo de rebote del switch, en milisegundos
+#define DEBOUNCE_MS 50
+
+// Plazo para terminar una línea, en milisegundos
+#define LINE_TIMEOUT_MS 5000
+
+// Periodo de los informes, en milisegundos
+#define REPORT_PERIOD_MS 1000
+
+// Número de contadores independientes
+#define TICKERS 24
+
+/*
+ * Corrutinas y su estado. Las variables locales no sobreviven a una espera,
+ * así que lo que se necesita después va en estas estructuras
+ */
+bsp_pt_t blink_pt, button_pt, line_pt, report_pt;
+bsp_pt_t ticker_pts[TICKERS];
+
+uint32_t presses = 0;
+uint32_t lines = 0;
+uint32_t timeouts = 0;
+uint32_t ticks[TICKERS];
+
+struct
+{
+    char buf[64];
+    uint32_t len;
+    uint32_t sent;
+} line;
+
+/*****************************************************************************/
+
+/*
+ * Inicialización de los pines de E/S
+ */
+void gpio_init(void)
+{
+    // Configuramos el GPIO44 y GPIO45 para que sea de salida
+    gpio_set_port_dir_output(gpio_port_1, 1 << (RED_LED - 32) | 1 << (GREEN_LED - 32));
+
+    //El switch S3 une KBI0 con KBI4: con un 1 en KBI0, pulsarlo da un flanco de subida
+    gpio_set_port_dir_output(gpio_port_0, 1 << KBI0);
+    gpio_set_port_dir_input(gpio_port_0, 1 << KBI4);
+    gpio_set_port(gpio_port_0, 1 << KBI0);
+}
+
+/*****************************************************************************/
+
+/*
+ * Parpadeo del led rojo, sin espera activa
+ */
+PT_THREAD(blink(bsp_pt_t *bpt, void *ctx)){
+    static uint8_t on = 0;
+
+    BSP_PT_BEGIN(bpt);
+    while(1){
+        on = !on;
+        if(on){
+            gpio_set_pin(RED_LED);
+        }
+        else{
+            gpio_clear_pin(RED_LED);
+        }
+        BSP_PT_SLEEP(bpt, BLINK_PERIOD_MS);
+    }
+    BSP_PT_END(bpt);
+}
+
+/*****************************************************************************/
+
+/*
+ * Cada pulsación de S3 cambia el led verde. La corrutina sólo se ejecuta con
+ * el flanco de KBI4
+ */
+PT_THREAD(button(bsp_pt_t *bpt, void *ctx)){
+    static uint8_t on = 0;
+
+    BSP_PT_BEGIN(bpt);
+    while(1){
+        BSP_PT_WAIT_SIGNAL(bpt, BSP_PT_SIGNAL_KBI(4));
+        presses++;
+        on = !on;
+        if(on){
+            gpio_set_pin(GREEN_LED);
+        }
+        else{
+            gpio_clear_pin(GREEN_LED);
+        }
+        //Los rebotes que lleguen mientras tanto se descartan al volver a esperar
+        BSP_PT_SLEEP(bpt, DEBOUNCE_MS);
+    }
+    BSP_PT_END(bpt);
+}
+
+/*****************************************************************************/
+
+/*
+ * Devuelve por la uart1 cada línea recibida. Si la línea no se termina a
+ * tiempo se descarta
+ */
+PT_THREAD(echo_line(bsp_pt_t *bpt, void *ctx)){
+    char c = 0;
+    ssize_t n;
+
+    BSP_PT_BEGIN(bpt);
+    while(1){
+        line.len = 0;
+        bsp_pt_set_timer(bpt, LINE_TIMEOUT_MS);
+
+        do{
+            BSP_PT_WAIT_UNTIL(bpt, BSP_PT_SIGNAL_UART_RX(uart_1) | BSP_PT_SIGNAL_TIMER,
+                              uart_rx_count(uart_1) > 0 || bsp_pt_timer_expired(bpt));
+            if(uart_rx_count(uart_1) == 0)
+                break;
+            uart_receive(uart_1, &c, 1);
+            if(line.len < sizeof(line.buf))
+                line.buf[line.len++] = c;
+        }while(c != '\r' && c != '\n');
+
+        if(line.len == 0 || (line.buf[line.len - 1] != '\r' && line.buf[line.len - 1] != '\n')){
+            timeouts++;
+            continue;
+        }
+
+        //Se envía por partes según va quedando hueco en el búfer de transmisión
+        lines++;
+        line.sent = 0;
+        while(line.sent < line.len){
+            BSP_PT_WAIT_UART_TX(bpt, uart_1);
+            n = uart_send(uart_1, line.buf + line.sent, line.len - line.sent);
+            if(n > 0)
+                line.sent += n;
+        }
+    }
+    BSP_PT_END(bpt);
+}
+
+/*****************************************************************************/
+
+/*
+ * Contadores con periodos distintos, para ver cuántas máquinas de estados
+ * caben sin pila propia
+ */
+PT_THREAD(ticker(bsp_pt_t *bpt, void *ctx)){
+    uint32_t i = bpt - ticker_pts;
+
+    BSP_PT_BEGIN(bpt);
+    while(1){
+        BSP_PT_SLEEP(bpt, 10 * (i + 1));
+        ticks[i]++;
+    }
+    BSP_PT_END(bpt);
+}
+
+/*****************************************************************************/
+
+/*
+ * Informe periódico
+ */
+PT_THREAD(report(bsp_pt_t *bpt, void *ctx)){
+    static uint32_t total;
+    static uint32_t i;
+
+    BSP_PT_BEGIN(bpt);
+    while(1){
+        BSP_PT_SLEEP(bpt, REPORT_PERIOD_MS);
+
+        for(i = 0, total = 0; i < TICKERS; i++)
+            total += ticks[i];
+
+        printf("\r\nt = %lu ms, pulsaciones = %lu, lineas = %lu, plazos = %lu, ticks = %lu, corrutinas = %u x %u bytes\r\n",
+               (unsigned long) bsp_pt_now(), (unsigned long) presses, (unsigned long) lines,
+               (unsigned long) timeouts, (unsigned long) total,
+               (unsigned) (TICKERS + 4), (unsigned) sizeof(bsp_pt_t));
+    }
+    BSP_PT_END(bpt);
+}
+
+/*****************************************************************************/
+
+/*
+ * Programa principal
+ */
+int main ()
+{
+    uint32_t i;
+
+    gpio_init();
+    crm_set_kbi_irq(CRM_WAKE_KBI(4));
+
+    bsp_pt_start(&blink_pt, blink, NULL);
+    bsp_pt_start(&button_pt, button, NULL);
+    bsp_pt_start(&line_pt, echo_line, NULL);
+    bsp_pt_start(&report_pt, report, NULL);
+    for(i = 0; i < TICKERS; i++)
+        bsp_pt_start(&ticker_pts[i], ticker, NULL);
+
+    printf("Arrancando las corrutinas\r\n");
+
+    //Sin nada que hacer, el gestor de bajo consumo duerme hasta la siguiente señal
+    bsp_pt_loop();
+
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,131 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Sistemas Empotrados                                                       */
+/* Programa para testear el driver de los temporizadores                     */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include "system.h"
+
+/*
+ * Constantes relativas a la plataforma
+ */
+
+// El led rojo está en el GPIO 44
+#define RED_LED gpio_pin_44
+
+// El led verde está en el GPIO 45
+#define GREEN_LED gpio_pin_45
+
+/*
+ * Constantes relativas a la aplicacion
+ */
+
+// Periodo de parpadeo del led rojo, en microsegundos
+#define RED_PERIOD_US   250000
+
+// Periodo de parpadeo del led verde, en microsegundos (más largo que un tramo de 16 bits)
+#define GREEN_PERIOD_US 1000000
+
+// Retardo activo que se mide en cada vuelta
+#define DELAY_US        1000
+
+//Estado de los leds en variables globales
+uint8_t red_led_on = 0;
+uint8_t green_led_on = 0;
+
+//Instante del siguiente vencimiento del led verde
+uint64_t green_deadline;
+
+/*****************************************************************************/
+
+/*
+ * Inicialización de los pines de E/S
+ */
+void gpio_init(void)
+{
+    // Configuramos el GPIO44 y GPIO45 para que sea de salida
+    gpio_set_port_dir_output(gpio_port_1, 1 << (RED_LED - 32) | 1 << (GREEN_LED - 32));
+}
+
+/*****************************************************************************/
+
+/*
+ * Callback del temporizador periódico, se ejecuta en la isr
+ */
+void red_callback(tmr_id_t tmr, void *ctx){
+    uint8_t *on = ctx;
+
+    *on = !*on;
+    if(*on){
+        gpio_set_pin(RED_LED);
+    }
+    else{
+        gpio_clear_pin(RED_LED);
+    }
+}
+
+/*****************************************************************************/
+
+/*
+ * Manejador del evento del temporizador de un disparo. Se reprograma con un
+ * instante absoluto para que el parpadeo no acumule deriva
+ */
+void timer_event_handler(const bsp_event_t *event, void *ctx){
+    uint64_t late;
+
+    if(event->source != tmr_2){
+        return;
+    }
+
+    late = tmr_now() - green_deadline;
+    green_led_on = !green_led_on;
+    if(green_led_on){
+        gpio_set_pin(GREEN_LED);
+    }
+    else{
+        gpio_clear_pin(GREEN_LED);
+    }
+
+    green_deadline += tmr_us_to_ticks(GREEN_PERIOD_US);
+    tmr_set_deadline(tmr_2, green_deadline, NULL, NULL);
+
+    printf("t = %lu us, retraso del evento = %lu us\r\n",
+           (unsigned long) tmr_ticks_to_us(tmr_now()), (unsigned long) tmr_ticks_to_us(late));
+}
+
+/*****************************************************************************/
+
+/*
+ * Programa principal
+ */
+int main ()
+{
+    uint64_t start, elapsed;
+
+    gpio_init();
+
+    //Comprobamos el retardo activo
+    start = tmr_now();
+    tmr_delay_us(DELAY_US);
+    elapsed = tmr_now() - start;
+    printf("tmr_delay_us(%u) = %lu us\r\n", DELAY_US, (unsigned long) tmr_ticks_to_us(elapsed));
+
+    //El led rojo parpadea desde la isr y el verde desde el despachador
+    tmr_start(tmr_1, tmr_us_to_ticks(RED_PERIOD_US), tmr_periodic, red_callback, &red_led_on);
+
+    bsp_event_set_handler(bsp_event_timer, timer_event_handler, NULL);
+    green_deadline = tmr_now() + tmr_us_to_ticks(GREEN_PERIOD_US);
+    tmr_set_deadline(tmr_2, green_deadline, NULL, NULL);
+
+    while (1)
+    {
+        bsp_event_dispatch();
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
@@ -74,7 +74,7 @@ void pause(void)
  * Callback de recepción
  */
 
-void my_rx_callback(void){
+void my_rx_callback(uart_id_t uart, void *ctx){
     
     //Mensaje de error
     char c;
@@ -100,7 +100,7 @@ int main ()
 {
     gpio_init();
     
-    uart_set_receive_callback(uart_1, (uart_callback_t) my_rx_callback);
+    uart_set_receive_callback(uart_1, my_rx_callback, NULL);
 
     while (1)
     {
@@ -0,0 +1,268 @@
+/*
+ * Sistemas operativos empotrados
+ * Prueba en el host del cálculo de los divisores de velocidad de las uart
+ *
+ * Resuelve las velocidades estándar con el reloj de la placa (CPU_FREQ de
+ * system.h, que pasa el Makefile) y comprueba que el error queda dentro de
+ * UART_BAUDRATE_TOLERANCE, que la velocidad y el error que se informan
+ * corresponden a la pareja INC/MOD elegida y que ninguna otra pareja de 16 bits
+ * se acerca más, recorriendo todos los valores de MOD. Lo mismo se comprueba
+ * para una serie de velocidades arbitrarias. Después verifica que se rechazan
+ * las entradas fuera de rango sin tocar el resultado
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "baudrate.h"
+
+#if !defined (CPU_FREQ) || !defined (UART_BAUDRATE_TOLERANCE)
+#error "El Makefile define CPU_FREQ y UART_BAUDRATE_TOLERANCE a partir de system.h"
+#endif
+
+/*****************************************************************************/
+
+#define DIV_MAX		65536u		/* Máximo valor de (inc + 1) y (mod + 1) */
+#define SWEEP		500			/* Velocidades arbitrarias */
+
+/**
+ * Velocidades estándar. Las marcadas como exactas salen sin error con el reloj
+ * de 24 MHz
+ */
+static const struct
+{
+	uint32_t baud;
+	int exact;
+} rates[] =
+{
+	{ 300, 1 }, { 600, 1 }, { 1200, 1 }, { 2400, 1 }, { 4800, 1 }, { 9600, 1 },
+	{ 14400, 1 }, { 19200, 1 }, { 38400, 1 }, { 57600, 1 }, { 115200, 1 },
+	{ 230400, 1 }, { 460800, 1 }, { 921600, 1 }, { 1000000, 1 }, { 1200000, 1 },
+	{ 1500000, 1 }, { 2000000, 1 }, { 3000000, 1 }, { 110, 0 }, { 250000, 1 }
+};
+
+#define N_RATES		(sizeof (rates) / sizeof (rates[0]))
+
+/*****************************************************************************/
+
+/**
+ * Termina con un error
+ * @param what	Error
+ * @param baud	Velocidad implicada
+ * @param os	Sobremuestreo pedido
+ */
+static void fail (const char *what, uint32_t baud, uint32_t os)
+{
+	fprintf (stderr, "FALLO: %s\n  reloj %u Hz, velocidad %u, sobremuestreo %u\n",
+			 what, CPU_FREQ, baud, os);
+	exit (EXIT_FAILURE);
+}
+
+/*****************************************************************************/
+
+/**
+ * Error en ppm de una razón, con el mismo redondeo que baudrate_solve
+ * @param baud	Velocidad pedida
+ * @param os	Sobremuestreo
+ * @param num	inc + 1
+ * @param den	mod + 1
+ * @return	Error relativo en ppm
+ */
+static int32_t error_ppm (uint32_t baud, uint32_t os, uint32_t num, uint32_t den)
+{
+	int64_t target = (int64_t) baud * os * den;
+	int64_t actual = (int64_t) CPU_FREQ * num;
+
+	return ((actual - target) * 1000000) / target;
+}
+
+/*****************************************************************************/
+
+/**
+ * Busca por fuerza bruta el menor error alcanzable con un sobremuestreo: para
+ * cada MOD sólo pueden ser óptimos los dos INC que rodean el valor ideal
+ * @param baud	Velocidad pedida
+ * @param os	Sobremuestreo
+ * @return	Menor error absoluto en ppm, o -1 si ninguna pareja es válida
+ */
+static int32_t search (uint32_t baud, uint32_t os)
+{
+	int32_t best = -1, err;
+	uint32_t den, num, k;
+
+	for (den = 1; den <= DIV_MAX; den++)
+	{
+		num = (uint32_t) ((uint64_t) baud * os * den / CPU_FREQ);
+		for (k = num; k <= num + 1; k++)
+		{
+			/* La razón (inc + 1) / (mod + 1) no puede superar 1 */
+			if (k == 0 || k > den)
+				continue;
+			err = error_ppm (baud, os, k, den);
+			if (err < 0)
+				err = -err;
+			if (best < 0 || err < best)
+				best = err;
+		}
+	}
+
+	return best;
+}
+
+/*****************************************************************************/
+
+/**
+ * Resuelve una velocidad y comprueba el resultado: coherencia de la
+ * velocidad y el error que se informan, tolerancia y optimalidad
+ * @param baud	Velocidad pedida
+ * @param os	Sobremuestreo pedido (0, 16 u 8)
+ * @param cfg	Destino de la configuración
+ * @return	Cero si se ha resuelto o -1 si baudrate_solve la rechaza
+ */
+static int32_t check (uint32_t baud, uint32_t os, baudrate_t *cfg)
+{
+	int32_t best16 = -1, best8 = -1, best, err;
+	uint32_t num, den, rate;
+
+	if (os != 8)
+		best16 = search (baud, 16);
+	if (os != 16)
+		best8 = search (baud, 8);
+	best = (best16 < 0 || (best8 >= 0 && best8 < best16)) ? best8 : best16;
+
+	if (baudrate_solve (CPU_FREQ, baud, os, UART_BAUDRATE_TOLERANCE, cfg) < 0)
+	{
+		if (errno != EINVAL)
+			fail ("el rechazo no indica EINVAL", baud, os);
+		if (best >= 0 && best <= UART_BAUDRATE_TOLERANCE)
+			fail ("se rechaza una velocidad alcanzable dentro de la tolerancia", baud, os);
+		return -1;
+	}
+
+	num = cfg->inc + 1u;
+	den = cfg->mod + 1u;
+	rate = (uint32_t) (((uint64_t) CPU_FREQ * num + (uint64_t) cfg->oversampling * den / 2) /
+					   ((uint64_t) cfg->oversampling * den));
+	err = error_ppm (baud, cfg->oversampling, num, den);
+
+	if (cfg->oversampling != 16 && cfg->oversampling != 8)
+		fail ("sobremuestreo no válido", baud, os);
+	if (os && cfg->oversampling != os)
+		fail ("no se respeta el sobremuestreo pedido", baud, os);
+	if (cfg->inc > cfg->mod)
+		fail ("INC supera a MOD", baud, os);
+	if (cfg->rate != rate || cfg->error_ppm != err)
+		fail ("la velocidad o el error informados no corresponden a INC/MOD", baud, os);
+	if ((err < 0 ? -err : err) > UART_BAUDRATE_TOLERANCE)
+		fail ("el error supera la tolerancia", baud, os);
+	if ((err < 0 ? -err : err) != best)
+		fail ("hay otra pareja INC/MOD con menos error", baud, os);
+	if (os == 0 && best16 >= 0 && best16 == best && cfg->oversampling != 16)
+		fail ("en caso de empate se debe preferir el sobremuestreo de 16x", baud, os);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Comprueba que una llamada se rechaza con el errno indicado sin modificar
+ * el resultado
+ * @param what		Descripción del caso
+ * @param baud		Velocidad pedida
+ * @param os		Sobremuestreo pedido
+ * @param tolerance	Error máximo admitido
+ * @param expected	errno esperado
+ */
+static void reject (const char *what, uint32_t baud, uint32_t os, uint32_t tolerance, int expected)
+{
+	baudrate_t cfg, orig;
+
+	memset (&cfg, 0xA5, sizeof (cfg));
+	orig = cfg;
+	errno = 0;
+
+	if (baudrate_solve (CPU_FREQ, baud, os, tolerance, &cfg) == 0)
+		fail (what, baud, os);
+	if (errno != expected)
+		fail ("errno incorrecto en un rechazo", baud, os);
+	if (memcmp (&cfg, &orig, sizeof (cfg)))
+		fail ("un rechazo modifica el resultado", baud, os);
+
+	printf ("rechazada: %s\n", what);
+}
+
+/*****************************************************************************/
+
+int main (void)
+{
+	static const uint32_t modes[] = { 0, 16, 8 };
+	baudrate_t cfg;
+	uint32_t i, m, baud, x = 2463534242u;
+	int32_t best;
+
+	printf ("reloj %u Hz, tolerancia %d ppm\n", CPU_FREQ, UART_BAUDRATE_TOLERANCE);
+	printf ("%10s %4s %6s %6s %10s %8s\n", "baudios", "os", "inc", "mod", "obtenida", "ppm");
+
+	/* Velocidades estándar con la elección automática y los dos sobremuestreos */
+	for (i = 0; i < N_RATES; i++)
+	{
+		for (m = 0; m < sizeof (modes) / sizeof (modes[0]); m++)
+		{
+			if (check (rates[i].baud, modes[m], &cfg) < 0)
+			{
+				if (modes[m] == 0)
+					fail ("no se alcanza una velocidad estándar", rates[i].baud, 0);
+				continue;
+			}
+			if (modes[m] != 0)
+				continue;
+
+			printf ("%10u %4u %6u %6u %10u %8d\n", rates[i].baud, cfg.oversampling,
+					cfg.inc, cfg.mod, cfg.rate, cfg.error_ppm);
+			if (rates[i].exact && (cfg.error_ppm != 0 || cfg.rate != rates[i].baud))
+				fail ("una velocidad exacta tiene error", rates[i].baud, 0);
+		}
+	}
+
+	/* Velocidades arbitrarias en todo el rango, incluidas las inalcanzables */
+	for (i = 0; i < SWEEP; i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		baud = 1 + x % (CPU_FREQ / 4);
+		for (m = 0; m < sizeof (modes) / sizeof (modes[0]); m++)
+			check (baud, modes[m], &cfg);
+	}
+	printf ("%u velocidades arbitrarias ok\n", SWEEP);
+
+	/* Entradas fuera de rango */
+	reject ("velocidad nula", 0, 0, UART_BAUDRATE_TOLERANCE, EINVAL);
+	reject ("velocidad un 2% por encima de CPU_FREQ / 8", CPU_FREQ / 8 / 100 * 102, 0,
+			UART_BAUDRATE_TOLERANCE, EINVAL);
+	reject ("velocidad un 2% por encima de CPU_FREQ / 16 con 16x", CPU_FREQ / 16 / 100 * 102, 16,
+			UART_BAUDRATE_TOLERANCE, EINVAL);
+	reject ("velocidad por debajo de la mínima", CPU_FREQ / 16 / DIV_MAX / 2, 0,
+			UART_BAUDRATE_TOLERANCE, EINVAL);
+	reject ("sobremuestreo no válido", 115200, 4, UART_BAUDRATE_TOLERANCE, EINVAL);
+	reject ("velocidad inexacta sin tolerancia", 110, 0, 0, EINVAL);
+	if (baudrate_solve (CPU_FREQ, 115200, 0, UART_BAUDRATE_TOLERANCE, NULL) == 0 || errno != EFAULT)
+		fail ("se acepta un resultado nulo", 115200, 0);
+	printf ("rechazada: resultado nulo\n");
+
+	/* La tolerancia es inclusiva: el menor error posible se admite */
+	best = search (110, 16);
+	if (search (110, 8) < best)
+		best = search (110, 8);
+	if (best <= 0 || baudrate_solve (CPU_FREQ, 110, 0, best, &cfg) < 0)
+		fail ("no se admite una velocidad con el error justo en la tolerancia", 110, 0);
+	if (best > 0)
+		reject ("velocidad con un ppm más de error que la tolerancia", 110, 0, best - 1, EINVAL);
+
+	return EXIT_SUCCESS;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,147 @@
+/*
+ * Sistemas operativos empotrados
+ * Banco de pruebas en el host del búfer circular
+ *
+ * Compara el coste por byte de pasar datos por un circular_buffer_t byte a
+ * byte (circular_buffer_write/read) y por bloques (write_block/read_block y
+ * los tramos de peek/commit). Los bloques imitan el trabajo de la isr de la
+ * uart, que mueve hasta 8 bytes del FIFO en cada pasada
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "circular_buffer.h"
+
+/*****************************************************************************/
+
+#define RING_SIZE	256			/* Tamaño de los búferes de la uart */
+#define FIFO_SIZE	8			/* Bytes por pasada de la isr */
+#define READ_SIZE	64			/* Bytes por llamada de la aplicación */
+#define TOTAL		(64 << 20)	/* Bytes que atraviesan el búfer en cada prueba */
+
+static uint8_t ring_data[RING_SIZE];
+static circular_buffer_t ring;
+
+/*****************************************************************************/
+
+/**
+ * Reloj monótono en nanosegundos
+ */
+static double now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*****************************************************************************/
+
+/**
+ * Byte a byte, como hacían la isr y uart_send/uart_receive
+ * @return	Suma de los bytes leídos
+ */
+static uint32_t run_bytes (void)
+{
+	uint32_t sum = 0, moved = 0, i;
+	int32_t c;
+
+	while (moved < TOTAL)
+	{
+		for (i = 0; i < FIFO_SIZE; i++)
+			circular_buffer_write (&ring, (uint8_t) (moved + i));
+		for (i = 0; i < FIFO_SIZE; i++)
+		{
+			c = circular_buffer_read (&ring);
+			if (c >= 0)
+				sum += c;
+		}
+		moved += FIFO_SIZE;
+	}
+
+	return sum;
+}
+
+/*****************************************************************************/
+
+/**
+ * Por bloques: la isr escribe en el tramo libre y la aplicación lee en bloque
+ * @return	Suma de los bytes leídos
+ */
+static uint32_t run_blocks (void)
+{
+	uint8_t fifo[FIFO_SIZE], out[READ_SIZE], *span;
+	uint32_t sum = 0, moved = 0, n, len, i;
+
+	while (moved < TOTAL)
+	{
+		for (i = 0; i < FIFO_SIZE; i++)
+			fifo[i] = (uint8_t) (moved + i);
+
+		/* Como la isr: como mucho dos tramos contiguos */
+		for (i = 0; i < FIFO_SIZE; i += len)
+		{
+			len = circular_buffer_peek_write (&ring, &span);
+			if (len == 0)
+				break;
+			if (len > FIFO_SIZE - i)
+				len = FIFO_SIZE - i;
+			memcpy (span, fifo + i, len);
+			circular_buffer_commit_write (&ring, len);
+		}
+		moved += FIFO_SIZE;
+
+		if (ring.count >= READ_SIZE || moved >= TOTAL)
+		{
+			n = circular_buffer_read_block (&ring, out, READ_SIZE);
+			for (i = 0; i < n; i++)
+				sum += out[i];
+		}
+	}
+
+	while ((n = circular_buffer_read_block (&ring, out, READ_SIZE)) > 0)
+		for (i = 0; i < n; i++)
+			sum += out[i];
+
+	return sum;
+}
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta una prueba y muestra su coste por byte
+ * @param name	Nombre de la prueba
+ * @param run	Prueba
+ * @return	Nanosegundos por byte
+ */
+static double bench (const char *name, uint32_t (*run) (void))
+{
+	double t0, ns;
+	uint32_t sum;
+
+	circular_buffer_init (&ring, ring_data, RING_SIZE);
+	t0 = now_ns ();
+	sum = run ();
+	ns = (now_ns () - t0) / TOTAL;
+
+	printf ("%-10s %6.2f ns/byte (suma %08x)\n", name, ns, sum);
+	return ns;
+}
+
+/*****************************************************************************/
+
+int main (void)
+{
+	double bytes, blocks;
+
+	bytes = bench ("byte", run_bytes);
+	blocks = bench ("bloque", run_blocks);
+
+	printf ("mejora: x%.1f\n", bytes / blocks);
+	return EXIT_SUCCESS;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,365 @@
+/*
+ * Sistemas operativos empotrados
+ * Prueba de estrés en el host del búfer circular SPSC
+ *
+ * Simula una isr que expulsa al otro extremo del búfer en cada frontera de
+ * instrucción. La operación del programa principal se ejecuta con el bit TF
+ * de x86 activo, de modo que el procesador genera un SIGTRAP tras cada
+ * instrucción. El manejador de la señal hace de isr: se ejecuta en el mismo
+ * hilo, hasta el final y sin ser a su vez expulsado (el núcleo borra TF al
+ * entrar en el manejador), igual que una isr en el ARM7.
+ *
+ * Para cada combinación de operaciones (principal productor con isr
+ * consumidora, como la transmisión de la uart, y al revés, como la recepción),
+ * cada nivel de llenado inicial y cada longitud, la isr se inyecta una vez en
+ * la instrucción k, para todo k hasta que la operación termina antes, y
+ * después en todas las instrucciones a la vez. Los bytes son una secuencia, así
+ * que el consumidor detecta cualquier pérdida, duplicado o dato leído antes de
+ * estar escrito
+ */
+
+#if !defined (__x86_64__) && !defined (__i386__)
+#error "La prueba usa el bit TF de x86 para ejecutar paso a paso"
+#endif
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spsc_buffer.h"
+
+/*****************************************************************************/
+
+#define RING_SIZE	8			/* Pequeño para que los índices den muchas vueltas */
+
+SPSC_BUFFER_DEFINE (ring, RING_SIZE);
+
+/**
+ * Siguiente byte que escribirá el productor y que espera el consumidor
+ */
+static uint8_t out_seq;
+static uint8_t in_seq;
+
+/**
+ * Bytes que intenta mover cada operación
+ */
+static uint32_t op_len;
+static uint32_t isr_len;
+
+/**
+ * Estado de la isr simulada
+ */
+typedef void (* op_t) (uint32_t len);
+
+static volatile unsigned long steps;
+static volatile unsigned long inject_at;
+static volatile int inject_every;
+static volatile unsigned long isr_runs;
+static op_t isr_op;
+
+/**
+ * Descripción de la prueba en curso, para los errores
+ */
+static const char *cur_main, *cur_isr;
+static uint32_t cur_fill;
+
+/*****************************************************************************/
+
+/**
+ * Termina con un error describiendo la prueba en curso
+ * @param what	Error
+ */
+static void fail (const char *what)
+{
+	fprintf (stderr, "FALLO: %s\n  principal %s, isr %s, llenado %u, longitudes %u/%u, "
+			 "isr en la instrucción %lu%s (head %u, tail %u)\n",
+			 what, cur_main, cur_isr, cur_fill, op_len, isr_len, inject_at,
+			 inject_every ? " y todas las siguientes" : "", ring.head, ring.tail);
+	exit (EXIT_FAILURE);
+}
+
+/*****************************************************************************/
+
+/**
+ * Comprueba los bytes recibidos por el consumidor
+ * @param buf	Bytes
+ * @param n		Número de bytes
+ */
+static void check (const uint8_t *buf, uint32_t n)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+		if (buf[i] != in_seq++)
+			fail ("secuencia rota");
+}
+
+/*****************************************************************************/
+
+/*
+ * Operaciones del productor, como la isr de recepción y uart_send
+ */
+
+static void prod_block (uint32_t len)
+{
+	uint8_t buf[RING_SIZE];
+	uint32_t i, n;
+
+	for (i = 0; i < len; i++)
+		buf[i] = out_seq + i;
+
+	n = spsc_buffer_write_block (&ring, buf, len);
+	if (n > len)
+		fail ("write_block escribe de más");
+	out_seq += n;
+}
+
+static void prod_span (uint32_t len)
+{
+	uint8_t *span;
+	uint32_t i, n;
+
+	n = spsc_buffer_peek_write (&ring, &span);
+	if (n > len)
+		n = len;
+	for (i = 0; i < n; i++)
+		span[i] = out_seq + i;
+
+	spsc_buffer_commit_write (&ring, n);
+	out_seq += n;
+}
+
+static void prod_stage (uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		if (!spsc_buffer_stage (&ring, i, out_seq + i))
+			break;
+
+	spsc_buffer_commit_write (&ring, i);
+	out_seq += i;
+}
+
+/*****************************************************************************/
+
+/*
+ * Operaciones del consumidor, como uart_receive y la isr de transmisión
+ */
+
+static void cons_block (uint32_t len)
+{
+	uint8_t buf[RING_SIZE];
+	uint32_t n;
+
+	n = spsc_buffer_read_block (&ring, buf, len);
+	if (n > len)
+		fail ("read_block lee de más");
+	check (buf, n);
+}
+
+static void cons_span (uint32_t len)
+{
+	uint8_t *span;
+	uint32_t n;
+
+	n = spsc_buffer_peek_read (&ring, &span);
+	if (n > len)
+		n = len;
+	check (span, n);
+
+	spsc_buffer_commit_read (&ring, n);
+}
+
+/*****************************************************************************/
+
+/**
+ * Manejador de SIGTRAP: cuenta instrucciones y hace de isr
+ */
+static void trap (int sig, siginfo_t *info, void *uc)
+{
+	(void) sig;
+	(void) info;
+	(void) uc;
+
+	steps++;
+	if (inject_every || steps == inject_at)
+	{
+		isr_runs++;
+		isr_op (isr_len);
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Activa y desactiva la ejecución paso a paso
+ */
+static void trace_on (void)
+{
+	asm volatile ("pushf\n\torl $0x100, (%%"
+#ifdef __x86_64__
+				  "rsp"
+#else
+				  "esp"
+#endif
+				  ")\n\tpopf" : : : "memory", "cc");
+}
+
+static void trace_off (void)
+{
+	asm volatile ("pushf\n\tandl $~0x100, (%%"
+#ifdef __x86_64__
+				  "rsp"
+#else
+				  "esp"
+#endif
+				  ")\n\tpopf" : : : "memory", "cc");
+}
+
+/*****************************************************************************/
+
+/**
+ * Vacía el búfer comprobando su contenido y lo deja con fill bytes
+ * @param fill	Bytes que quedan en el búfer
+ */
+static void set_fill (uint32_t fill)
+{
+	cons_block (RING_SIZE);
+	if (!spsc_buffer_is_empty (&ring))
+		fail ("no se vacía");
+
+	prod_block (fill);
+	if (spsc_buffer_count (&ring) != fill)
+		fail ("no se llena");
+}
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta la operación principal con la isr inyectada
+ * @param op	Operación principal
+ * @param at	Instrucción en la que se inyecta la isr, 0 para todas
+ * @return	Número de instrucciones ejecutadas
+ */
+static unsigned long run (op_t op, unsigned long at)
+{
+	steps = 0;
+	inject_at = at;
+	inject_every = (at == 0);
+
+	trace_on ();
+	op (op_len);
+	trace_off ();
+
+	inject_every = 0;
+
+	if (spsc_buffer_count (&ring) > RING_SIZE)
+		fail ("cuenta fuera de rango");
+
+	return steps;
+}
+
+/*****************************************************************************/
+
+/**
+ * Prueba una operación principal contra una isr en todas las instrucciones
+ */
+static void stress (const char *main_name, op_t main_op, const char *isr_name, op_t op)
+{
+	static const uint32_t lens[] = { 1, 3, RING_SIZE };
+	unsigned long k, n;
+	uint32_t fill, i, j;
+
+	cur_main = main_name;
+	cur_isr = isr_name;
+	isr_op = op;
+
+	for (i = 0; i < sizeof (lens) / sizeof (lens[0]); i++)
+		for (j = 0; j < sizeof (lens) / sizeof (lens[0]); j++)
+		{
+			op_len = lens[i];
+			isr_len = lens[j];
+
+			for (fill = 0; fill <= RING_SIZE; fill++)
+			{
+				cur_fill = fill;
+
+				for (k = 1; ; k++)
+				{
+					set_fill (fill);
+					n = run (main_op, k);
+					if (n < k)
+						break;
+				}
+
+				set_fill (fill);
+				run (main_op, 0);
+			}
+		}
+
+	/* Lo que quede debe seguir en orden */
+	set_fill (0);
+
+	printf ("principal %-10s  isr %-10s  ok\n", main_name, isr_name);
+}
+
+/**
+ * Un búfer de tamaño 0 (dirección de la uart deshabilitada) está siempre
+ * vacío y lleno a la vez, y no admite ni entrega bytes
+ */
+static void check_disabled (void)
+{
+	spsc_buffer_t off;
+	uint8_t buf[1] = { 0 }, *span;
+
+	spsc_buffer_init (&off, ring_data, 0);
+	if (!spsc_buffer_is_empty (&off) || !spsc_buffer_is_full (&off) || spsc_buffer_size (&off) != 0 ||
+		spsc_buffer_write_block (&off, buf, 1) != 0 || spsc_buffer_read_block (&off, buf, 1) != 0 ||
+		spsc_buffer_peek_write (&off, &span) != 0 || spsc_buffer_peek_read (&off, &span) != 0 ||
+		spsc_buffer_stage (&off, 0, 0))
+	{
+		fprintf (stderr, "FALLO: búfer de tamaño 0\n");
+		exit (EXIT_FAILURE);
+	}
+
+	printf ("búfer deshabilitado ok\n");
+}
+
+/*****************************************************************************/
+
+#define STRESS(main_op, isr_op)	stress (#main_op, main_op, #isr_op, isr_op)
+
+/*****************************************************************************/
+
+int main (void)
+{
+	struct sigaction sa;
+
+	memset (&sa, 0, sizeof (sa));
+	sa.sa_sigaction = trap;
+	sa.sa_flags = SA_SIGINFO;
+	sigemptyset (&sa.sa_mask);
+	sigaction (SIGTRAP, &sa, NULL);
+
+	check_disabled ();
+
+	/* Transmisión: la aplicación produce y la isr consume */
+	STRESS (prod_block, cons_block);
+	STRESS (prod_block, cons_span);
+	STRESS (prod_span, cons_span);
+	STRESS (prod_stage, cons_span);
+
+	/* Recepción: la isr produce y la aplicación consume */
+	STRESS (cons_block, prod_block);
+	STRESS (cons_block, prod_span);
+	STRESS (cons_block, prod_stage);
+	STRESS (cons_span, prod_span);
+
+	printf ("%lu isr inyectadas\n", isr_runs);
+	return EXIT_SUCCESS;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,433 @@
+/*
+ * Sistemas operativos empotrados
+ * Prueba en el host de la rueda de temporizadores
+ *
+ * Conduce la rueda con un reloj simulado que avanza a saltos: unas veces hasta
+ * el instante que indica timer_wheel_next, como haría el temporizador
+ * hardware, y otras una cantidad aleatoria, como si la isr llegara tarde. Tras
+ * cada salto se extraen todos los vencidos y se comparan con un modelo
+ * ingenuo, una lista con el vencimiento de cada temporizador que se recorre
+ * entera en cada paso. El modelo decide qué debe vencer: cada temporizador se
+ * entrega exactamente en la primera extracción cuyo instante alcanza su
+ * vencimiento, ni antes ni después.
+ *
+ * El reloj empieza cerca del final del rango de 32 bits para que los instantes
+ * den la vuelta, y las operaciones aleatorias mezclan temporizadores de un
+ * disparo y periódicos, vencimientos pasados, cercanos y más allá del rango de
+ * la rueda, cancelaciones normales, desde la propia callback y de
+ * identificadores ya liberados, y altas desde las callbacks
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "timer_wheel.h"
+
+/*****************************************************************************/
+
+#define POOL_SIZE	64				/* Pequeño para que la reserva se agote a menudo */
+#define STEPS		1000000			/* Saltos del reloj */
+#define CLOCK_START	0xFFFF0000u		/* Da la vuelta al poco de empezar */
+
+static timer_wheel_node_t pool[POOL_SIZE];
+static timer_wheel_t wheel;
+
+/**
+ * Modelo de referencia: un temporizador por nodo de la reserva, indexado por
+ * la parte baja del identificador
+ */
+typedef struct
+{
+	int32_t id;
+	uint32_t due;					/* Vencimiento esperado */
+	uint32_t period;
+	int active;
+	int cancelled;					/* Cancelado desde su propia callback */
+} ref_timer_t;
+
+static ref_timer_t ref[POOL_SIZE];
+static uint32_t ref_active;
+
+/**
+ * Estado de la simulación
+ */
+static uint32_t now;				/* Reloj simulado */
+static uint32_t last_due;			/* Vencimiento de la última entrega del salto */
+static int32_t stale_id = -1;		/* Identificador ya liberado */
+static unsigned long step;
+
+/**
+ * Estadísticas, para comprobar que se ha ejercitado todo
+ */
+static unsigned long n_fired, n_periodic, n_cancel, n_cancel_self, n_cancel_other,
+	n_stale, n_far, n_past, n_full, n_wraps;
+
+/*****************************************************************************/
+
+/**
+ * Generador pseudoaleatorio xorshift, con semilla fija para que los fallos se
+ * puedan reproducir
+ * @return	Número aleatorio
+ */
+static uint32_t rnd (void)
+{
+	static uint32_t x = 2463534242u;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+/*****************************************************************************/
+
+/**
+ * Termina con un error describiendo el paso en curso
+ * @param what	Error
+ * @param id	Temporizador implicado, -1 si no hay ninguno
+ */
+static void fail (const char *what, int32_t id)
+{
+	fprintf (stderr, "FALLO: %s\n  paso %lu, reloj 0x%08x, temporizador 0x%08x",
+			 what, step, now, (unsigned) id);
+	if (id >= 0)
+		fprintf (stderr, " (vencimiento 0x%08x, periodo %u)",
+				 ref[id & 0xFFFF].due, ref[id & 0xFFFF].period);
+	fprintf (stderr, "\n");
+	exit (EXIT_FAILURE);
+}
+
+/*****************************************************************************/
+
+/**
+ * Busca el temporizador del modelo que corresponde a un identificador
+ * @param id	Identificador
+ * @return	El temporizador o NULL si no está activo en el modelo
+ */
+static ref_timer_t *ref_lookup (int32_t id)
+{
+	ref_timer_t *t;
+
+	if (id < 0 || (id & 0xFFFF) >= POOL_SIZE)
+		return NULL;
+
+	t = &ref[id & 0xFFFF];
+	return (t->active && t->id == id) ? t : NULL;
+}
+
+/*****************************************************************************/
+
+/**
+ * Elige un temporizador activo del modelo al azar
+ * @return	El temporizador o NULL si no hay ninguno
+ */
+static ref_timer_t *ref_pick (void)
+{
+	uint32_t i, start = rnd () % POOL_SIZE;
+
+	for (i = 0; i < POOL_SIZE; i++)
+		if (ref[(start + i) % POOL_SIZE].active)
+			return &ref[(start + i) % POOL_SIZE];
+
+	return NULL;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retira un temporizador del modelo y recuerda su identificador para
+ * comprobar después que ya no es válido
+ * @param t	Temporizador
+ */
+static void ref_drop (ref_timer_t *t)
+{
+	t->active = 0;
+	stale_id = t->id;
+	ref_active--;
+}
+
+/*****************************************************************************/
+
+/**
+ * Elige un vencimiento aleatorio a partir del reloj: cercano casi siempre, a
+ * veces más allá del rango de la rueda y, si se permite, a veces pasado
+ * @param past	Se permiten vencimientos pasados
+ * @param due	Destino del vencimiento que espera el modelo
+ * @return	Vencimiento que se pasa a la rueda
+ */
+static uint32_t pick_expires (int past, uint32_t *due)
+{
+	uint32_t r = rnd () % 100;
+	uint32_t expires;
+
+	if (past && r < 5)
+	{
+		/* Vencido: se entrega en la siguiente unidad por procesar, que con la
+		   rueda vacía es el instante actual */
+		expires = now - rnd () % 1000;
+		*due = ref_active ? wheel.now : now;
+		n_past++;
+		return expires;
+	}
+
+	if (r < 10)
+	{
+		expires = now + TIMER_WHEEL_RANGE + rnd () % (4 * TIMER_WHEEL_RANGE);
+		n_far++;
+	}
+	else if (r < 30)
+		expires = now + 1 + rnd () % (TIMER_WHEEL_RANGE - 1);
+	else if (r < 60)
+		expires = now + 1 + rnd () % (TIMER_WHEEL_SLOTS * TIMER_WHEEL_SLOTS);
+	else
+		expires = now + 1 + rnd () % TIMER_WHEEL_SLOTS;
+
+	*due = expires;
+	return expires;
+}
+
+/*****************************************************************************/
+
+static void callback (int32_t id, void *ctx);
+
+/**
+ * Añade un temporizador aleatorio a la rueda y al modelo
+ * @param past	Se permiten vencimientos pasados
+ */
+static void add (int past)
+{
+	uint32_t due, expires, period = 0;
+	ref_timer_t *t;
+	int32_t id;
+
+	/* Los periódicos se reprograman desde su vencimiento, que debe ser futuro */
+	if (rnd () % 3 == 0)
+	{
+		period = 1 + rnd () % ((rnd () % 4) ? TIMER_WHEEL_SLOTS * 4 : TIMER_WHEEL_RANGE * 2);
+		past = 0;
+	}
+
+	expires = pick_expires (past, &due);
+	id = timer_wheel_add (&wheel, now, expires, period, callback, NULL);
+
+	if (id < 0)
+	{
+		if (ref_active != POOL_SIZE)
+			fail ("timer_wheel_add falla con nodos libres", id);
+		n_full++;
+		return;
+	}
+	if (ref_active == POOL_SIZE)
+		fail ("timer_wheel_add devuelve un nodo con la reserva agotada", id);
+	if (ref_lookup (id) || id == stale_id)
+		fail ("timer_wheel_add repite un identificador", id);
+
+	t = &ref[id & 0xFFFF];
+	t->id = id;
+	t->due = due;
+	t->period = period;
+	t->active = 1;
+	t->cancelled = 0;
+	ref_active++;
+}
+
+/*****************************************************************************/
+
+/**
+ * Cancela un temporizador activo al azar, o uno ya liberado, que debe fallar
+ */
+static void cancel (void)
+{
+	ref_timer_t *t = ref_pick ();
+
+	if (rnd () % 4 == 0 && stale_id >= 0)
+	{
+		if (timer_wheel_cancel (&wheel, stale_id) == 0)
+			fail ("timer_wheel_cancel acepta un identificador liberado", stale_id);
+		n_stale++;
+		return;
+	}
+
+	if (!t)
+		return;
+
+	if (timer_wheel_cancel (&wheel, t->id) < 0)
+		fail ("timer_wheel_cancel falla con un temporizador activo", t->id);
+	ref_drop (t);
+	n_cancel++;
+}
+
+/*****************************************************************************/
+
+/**
+ * Callback de los temporizadores. Comprueba contra el modelo que el
+ * temporizador tocaba y, a veces, cancela este u otro temporizador o añade uno
+ * nuevo, como pueden hacer las callbacks reales
+ * @param id	Identificador del temporizador
+ * @param ctx	No se usa
+ */
+static void callback (int32_t id, void *ctx)
+{
+	ref_timer_t *t = ref_lookup (id), *other;
+	uint32_t r = rnd () % 100;
+
+	(void) ctx;
+
+	if (!t)
+		fail ("se entrega un temporizador que no está activo", id);
+	if ((int32_t) (t->due - now) > 0)
+		fail ("se entrega un temporizador antes de su vencimiento", id);
+	if ((int32_t) (t->due - last_due) < 0)
+		fail ("se entregan los vencimientos desordenados", id);
+
+	last_due = t->due;
+	n_fired++;
+
+	if (r < 5)
+	{
+		/* Cancelación desde la propia callback: timer_wheel_finish lo libera */
+		if (timer_wheel_cancel (&wheel, id) < 0)
+			fail ("timer_wheel_cancel falla desde la callback", id);
+		if (timer_wheel_cancel (&wheel, id) == 0)
+			fail ("timer_wheel_cancel acepta dos veces el mismo temporizador", id);
+		t->cancelled = 1;
+		n_cancel_self++;
+	}
+	else if (r < 10 && (other = ref_pick ()) != NULL && other != t)
+	{
+		/* Cancelación de otro temporizador, que puede estar ya en la lista de vencidos */
+		if (timer_wheel_cancel (&wheel, other->id) < 0)
+			fail ("timer_wheel_cancel falla con otro temporizador desde la callback", other->id);
+		ref_drop (other);
+		n_cancel_other++;
+	}
+	else if (r < 15)
+		add (0);
+}
+
+/*****************************************************************************/
+
+/**
+ * Extrae y entrega todos los vencidos hasta el reloj actual, y comprueba que
+ * no queda en el modelo ningún vencimiento alcanzado
+ */
+static void expire (void)
+{
+	timer_wheel_callback_t func;
+	ref_timer_t *t;
+	uint32_t i;
+	int32_t id;
+	void *ctx;
+
+	last_due = now - 0x40000000u;
+
+	while ((id = timer_wheel_expire (&wheel, now, &func, &ctx)) >= 0)
+	{
+		func (id, ctx);
+		timer_wheel_finish (&wheel, id);
+
+		t = &ref[id & 0xFFFF];
+		if (t->cancelled || !t->period)
+			ref_drop (t);
+		else
+		{
+			t->due += t->period;
+			n_periodic++;
+		}
+	}
+
+	for (i = 0; i < POOL_SIZE; i++)
+		if (ref[i].active && (int32_t) (ref[i].due - now) <= 0)
+			fail ("un temporizador vencido no se entrega", ref[i].id);
+}
+
+/*****************************************************************************/
+
+/**
+ * Comprueba timer_wheel_next contra el modelo: sin temporizadores no hay
+ * trabajo, y con ellos el próximo instante no es anterior a la siguiente unidad
+ * por procesar ni posterior al vencimiento más cercano (puede ser anterior para bajar una ranura de nivel)
+ * @param when	Destino del instante, si lo hay
+ * @return	Cero si hay trabajo o -1 si la rueda está vacía
+ */
+static int32_t next (uint32_t *when)
+{
+	uint32_t i, earliest = 0;
+	int found = 0;
+
+	for (i = 0; i < POOL_SIZE; i++)
+		if (ref[i].active && (!found || (int32_t) (ref[i].due - earliest) < 0))
+		{
+			earliest = ref[i].due;
+			found = 1;
+		}
+
+	if (timer_wheel_next (&wheel, when) < 0)
+	{
+		if (found)
+			fail ("timer_wheel_next no ve temporizadores pendientes", -1);
+		return -1;
+	}
+
+	if (!found)
+		fail ("timer_wheel_next encuentra trabajo en una rueda vacía", -1);
+	if ((int32_t) (*when - wheel.now) < 0)
+		fail ("timer_wheel_next devuelve un instante ya procesado", -1);
+	if ((int32_t) (*when - earliest) > 0)
+		fail ("timer_wheel_next devuelve un instante posterior al próximo vencimiento", -1);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+int main (void)
+{
+	uint32_t when, r, prev, i;
+
+	now = CLOCK_START;
+	timer_wheel_init (&wheel, pool, POOL_SIZE, now);
+
+	for (step = 0; step < STEPS; step++)
+	{
+		/* Operaciones de la aplicación entre dos isr. De vez en cuando una
+		   ráfaga de altas agota la reserva */
+		r = rnd () % 1000;
+		if (r == 0)
+			for (i = 0; i <= POOL_SIZE; i++)
+				add (1);
+		else if (r < 450)
+			add (1);
+		else if (r < 600)
+			cancel ();
+
+		/* La isr llega en el instante programado o más tarde */
+		prev = now;
+		r = rnd () % 100;
+		if (next (&when) == 0 && r < 60)
+			now = when;
+		else if (r < 95)
+			now += 1 + rnd () % TIMER_WHEEL_SLOTS;
+		else
+			now += 1 + rnd () % (TIMER_WHEEL_RANGE / 4);
+		if (now < prev)
+			n_wraps++;
+
+		expire ();
+	}
+
+	if (!n_wraps || !n_periodic || !n_cancel_self || !n_cancel_other || !n_stale ||
+		!n_far || !n_past || !n_full)
+		fail ("la prueba no ha ejercitado todos los casos", -1);
+
+	printf ("%lu pasos, %lu vueltas del reloj\n", step, n_wraps);
+	printf ("%lu entregas (%lu periódicas), %lu vencimientos pasados, %lu lejanos\n",
+			n_fired, n_periodic, n_past, n_far);
+	printf ("%lu cancelaciones, %lu desde la callback, %lu de otro desde la callback, "
+			"%lu de identificadores liberados\n", n_cancel, n_cancel_self, n_cancel_other, n_stale);
+	printf ("%lu altas con la reserva agotada\n", n_full);
+
+	return EXIT_SUCCESS;
+}
+
+/*****************************************************************************/